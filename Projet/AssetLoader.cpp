@@ -0,0 +1,332 @@
+#include "AssetLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include "FileUtil.h"
+#include "KtxCache.h"
+#include "Texture.h"
+
+AssetLoader::AssetLoader(MeshRegistry& registry, TextureCache& textures, unsigned threadCount)
+    : registry_(registry), textures_(textures), compression_(queryCompressionSupport()), decodeBudget_(kDecodeBudget),
+      streamer_(textures, [this](const std::string& path, GLuint texture) { resumeTexture(path, texture); }),
+      pool_(threadCount) {
+}
+
+AssetLoader::~AssetLoader() {
+    // Workers waiting for decode memory would never be let through otherwise
+    decodeBudget_.close();
+}
+
+std::shared_ptr<ImageData> AssetLoader::decodeTexture(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        return std::make_shared<ImageData>();
+    }
+
+    // The pixels count against the budget until the last owner drops them,
+    // which is normally the upload on the GL thread
+    size_t bytes = decodedImageSize(file.data(), file.size(), true);
+    decodeBudget_.acquire(bytes);
+    std::shared_ptr<ImageData> image(new ImageData(), [this, bytes](ImageData* image) {
+        delete image;
+        decodeBudget_.release(bytes);
+    });
+    decodeImage(path.c_str(), file.data(), file.size(), *image);
+    return image;
+}
+
+std::shared_ptr<CompressedImage> AssetLoader::reserveCompressed(size_t bytes) {
+    decodeBudget_.acquire(bytes);
+    return std::shared_ptr<CompressedImage>(new CompressedImage(), [this, bytes](CompressedImage* image) {
+        delete image;
+        decodeBudget_.release(bytes);
+    });
+}
+
+std::shared_ptr<CompressedImage> AssetLoader::importTexture(const std::string& path,
+    std::shared_ptr<ImageData>& image) {
+    FileInfo cacheInfo;
+    if (getFileInfo(ktxCachePath(path), cacheInfo)) {
+        std::shared_ptr<CompressedImage> compressed = reserveCompressed((size_t)cacheInfo.size);
+        if (readKtxCache(path, compression_, *compressed)) return compressed;
+    }
+
+    image = decodeTexture(path);
+    CompressedImage blocks;
+    if (!image->pixels) return nullptr;
+    if (!compressImage(*image, compression_, blocks)) {
+        buildMips(*image);
+        return nullptr;
+    }
+    if (!writeKtxCache(path, blocks)) std::cerr << "Failed to write texture cache: " << ktxCachePath(path) << std::endl;
+
+    // Trade the decoded image's share of the budget for the smaller blocks
+    image.reset();
+    std::shared_ptr<CompressedImage> compressed = reserveCompressed(blocks.blocks.size());
+    *compressed = std::move(blocks);
+    return compressed;
+}
+
+void AssetLoader::resumeTexture(const std::string& path, GLuint texture) {
+    pool_.submit([this, path, texture]() {
+        std::shared_ptr<ImageData> image;
+        std::shared_ptr<CompressedImage> compressed = importTexture(path, image);
+        queueUpload([this, texture, image, compressed]() {
+            streamer_.resume(texture, image, compressed);
+            return true;
+        });
+    });
+}
+
+void AssetLoader::queueUpload(std::function<bool()> upload) {
+    std::lock_guard<std::mutex> lock(uploadMutex_);
+    uploads_.push_back(std::move(upload));
+}
+
+void AssetLoader::watch(const std::string& path) {
+    if (watcher_) watcher_->watch(path);
+}
+
+void AssetLoader::loadMesh(const std::string& path, MeshCallback onLoaded) {
+    if (MeshHandle mesh = registry_.find(path)) {
+        onLoaded(mesh);
+        return;
+    }
+
+    pending_++;
+    std::vector<MeshCallback>& waiters = meshWaiters_[path];
+    waiters.push_back(std::move(onLoaded));
+    if (waiters.size() > 1) return;
+
+    // Watched whether or not it loads, so fixing a broken file retries it
+    std::string key = canonicalPath(path);
+    meshPaths_.insert(key);
+    meshesLoading_.insert(key);
+    watch(path);
+
+    pool_.submit([this, path]() {
+        auto data = std::make_shared<MeshData>();
+        bool ok = loadModel(path, *data);
+
+        // With a staging ring the mesh streams in over as many frames as it needs
+        queueUpload([this, path, data, ok, mesh = MeshHandle(), upload = std::shared_ptr<MeshUpload>()]() mutable {
+            if (ok && !mesh) mesh = staging_ ? registry_.addStreamed(path, data, upload) : registry_.add(path, *data);
+            if (upload && !upload->step(*staging_)) return false;
+
+            std::vector<MeshCallback> callbacks = std::move(meshWaiters_[path]);
+            meshWaiters_.erase(path);
+            std::string key = canonicalPath(path);
+            meshesLoading_.erase(key);
+            // A reload parsed while this load was in flight has the newer file
+            auto reloaded = pendingReloads_.find(key);
+            if (reloaded != pendingReloads_.end()) {
+                std::shared_ptr<const MeshData> newer = std::move(reloaded->second);
+                pendingReloads_.erase(reloaded);
+                mesh = mesh ? registry_.reload(key, *newer) : registry_.add(key, *newer);
+            }
+            if (mesh) {
+                loadMaterialTextures(mesh);
+                // Requests that failed earlier get the mesh as well
+                auto failed = failedMeshes_.find(key);
+                if (failed != failedMeshes_.end()) {
+                    std::vector<MeshCallback> earlier = std::move(failed->second);
+                    failedMeshes_.erase(failed);
+                    for (MeshCallback& callback : earlier) callback(mesh);
+                }
+            }
+            else {
+                std::vector<MeshCallback>& parked = failedMeshes_[key];
+                parked.insert(parked.end(), callbacks.begin(), callbacks.end());
+            }
+            for (MeshCallback& callback : callbacks) {
+                pending_--;
+                callback(mesh);
+            }
+            return true;
+        });
+    });
+}
+
+void AssetLoader::loadMaterialTextures(const MeshHandle& mesh) {
+    if (mesh->texturesRequested) return;
+    mesh->texturesRequested = true;
+
+    // After a reload only the maps the new materials added are missing
+    std::vector<std::string> paths;
+    for (const GpuMaterial& material : mesh->materials) {
+        const std::string& path = material.diffuseTexture;
+        if (!path.empty() && !material.diffuseMap && std::find(paths.begin(), paths.end(), path) == paths.end()) {
+            paths.push_back(path);
+        }
+    }
+    std::weak_ptr<GpuMesh> owner = mesh;
+    for (const std::string& path : paths) {
+        loadTexture(path, [owner, path](TextureHandle texture) {
+            if (MeshHandle mesh = owner.lock()) mesh->setDiffuseMap(path, texture);
+        });
+    }
+}
+
+void AssetLoader::loadTexture(const std::string& path, TextureCallback onLoaded) {
+    if (TextureHandle texture = textures_.find(path)) {
+        onLoaded(texture);
+        return;
+    }
+
+    pending_++;
+    std::vector<TextureCallback>& waiters = textureWaiters_[path];
+    waiters.push_back(std::move(onLoaded));
+    if (waiters.size() > 1) return;
+
+    pool_.submit([this, path]() {
+        std::shared_ptr<ImageData> image;
+        std::shared_ptr<CompressedImage> compressed = importTexture(path, image);
+        TextureInfo info = compressed ? describeTexture(*compressed) : describeTexture(*image);
+
+        bool packed = compressed ? fitsLayer(*compressed) : fitsLayer(*image);
+
+        queueUpload([this, path, image, compressed, info, packed, texture = TextureHandle(),
+            upload = std::shared_ptr<TextureUpload>(), layer = TextureLayer(),
+            layerUpload = std::shared_ptr<LayerUpload>()]() mutable {
+            // A renamed copy of a live texture is shared before anything is uploaded
+            if (!texture && !upload && !layer.array) texture = textures_.findContent(path, info);
+            if (!texture && packed) {
+                if (!layer.array) {
+                    layer = compressed ? arrays_.allocate(*compressed) : arrays_.allocate(*image);
+                    if (staging_) {
+                        layerUpload = compressed ? std::make_shared<LayerUpload>(layer, compressed)
+                                                 : std::make_shared<LayerUpload>(layer, image);
+                    }
+                    else if (compressed) {
+                        uploadLayer(layer, *compressed);
+                    }
+                    else {
+                        uploadLayer(layer, *image);
+                    }
+                }
+                if (layerUpload && !layerUpload->step(*staging_)) return false;
+                texture = textures_.add(path, layer, info);
+            }
+            else if (!texture && staging_) {
+                if (!upload) {
+                    upload = compressed ? std::make_shared<TextureUpload>(compressed)
+                                        : std::make_shared<TextureUpload>(image);
+                }
+                // Out as soon as the small levels are; the streamer does the rest
+                if (!upload->step(*staging_, upload->levelFor(kStreamTailSize))) return false;
+                texture = textures_.add(path, upload->texture(), info);
+                streamer_.add(texture, upload);
+            }
+            else if (!texture) {
+                texture = textures_.add(path, compressed ? uploadTexture(*compressed) : uploadTexture(*image), info);
+            }
+            texturePaths_.insert(canonicalPath(path));
+            watch(path);
+
+            std::vector<TextureCallback> callbacks = std::move(textureWaiters_[path]);
+            textureWaiters_.erase(path);
+            for (size_t i = 0; i < callbacks.size(); i++) {
+                if (i > 0) textures_.countShared(*texture);
+                pending_--;
+                callbacks[i](texture);
+            }
+            return true;
+        });
+    });
+}
+
+bool AssetLoader::reload(const std::string& path) {
+    std::string key = canonicalPath(path);
+    bool isMesh = meshPaths_.count(key) > 0;
+    if (!isMesh && !texturePaths_.count(key)) return false;
+
+    uint64_t generation = ++reloadGenerations_[key];
+    auto start = std::chrono::steady_clock::now();
+    auto report = [key, start]() {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Reloaded %s in %.1f ms\n", key.c_str(), ms);
+    };
+
+    if (isMesh) {
+        pool_.submit([this, key, generation, report]() {
+            // A file caught mid-write fails to parse; its final write reloads it again
+            auto data = std::make_shared<MeshData>();
+            if (!loadModel(key, *data)) return;
+
+            queueUpload([this, key, generation, report, data]() {
+                if (reloadGenerations_[key] != generation) return true;
+                if (MeshHandle mesh = registry_.reload(key, *data)) {
+                    loadMaterialTextures(mesh);
+                    report();
+                    return true;
+                }
+                // Applied by the load still in flight once it is in
+                if (meshesLoading_.count(key)) {
+                    pendingReloads_[key] = data;
+                    return true;
+                }
+
+                // A mesh that failed to load goes to the requests that got null
+                auto failed = failedMeshes_.find(key);
+                if (failed == failedMeshes_.end()) return true;
+                MeshHandle mesh = registry_.add(key, *data);
+                std::vector<MeshCallback> callbacks = std::move(failed->second);
+                failedMeshes_.erase(failed);
+                loadMaterialTextures(mesh);
+                report();
+                for (MeshCallback& callback : callbacks) callback(mesh);
+                return true;
+            });
+        });
+        return true;
+    }
+
+    pool_.submit([this, key, generation, report]() {
+        // The edit invalidates the KTX2 cache, so this compresses afresh
+        std::shared_ptr<ImageData> image;
+        std::shared_ptr<CompressedImage> compressed = importTexture(key, image);
+        if (!compressed && !image->pixels) return;
+
+        queueUpload([this, key, generation, report, image, compressed]() {
+            if (reloadGenerations_[key] != generation) return true;
+            if (compressed ? textures_.reload(key, *compressed) : textures_.reload(key, *image)) report();
+            return true;
+        });
+    });
+    return true;
+}
+
+void AssetLoader::pumpUploads(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    bool ringFull = false;
+    for (;;) {
+        std::function<bool()> upload;
+        {
+            std::lock_guard<std::mutex> lock(uploadMutex_);
+            if (uploads_.empty()) break;
+            upload = std::move(uploads_.front());
+            uploads_.pop_front();
+        }
+
+        // An upload the staging ring has no more room for this frame goes
+        // on next frame, ahead of the rest so assets arrive in order
+        if (!upload()) {
+            std::lock_guard<std::mutex> lock(uploadMutex_);
+            uploads_.push_front(std::move(upload));
+            ringFull = true;
+            break;
+        }
+
+        // At least one upload per frame so large assets cannot stall forever
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetMs) break;
+    }
+    if (staging_) {
+        if (!ringFull) streamer_.update(*staging_);
+        staging_->endFrame();
+    }
+}
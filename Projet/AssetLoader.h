@@ -0,0 +1,145 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "FileWatcher.h"
+#include "MemoryBudget.h"
+#include "MeshRegistry.h"
+#include "StagingRing.h"
+#include "TextureArray.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+// Texture bytes in flight at once: decoded or read from the compressed
+// cache on a worker and not yet uploaded. Loads past it wait, so a burst of
+// large images cannot exhaust memory while the GL thread catches up.
+const size_t kDecodeBudget = 256u << 20;
+
+// Streams assets in without blocking the frame loop. Parsing and decoding
+// run on a worker pool, and textures are block-compressed there once and
+// read back from their KTX2 cache afterwards; the GL upload for each
+// finished asset is queued and performed by pumpUploads on the context
+// thread, which then calls the asset's completion callback. Small textures
+// with power-of-two sides are packed into texture array layers; with a
+// staging ring, the others are handed out as soon as their small mips are
+// in and a TextureStreamer refines them over the following frames. Requests
+// and callbacks live on the GL thread.
+//
+// Loaded assets can be reloaded from disk: the file is imported again on a
+// worker and the new data is swapped into the existing GL objects by the
+// next pumpUploads, between frames, so handles stay valid and nothing else
+// is touched.
+class AssetLoader {
+public:
+    using MeshCallback = std::function<void(MeshHandle)>;
+    using TextureCallback = std::function<void(TextureHandle)>;
+
+    // GL thread, to learn which block formats the context samples
+    AssetLoader(MeshRegistry& registry, TextureCache& textures, unsigned threadCount = 0);
+    ~AssetLoader();
+
+    // Concurrent requests for one path share a single parse and upload. A
+    // mesh that fails to load is still watched: onLoaded gets null, and is
+    // called again with the mesh once a write to the file imports cleanly.
+    void loadMesh(const std::string& path, MeshCallback onLoaded);
+    void loadTexture(const std::string& path, TextureCallback onLoaded);
+
+    // Meshes and textures loaded from now on are watched for changes by
+    // watcher, which the frame loop polls and passes to reload
+    void setFileWatcher(FileWatcher* watcher) { watcher_ = watcher; }
+
+    // Uploads from now on are staged through ring and stream in over several
+    // frames when large; without one they upload directly. pumpUploads ends
+    // the ring's frame.
+    void setStagingRing(StagingRing* ring) { staging_ = ring; }
+
+    // Re-imports the mesh or texture loaded from path. Returns false if path
+    // is not an asset of this loader. Of several reloads of one path in
+    // flight, only the newest is applied.
+    bool reload(const std::string& path);
+
+    // Runs queued uploads until the time budget is spent or the staging ring
+    // is full, then streams texture levels into what is left of the ring;
+    // call once per frame
+    void pumpUploads(double budgetMs);
+
+    // Assets requested but not yet handed to their callback
+    size_t pending() const { return pending_; }
+
+    // Most decoded texture bytes held at once so far
+    size_t decodePeakBytes() const { return decodeBudget_.peak(); }
+
+    // Video memory the streamed textures' levels are kept within
+    void setTextureBudget(size_t bytes) { streamer_.setBudget(bytes); }
+    const TextureStreamer& streamer() const { return streamer_; }
+    const TextureArrayPool& textureArrays() const { return arrays_; }
+
+private:
+    // upload returns false to be run again next frame
+    void queueUpload(std::function<bool()> upload);
+    void watch(const std::string& path);
+
+    // Maps the file, waits for decode budget (for the pixels and a mip
+    // chain) and decodes from the mapping. Never null; pixels are null on
+    // failure.
+    std::shared_ptr<ImageData> decodeTexture(const std::string& path);
+
+    // Empty compressed image whose bytes count against the budget until it
+    // is destroyed
+    std::shared_ptr<CompressedImage> reserveCompressed(size_t bytes);
+
+    // Worker side of a texture load: the KTX2 cache of path when it is
+    // valid, else decodes it and, when the context samples a block format
+    // for it, compresses it and writes the cache. Returns the compressed
+    // image, or null with image set to the decoded one and its mips.
+    std::shared_ptr<CompressedImage> importTexture(const std::string& path, std::shared_ptr<ImageData>& image);
+
+    // Imports path again for the streamer, which released the data of texture
+    void resumeTexture(const std::string& path, GLuint texture);
+
+    // Streams in the diffuse maps of a newly uploaded mesh, once per mesh
+    void loadMaterialTextures(const MeshHandle& mesh);
+
+    MeshRegistry& registry_;
+    TextureCache& textures_;
+    CompressionSupport compression_;
+    TextureArrayPool arrays_;
+
+    // Before the upload queue and the streamer, whose images release into it
+    // when destroyed
+    MemoryBudget decodeBudget_;
+    TextureStreamer streamer_;
+
+    std::unordered_map<std::string, std::vector<MeshCallback>> meshWaiters_;
+    std::unordered_map<std::string, std::vector<TextureCallback>> textureWaiters_;
+    // Callbacks of meshes that failed to load, by canonical path, for the
+    // reload that fixes them
+    std::unordered_map<std::string, std::vector<MeshCallback>> failedMeshes_;
+    // Canonical paths of meshes being loaded, and reloads that came in
+    // before their load was
+    std::unordered_set<std::string> meshesLoading_;
+    std::unordered_map<std::string, std::shared_ptr<const MeshData>> pendingReloads_;
+    // Canonical paths of what has been requested, for reload
+    std::unordered_set<std::string> meshPaths_;
+    std::unordered_set<std::string> texturePaths_;
+    std::unordered_map<std::string, uint64_t> reloadGenerations_;
+    FileWatcher* watcher_ = nullptr;
+    StagingRing* staging_ = nullptr;
+    std::deque<std::function<bool()>> uploads_;
+    std::mutex uploadMutex_;
+    std::atomic<size_t> pending_{ 0 };
+
+    // Declared last so workers are joined before the queue above is destroyed
+    ThreadPool pool_;
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include "Benchmark.h"
+#include "FileUtil.h"
+#include "IndexCodec.h"
+#include "LzCodec.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MipGenerator.h"
+#include "ObjParser.h"
+#include "Texture.h"
+#include "VertexCodec.h"
+#include "VertexFormat.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kRuns = 3;
+
+const char* const kSceneAssets[] = {
+    "Objects\\Cottage\\cottage_obj.obj",
+    "Objects\\OBJ\\OBJ.obj",
+    "Objects\\Wolf\\Wolf_obj.obj",
+    "cube.obj",
+};
+
+const char* const kMipAssets[] = {
+    "Objects\\Human\\Texture_humain.jpg",
+};
+
+std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Fastest of kRuns parses, in seconds; negative if the parser failed
+template <typename Parse>
+double timeParser(Parse parse) {
+    double best = -1.0;
+    for (int run = 0; run < kRuns; run++) {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = parse(attrib, shapes, materials, warn, err);
+        double elapsed = seconds(start);
+        if (!ok) {
+            std::cerr << "ERR: " << err << std::endl;
+            return -1.0;
+        }
+        if (best < 0.0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+void benchmarkObj(const std::string& path) {
+    FileInfo info;
+    if (!getFileInfo(path, info)) {
+        std::cerr << "WARN: " << path << " not found, skipped" << std::endl;
+        return;
+    }
+    double megabytes = (double)info.size / (1024.0 * 1024.0);
+    std::string dir = directoryOf(path);
+
+    double tiny = timeParser([&](tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+        std::vector<tinyobj::material_t>& materials, std::string& warn, std::string& err) {
+        return tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), dir.c_str());
+    });
+    double parallel = timeParser([&](tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+        std::vector<tinyobj::material_t>& materials, std::string& warn, std::string& err) {
+        return loadObjParallel(path, attrib, shapes, materials, warn, err, dir);
+    });
+    if (tiny < 0.0 || parallel < 0.0) return;
+
+    printf("%-40s %9.2f MB  tinyobj %8.1f MB/s  mapped %8.1f MB/s  (%.2fx)\n", path.c_str(), megabytes,
+        megabytes / tiny, megabytes / parallel, tiny / parallel);
+}
+
+// Grid of about `triangles` triangles with normals and texcoords
+bool writeSyntheticObj(const std::string& path, size_t triangles) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    size_t cells = (size_t)std::ceil(std::sqrt((double)triangles / 2.0));
+    std::vector<char> buffer(1 << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    fprintf(file, "# synthetic benchmark grid, %zu x %zu cells\no grid\n", cells, cells);
+    for (size_t y = 0; y <= cells; y++) {
+        for (size_t x = 0; x <= cells; x++) {
+            float u = (float)x / (float)cells, v = (float)y / (float)cells;
+            float height = 0.05f * std::sin(u * 25.0f) * std::cos(v * 17.0f);
+            fprintf(file, "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n",
+                u * 2.0f - 1.0f, height, v * 2.0f - 1.0f, -height, 0.998f, height * 0.5f, u, v);
+        }
+    }
+    size_t row = cells + 1;
+    for (size_t y = 0; y < cells; y++) {
+        for (size_t x = 0; x < cells; x++) {
+            size_t a = y * row + x + 1, b = a + 1, c = a + row, d = c + 1;
+            fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                a, a, a, b, b, b, d, d, d, a, a, a, d, d, d, c, c, c);
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+// Fastest of kRuns loads, in seconds; negative if one failed
+template <typename Load>
+double timeLoad(Load load) {
+    double best = -1.0;
+    for (int run = 0; run < kRuns; run++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!load()) return -1.0;
+        double elapsed = seconds(start);
+        if (best < 0.0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+double cacheMegabytes(const std::string& path) {
+    FileInfo info;
+    getFileInfo(meshCachePath(path), info);
+    return (double)info.size / (1024.0 * 1024.0);
+}
+
+void benchmarkCache(const std::string& path) {
+    MeshData loaded;
+    if (!loadModel(path, loaded)) {
+        std::cerr << "WARN: " << path << " could not be loaded, skipped" << std::endl;
+        return;
+    }
+
+    // Own the vertices and let go of the mapping so the cache can be rewritten
+    MeshData mesh = loaded;
+    mesh.vertices.assign(loaded.vertexData, loaded.vertexData + loaded.vertexCount * kVertexStride);
+    mesh.packing.vertices.assign(loaded.packedData, loaded.packedData + loaded.vertexCount);
+    mesh.useOwnedStorage();
+    loaded = MeshData();
+
+    size_t vertexBytes = mesh.vertexCount * kVertexStride * sizeof(float);
+    size_t packedBytes = mesh.vertexCount * sizeof(PackedVertex);
+    uint32_t flags = mesh.optimizeFlags;
+
+    // Raw vertices are mapped, not read: copy either stream once like
+    // glBufferData would
+    std::vector<unsigned char> staging(vertexBytes);
+    if (!writeMeshCache(path, mesh, false)) return;
+    double rawSize = cacheMegabytes(path);
+    double raw = timeLoad([&]() {
+        MeshData cached;
+        if (!readMeshCache(path, cached, flags)) return false;
+        std::memcpy(staging.data(), cached.vertexData, vertexBytes);
+        return true;
+    });
+    double packed = timeLoad([&]() {
+        MeshData cached;
+        if (!readMeshCache(path, cached, flags)) return false;
+        std::memcpy(staging.data(), cached.packedData, packedBytes);
+        return true;
+    });
+
+    if (!writeMeshCache(path, mesh, true)) return;
+    double compressedSize = cacheMegabytes(path);
+    double compressed = timeLoad([&]() {
+        MeshData cached;
+        return readMeshCache(path, cached, flags);
+    });
+    if (raw < 0.0 || packed < 0.0 || compressed < 0.0) {
+        std::cerr << "ERR: could not read back the cache of " << path << std::endl;
+        return;
+    }
+    writeMeshCache(path, mesh, false);
+
+    double decodedGigabytes = (vertexBytes + packedBytes + mesh.indexCount * sizeof(unsigned int)) /
+        (1024.0 * 1024.0 * 1024.0);
+    printf("%-40s raw %8.2f MB, floats %8.2f ms, packed %8.2f ms  compressed %8.2f MB %8.2f ms (%.2fx, %.2f GB/s)\n",
+        path.c_str(), rawSize, raw * 1000.0, packed * 1000.0, compressedSize, compressed * 1000.0,
+        rawSize / compressedSize, decodedGigabytes / compressed);
+}
+
+std::vector<std::string> assetPaths(int argc, char** argv) {
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++) paths.push_back(argv[i]);
+    if (paths.empty()) paths.assign(std::begin(kSceneAssets), std::end(kSceneAssets));
+    return paths;
+}
+
+int runCacheBenchmark(int argc, char** argv) {
+    printf("Mesh cache load time, best of %d runs, warm file cache\n", kRuns);
+    for (const std::string& path : assetPaths(argc, argv)) benchmarkCache(path);
+    return 0;
+}
+
+void benchmarkMips(const std::string& path, bool gl) {
+    ImageData image;
+    if (!decodeImage(path.c_str(), image)) {
+        std::cerr << "WARN: " << path << " could not be loaded, skipped" << std::endl;
+        return;
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser }) {
+        for (unsigned threads : { 1u, cores }) {
+            double elapsed = timeLoad([&]() {
+                MipChain chain;
+                generateMips(image.pixels, image.width, image.height, image.channels, image.channels != 1, filter,
+                    chain, threads);
+                return true;
+            });
+            printf("%-40s CPU %-6s %2u threads %8.2f ms\n", path.c_str(),
+                filter == MipFilter::Box ? "box" : "kaiser", threads, elapsed * 1000.0);
+        }
+    }
+    if (!gl) return;
+
+    // Level 0 uploaded once; each run rebuilds the levels below it
+    GLuint texture = uploadTexture(image);
+    glFinish();
+    double elapsed = timeLoad([&]() {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+        return true;
+    });
+    glDeleteTextures(1, &texture);
+    printf("%-40s glGenerateMipmap           %8.2f ms  (%s)\n", path.c_str(), elapsed * 1000.0,
+        (const char*)glGetString(GL_RENDERER));
+}
+
+int runMipBenchmark(int argc, char** argv) {
+    // glGenerateMipmap needs a context, which needs a window, kept hidden
+    GLFWwindow* window = nullptr;
+    bool gl = false;
+    if (glfwInit()) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "Projet benchmark", nullptr, nullptr);
+        if (window) {
+            glfwMakeContextCurrent(window);
+            glewExperimental = GL_TRUE;
+            gl = glewInit() == GLEW_OK;
+        }
+    }
+    if (!gl) std::cerr << "WARN: no GL context, glGenerateMipmap skipped" << std::endl;
+
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++) paths.push_back(argv[i]);
+    if (paths.empty()) paths.assign(std::begin(kMipAssets), std::end(kMipAssets));
+
+    printf("Mip chain generation, best of %d runs\n", kRuns);
+    for (const std::string& path : paths) benchmarkMips(path, gl);
+
+    if (window) glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
+
+// Decodes from a heap block of exactly the encoded size, so a decoder that
+// reads past its input trips the debug heap or AddressSanitizer
+template <typename Decode>
+bool decodeExact(const std::vector<unsigned char>& encoded, size_t size, Decode decode) {
+    std::unique_ptr<unsigned char[]> exact(new unsigned char[std::max<size_t>(size, 1)]);
+    if (size > 0) std::memcpy(exact.get(), encoded.data(), size);
+    return decode(exact.get(), size);
+}
+
+struct CodecCheck {
+    size_t cases = 0;
+    size_t failures = 0;
+
+    void expect(bool ok, const char* codec, const char* name) {
+        cases++;
+        if (ok) return;
+        failures++;
+        std::cerr << "FAIL: " << codec << " " << name << std::endl;
+    }
+};
+
+// Round trip, then every truncation of the encoding must be rejected
+void checkIndexCodec(CodecCheck& check, const char* name, const std::vector<unsigned int>& indices) {
+    std::vector<unsigned char> encoded;
+    encodeIndexBuffer(encoded, indices.data(), indices.size());
+    std::vector<unsigned int> decoded(indices.size());
+    bool ok = decodeExact(encoded, encoded.size(), [&](const unsigned char* data, size_t size) {
+        return decodeIndexBuffer(decoded.data(), decoded.size(), data, size);
+    });
+    check.expect(ok && decoded == indices, "index", name);
+
+    bool rejected = true;
+    for (size_t size = 0; size < encoded.size(); size++) {
+        rejected = rejected && !decodeExact(encoded, size, [&](const unsigned char* data, size_t size) {
+            return decodeIndexBuffer(decoded.data(), decoded.size(), data, size);
+        });
+    }
+    check.expect(rejected, "index truncated", name);
+}
+
+void checkVertexCodec(CodecCheck& check, const char* name, const std::vector<unsigned char>& vertices,
+    size_t vertexSize) {
+    size_t vertexCount = vertices.size() / vertexSize;
+    std::vector<unsigned char> encoded;
+    encodeVertexBuffer(encoded, vertices.data(), vertexCount, vertexSize);
+    std::vector<unsigned char> decoded(vertices.size());
+    bool ok = decodeExact(encoded, encoded.size(), [&](const unsigned char* data, size_t size) {
+        return decodeVertexBuffer(decoded.data(), vertexCount, vertexSize, data, size);
+    });
+    check.expect(ok && decoded == vertices, "vertex", name);
+    ok = encoded.empty() || !decodeExact(encoded, encoded.size() - 1, [&](const unsigned char* data, size_t size) {
+        return decodeVertexBuffer(decoded.data(), vertexCount, vertexSize, data, size);
+    });
+    check.expect(ok, "vertex truncated", name);
+}
+
+void checkLzCodec(CodecCheck& check, const char* name, const std::vector<unsigned char>& bytes) {
+    std::vector<unsigned char> encoded;
+    compressLz(encoded, bytes.data(), bytes.size());
+    std::vector<unsigned char> decoded(bytes.size());
+    bool ok = decodeExact(encoded, encoded.size(), [&](const unsigned char* data, size_t size) {
+        return decompressLz(decoded.data(), decoded.size(), data, size);
+    });
+    check.expect(ok && decoded == bytes, "lz", name);
+    ok = !decodeExact(encoded, encoded.size() - 1, [&](const unsigned char* data, size_t size) {
+        return decompressLz(decoded.data(), decoded.size(), data, size);
+    });
+    check.expect(ok, "lz truncated", name);
+}
+
+int runCodecCheck() {
+    CodecCheck check;
+    uint32_t seed = 12345;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    checkIndexCodec(check, "empty", {});
+    checkIndexCodec(check, "ends on a new vertex", { 0, 1, 2, 2, 1, 3 });
+    checkIndexCodec(check, "partial group on a new vertex", { 0, 1, 2, 2, 1, 3, 4 });
+    checkIndexCodec(check, "all new vertices", { 0, 1, 2, 3, 4, 5, 6, 7, 8 });
+    checkIndexCodec(check, "wide deltas", { 0, 70000, 5, 0x7FFFFFFF, 1, 0x40000000 });
+    checkIndexCodec(check, "raw", { 0, 0x80000000u, 1 });
+    std::vector<unsigned int> grid;
+    for (unsigned int row = 0; row < 64; row++) {
+        for (unsigned int column = 0; column < 64; column++) {
+            unsigned int a = row * 65 + column, b = a + 1, c = a + 65, d = c + 1;
+            grid.insert(grid.end(), { a, d, c, a, b, d });
+        }
+    }
+    checkIndexCodec(check, "grid", grid);
+    std::vector<unsigned int> scattered(3001);
+    for (unsigned int& index : scattered) index = random() % 100000;
+    checkIndexCodec(check, "scattered", scattered);
+
+    // More than one kVertexCodecBlock, and a short tail block
+    for (size_t vertexSize : { sizeof(PackedVertex), kVertexStride * sizeof(float) }) {
+        std::vector<unsigned char> smooth(vertexSize * (kVertexCodecBlock + 17));
+        for (size_t i = 0; i < smooth.size(); i++) smooth[i] = (unsigned char)(i / vertexSize + (i % 7));
+        checkVertexCodec(check, vertexSize == sizeof(PackedVertex) ? "packed smooth" : "float smooth", smooth,
+            vertexSize);
+        std::vector<unsigned char> noise(vertexSize * 100);
+        for (unsigned char& byte : noise) byte = (unsigned char)random();
+        checkVertexCodec(check, vertexSize == sizeof(PackedVertex) ? "packed noise" : "float noise", noise,
+            vertexSize);
+    }
+    checkVertexCodec(check, "empty", {}, sizeof(PackedVertex));
+
+    checkLzCodec(check, "empty", {});
+    checkLzCodec(check, "one byte", { 42 });
+    std::vector<unsigned char> runs(100000);
+    for (size_t i = 0; i < runs.size(); i++) runs[i] = (unsigned char)((i / 300) * 7);
+    checkLzCodec(check, "runs", runs);
+    std::vector<unsigned char> noise(70000);
+    for (unsigned char& byte : noise) byte = (unsigned char)random();
+    checkLzCodec(check, "noise", noise);
+
+    printf("Codec check: %zu cases, %zu failed\n", check.cases, check.failures);
+    return check.failures == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+bool isBenchmarkCommand(int argc, char** argv) {
+    return argc > 1 && (strcmp(argv[1], "--bench-obj") == 0 || strcmp(argv[1], "--bench-cache") == 0 ||
+        strcmp(argv[1], "--bench-mips") == 0 || strcmp(argv[1], "--check-codecs") == 0);
+}
+
+int runBenchmark(int argc, char** argv) {
+    if (strcmp(argv[1], "--bench-cache") == 0) return runCacheBenchmark(argc, argv);
+    if (strcmp(argv[1], "--bench-mips") == 0) return runMipBenchmark(argc, argv);
+    if (strcmp(argv[1], "--check-codecs") == 0) return runCodecCheck();
+
+    std::vector<std::string> paths;
+    size_t triangles = 10000000;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+            triangles = (size_t)strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) paths.assign(std::begin(kSceneAssets), std::end(kSceneAssets));
+
+    printf("OBJ parse throughput, best of %d runs\n", kRuns);
+    for (const std::string& path : paths) benchmarkObj(path);
+
+    if (triangles > 0) {
+        const std::string synthetic = "bench_synthetic.obj";
+        printf("Writing %zu triangle grid to %s...\n", triangles, synthetic.c_str());
+        if (!writeSyntheticObj(synthetic, triangles)) {
+            std::cerr << "ERR: could not write " << synthetic << std::endl;
+            return 1;
+        }
+        benchmarkObj(synthetic);
+        remove(synthetic.c_str());
+    }
+    return 0;
+}
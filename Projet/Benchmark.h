@@ -0,0 +1,27 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Command line benchmarks, run without showing a window:
+//   Projet --bench-obj [file.obj ...] [--triangles N]
+// Parses each file (the scene assets by default, plus a generated grid of
+// N triangles, 10M by default; 0 skips it) with tinyobj::LoadObj and with
+// loadObjParallel and prints the throughput of both in MB/s.
+//   Projet --bench-cache [file.obj ...]
+// Writes the mesh cache of each file (the scene assets by default) raw and
+// compressed and prints size and load time of three forms: the raw floats
+// copied out, the raw PackedVertex stream copied out, and compressed. The
+// raw cache, the default, is left in place.
+//   Projet --bench-mips [image ...]
+// Builds the mip chain of each image (the human texture by default) on the
+// CPU with the box and the Kaiser filter, on one thread and on all, and
+// with glGenerateMipmap in a hidden window's context, and prints the time
+// of each.
+//   Projet --check-codecs
+// Round-trips the index, vertex and LZ codecs of the mesh cache over edge
+// cases, decoding from buffers of exactly the encoded size so overreads
+// show under AddressSanitizer, and checks that truncated input is
+// rejected. Exits with 1 if any case fails.
+bool isBenchmarkCommand(int argc, char** argv);
+int runBenchmark(int argc, char** argv);
+
+#endif
@@ -0,0 +1,391 @@
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Block rows below this many blocks are not worth a thread
+const size_t kMinBlocksPerThread = 256;
+
+// 4x4 texels in RGBA, row by row
+struct Block {
+    float texels[16][4];
+};
+
+void fetchBlock(const unsigned char* texels, int width, int height, int channels, int bx, int by, Block& block) {
+    for (int y = 0; y < 4; y++) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const unsigned char* texel = texels + ((size_t)sy * width + sx) * channels;
+            float* out = block.texels[y * 4 + x];
+            for (int c = 0; c < 4; c++) {
+                out[c] = c < channels ? texel[c] : (c == 3 ? 255.0f : texel[0]);
+            }
+        }
+    }
+}
+
+float clampUnit(float value) {
+    return std::min(255.0f, std::max(0.0f, value));
+}
+
+// Line through the texels' first N channels that best fits them (mean and
+// principal axis of the covariance by power iteration), cut at the
+// outermost projections
+template <int N>
+void principalEndpoints(const Block& block, float lo[N], float hi[N]) {
+    float mean[N] = {};
+    for (const float* texel : block.texels) {
+        for (int c = 0; c < N; c++) mean[c] += texel[c];
+    }
+    for (int c = 0; c < N; c++) mean[c] /= 16.0f;
+
+    float covariance[N][N] = {};
+    for (const float* texel : block.texels) {
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+        }
+    }
+
+    float axis[N];
+    for (int c = 0; c < N; c++) axis[c] = 1.0f;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[N] = {};
+        float length = 0.0f;
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) next[i] += covariance[i][j] * axis[j];
+            length += next[i] * next[i];
+        }
+        if (length < 1e-12f) break;  // flat block: any axis will do
+        length = 1.0f / std::sqrt(length);
+        for (int c = 0; c < N; c++) axis[c] = next[c] * length;
+    }
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (const float* texel : block.texels) {
+        float t = 0.0f;
+        for (int c = 0; c < N; c++) t += (texel[c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    for (int c = 0; c < N; c++) {
+        lo[c] = clampUnit(mean[c] + axis[c] * minT);
+        hi[c] = clampUnit(mean[c] + axis[c] * maxT);
+    }
+}
+
+// Endpoints that minimise the squared error of texels rebuilt as
+// lo + weights[i] * (hi - lo), given each texel's weight. False when the
+// weights are all equal and leave the system singular.
+template <int N>
+bool leastSquaresEndpoints(const Block& block, const float weights[16], float lo[N], float hi[N]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[N] = {}, bx[N] = {};
+    for (int i = 0; i < 16; i++) {
+        float b = weights[i], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < N; c++) {
+            ax[c] += a * block.texels[i][c];
+            bx[c] += b * block.texels[i][c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f) return false;
+    float inverse = 1.0f / determinant;
+    for (int c = 0; c < N; c++) {
+        lo[c] = clampUnit((bb * ax[c] - ab * bx[c]) * inverse);
+        hi[c] = clampUnit((aa * bx[c] - ab * ax[c]) * inverse);
+    }
+    return true;
+}
+
+void store16(unsigned char* out, unsigned value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+}
+
+// --- BC1 ---
+
+unsigned packRgb565(const float rgb[3]) {
+    unsigned r = (unsigned)(rgb[0] * 31.0f / 255.0f + 0.5f);
+    unsigned g = (unsigned)(rgb[1] * 63.0f / 255.0f + 0.5f);
+    unsigned b = (unsigned)(rgb[2] * 31.0f / 255.0f + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+void unpackRgb565(unsigned color, int rgb[3]) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Nearest of the four-color palette of c0 and c1 for every texel; returns
+// the squared error
+int selectColorIndices(const Block& block, unsigned c0, unsigned c1, unsigned char indices[16]) {
+    int palette[4][3];
+    unpackRgb565(c0, palette[0]);
+    unpackRgb565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    int total = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 4; p++) {
+            int error = 0;
+            for (int c = 0; c < 3; c++) {
+                int d = (int)block.texels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices[i] = (unsigned char)best;
+        total += bestError;
+    }
+    return total;
+}
+
+void encodeColorBlock(const Block& block, unsigned char* out) {
+    // Weight of c0 (hi) in each palette entry, for the refit
+    static const float kWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    float lo[3], hi[3];
+    principalEndpoints<3>(block, lo, hi);
+
+    unsigned bestC0 = 0, bestC1 = 0;
+    unsigned char bestIndices[16] = {};
+    int bestError = 1 << 30;
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned c0 = packRgb565(hi), c1 = packRgb565(lo);
+        unsigned char indices[16];
+        int error = selectColorIndices(block, c0, c1, indices);
+        if (error < bestError) {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if (error == 0) break;
+
+        float weights[16];
+        for (int i = 0; i < 16; i++) weights[i] = kWeights[indices[i]];
+        if (!leastSquaresEndpoints<3>(block, weights, lo, hi)) break;
+    }
+
+    // c0 > c1 selects the four-color mode; equal endpoints would select the
+    // three-color one, where only index 0 still means c0
+    if (bestC0 < bestC1) {
+        std::swap(bestC0, bestC1);
+        for (unsigned char& index : bestIndices) index ^= 1;
+    }
+    else if (bestC0 == bestC1) {
+        std::memset(bestIndices, 0, sizeof(bestIndices));
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++) bits |= (uint32_t)bestIndices[i] << (i * 2);
+    store16(out, bestC0);
+    store16(out + 2, bestC1);
+    store16(out + 4, bits & 0xFFFF);
+    store16(out + 6, bits >> 16);
+}
+
+// --- BC4 (and the alpha half of BC3) ---
+
+void encodeChannelBlock(const Block& block, int channel, unsigned char* out) {
+    int lo = 255, hi = 0;
+    for (const float* texel : block.texels) {
+        lo = std::min(lo, (int)texel[channel]);
+        hi = std::max(hi, (int)texel[channel]);
+    }
+
+    // a0 > a1 selects the mode with six interpolated values between them
+    uint64_t bits = 0;
+    if (hi > lo) {
+        int palette[8] = { hi, lo };
+        for (int k = 1; k < 7; k++) palette[k + 1] = ((7 - k) * hi + k * lo + 3) / 7;
+        for (int i = 0; i < 16; i++) {
+            int value = (int)block.texels[i][channel];
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(value - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            bits |= (uint64_t)best << (i * 3);
+        }
+    }
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)std::min(lo, hi);
+    for (int i = 0; i < 6; i++) out[2 + i] = (unsigned char)(bits >> (i * 8));
+}
+
+// --- BC7 mode 6 ---
+
+const int kBc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// 7 bits per channel plus a low bit shared by the four; picks the low bit
+// that lands closest to the endpoint
+void quantizeBc7Endpoint(const float endpoint[4], int quantized[4], int& pbit) {
+    float bestError = 1e30f;
+    for (int p = 0; p < 2; p++) {
+        int q[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            q[c] = std::min(127, std::max(0, (int)std::lround((endpoint[c] - p) / 2.0f)));
+            float d = (float)((q[c] << 1) | p) - endpoint[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            std::memcpy(quantized, q, sizeof(q));
+        }
+    }
+}
+
+int selectBc7Indices(const Block& block, const int e0[4], const int e1[4], unsigned char indices[16]) {
+    int palette[16][4];
+    for (int w = 0; w < 16; w++) {
+        for (int c = 0; c < 4; c++) {
+            palette[w][c] = ((64 - kBc7Weights[w]) * e0[c] + kBc7Weights[w] * e1[c] + 32) >> 6;
+        }
+    }
+    int total = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestError = 1 << 30;
+        for (int w = 0; w < 16; w++) {
+            int error = 0;
+            for (int c = 0; c < 4; c++) {
+                int d = (int)block.texels[i][c] - palette[w][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = (unsigned char)best;
+        total += bestError;
+    }
+    return total;
+}
+
+// Writes bit fields into a 128-bit block from the low bit up
+struct BitWriter {
+    unsigned char* out;
+    int position = 0;
+
+    void put(unsigned value, int bits) {
+        for (int b = 0; b < bits; b++, position++) {
+            if (value & (1u << b)) out[position >> 3] |= (unsigned char)(1u << (position & 7));
+        }
+    }
+};
+
+void encodeBc7Block(const Block& block, unsigned char* out) {
+    float lo[4], hi[4];
+    principalEndpoints<4>(block, lo, hi);
+
+    int bestQ[2][4] = {}, bestP[2] = {};
+    unsigned char bestIndices[16] = {};
+    int bestError = 1 << 30;
+    for (int pass = 0; pass < 2; pass++) {
+        int q[2][4], p[2], e[2][4];
+        quantizeBc7Endpoint(lo, q[0], p[0]);
+        quantizeBc7Endpoint(hi, q[1], p[1]);
+        for (int k = 0; k < 2; k++) {
+            for (int c = 0; c < 4; c++) e[k][c] = (q[k][c] << 1) | p[k];
+        }
+        unsigned char indices[16];
+        int error = selectBc7Indices(block, e[0], e[1], indices);
+        if (error < bestError) {
+            bestError = error;
+            std::memcpy(bestQ, q, sizeof(q));
+            std::memcpy(bestP, p, sizeof(p));
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if (error == 0) break;
+
+        float weights[16];
+        for (int i = 0; i < 16; i++) weights[i] = kBc7Weights[indices[i]] / 64.0f;
+        if (!leastSquaresEndpoints<4>(block, weights, lo, hi)) break;
+    }
+
+    // The first texel's index is stored without its top bit, which must
+    // therefore be clear: swap the endpoints and mirror the indices if not
+    if (bestIndices[0] & 8) {
+        std::swap(bestQ[0], bestQ[1]);
+        std::swap(bestP[0], bestP[1]);
+        for (unsigned char& index : bestIndices) index = (unsigned char)(15 - index);
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter bits = { out };
+    bits.put(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        bits.put((unsigned)bestQ[0][c], 7);
+        bits.put((unsigned)bestQ[1][c], 7);
+    }
+    bits.put((unsigned)bestP[0], 1);
+    bits.put((unsigned)bestP[1], 1);
+    bits.put(bestIndices[0], 3);
+    for (int i = 1; i < 16; i++) bits.put(bestIndices[i], 4);
+}
+
+} // namespace
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void encodeBlocks(BlockFormat format, const unsigned char* texels, int width, int height, int channels,
+    unsigned char* out, unsigned threadCount) {
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t stride = blockBytes(format);
+    size_t minRows = std::max<size_t>(1, kMinBlocksPerThread / std::max(1, blocksX));
+
+    parallelFor((size_t)blocksY, minRows, threadCount, [&](size_t begin, size_t end) {
+        Block block;
+        for (size_t by = begin; by < end; by++) {
+            unsigned char* row = out + by * blocksX * stride;
+            for (int bx = 0; bx < blocksX; bx++) {
+                fetchBlock(texels, width, height, channels, bx, (int)by, block);
+                unsigned char* dst = row + bx * stride;
+                switch (format) {
+                case BlockFormat::BC1:
+                    encodeColorBlock(block, dst);
+                    break;
+                case BlockFormat::BC3:
+                    encodeChannelBlock(block, 3, dst);
+                    encodeColorBlock(block, dst + 8);
+                    break;
+                case BlockFormat::BC4:
+                    encodeChannelBlock(block, 0, dst);
+                    break;
+                case BlockFormat::BC7:
+                    encodeBc7Block(block, dst);
+                    break;
+                }
+            }
+        }
+    });
+}
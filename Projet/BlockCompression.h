@@ -0,0 +1,34 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Block-compressed texture formats the importer writes. Each encodes 4x4
+// texels into one block:
+//   BC1  8 bytes, RGB (DXT1, always the 4-color mode)
+//   BC3 16 bytes, RGBA (DXT5: a BC4 block for alpha, then a BC1 block)
+//   BC4  8 bytes, one channel (RGTC1)
+//   BC7 16 bytes, RGBA (mode 6 only: one subset, 7-bit endpoints with a
+//       shared low bit, 4-bit indices)
+enum class BlockFormat : uint32_t {
+    BC1,
+    BC3,
+    BC4,
+    BC7,
+};
+
+size_t blockBytes(BlockFormat format);
+
+// Bytes of a width x height image in format; partial blocks count whole
+size_t compressedSize(BlockFormat format, int width, int height);
+
+// Encodes width x height texels of channels 8-bit components (BC1 reads the
+// first three, BC3 and BC7 four, BC4 the first) into blocks in row order.
+// Blocks past the right or bottom edge repeat the last column or row. The
+// block rows are split by parallelFor into threadCount batches, 0 for one
+// per core or, on a ThreadPool worker, one per worker of its pool.
+void encodeBlocks(BlockFormat format, const unsigned char* texels, int width, int height, int channels,
+    unsigned char* out, unsigned threadCount = 0);
+
+#endif
@@ -0,0 +1,68 @@
+#include "Culling.h"
+
+Frustum extractFrustum(const glm::mat4& clip) {
+    // Gribb and Hartmann: each plane is the last row plus or minus another
+    glm::mat4 rows = glm::transpose(clip);
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool isSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius) {
+    for (const glm::vec4& plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& eye) {
+    if (meshlet.coneCutoff >= 1.0f) return false;
+    glm::vec3 apex(meshlet.coneApex[0], meshlet.coneApex[1], meshlet.coneApex[2]);
+    glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+    return glm::dot(glm::normalize(apex - eye), axis) >= meshlet.coneCutoff;
+}
+
+void drawVisibleMeshlets(const GpuMesh& mesh, const GpuDraw& draw, const Frustum& frustum,
+    const glm::vec3& eye, CullStats& stats) {
+    stats.triangles += draw.indexCount / 3;
+    if (draw.meshletCount == 0) {
+        stats.trianglesDrawn += draw.indexCount / 3;
+        glDrawElementsBaseVertex(GL_TRIANGLES, draw.indexCount, draw.indexType,
+            (void*)draw.indexByteOffset, draw.baseVertex);
+        return;
+    }
+
+    size_t indexSize = draw.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    size_t runStart = 0, runCount = 0;
+    auto flush = [&]() {
+        if (runCount == 0) return;
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)runCount, draw.indexType,
+            (void*)(draw.indexByteOffset + runStart * indexSize), draw.baseVertex);
+        stats.trianglesDrawn += runCount / 3;
+        runCount = 0;
+    };
+
+    stats.meshlets += draw.meshletCount;
+    for (uint32_t m = 0; m < draw.meshletCount; m++) {
+        const Meshlet& meshlet = mesh.meshlets[draw.meshletOffset + m];
+        glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+        if (!isSphereVisible(frustum, center, meshlet.radius) || isMeshletBackfacing(meshlet, eye)) {
+            flush();
+            continue;
+        }
+
+        stats.meshletsDrawn++;
+        // Meshlets tile the range in order, so visible neighbours join the run
+        if (runCount == 0) runStart = meshlet.indexOffset;
+        runCount += meshlet.triangleCount * 3;
+    }
+    flush();
+}
@@ -0,0 +1,34 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm.hpp>
+#include <cstddef>
+#include "MeshRegistry.h"
+
+// Frustum planes (xyz normal, w offset) in the space the matrix maps to clip
+// space from; normalized so distances are in that space's units
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4& clip);
+
+bool isSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius);
+
+// Whether every triangle of the meshlet faces away from eye
+bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& eye);
+
+struct CullStats {
+    size_t meshlets = 0;
+    size_t meshletsDrawn = 0;
+    size_t triangles = 0;
+    size_t trianglesDrawn = 0;
+};
+
+// Draws the meshlets of draw that are in the frustum and face eye, merging
+// neighbours into one call. frustum and eye are in model space. Draws
+// without meshlets are drawn whole.
+void drawVisibleMeshlets(const GpuMesh& mesh, const GpuDraw& draw, const Frustum& frustum,
+    const glm::vec3& eye, CullStats& stats);
+
+#endif
@@ -0,0 +1,351 @@
+#include "FastFloat.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Range of decimal exponents that can produce a finite non-zero float
+// once the (up to 19 digit) mantissa is taken into account
+const int kSmallestPowerOfTen = -65;
+const int kLargestPowerOfTen = 38;
+
+const int kMantissaBits = 23;
+const int kMinimumExponent = -127;
+const int kInfinitePower = 0xFF;
+
+// 128-bit truncated (rounded up for negative powers) 5^q, normalized so the
+// top bit is set, for q in [kSmallestPowerOfTen, kLargestPowerOfTen]
+const uint64_t kPowersOfFive[] = {
+    0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull,  // 5^-65
+    0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull,  // 5^-64
+    0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,  // 5^-63
+    0x83a3eeeef9153e89ull, 0x1953cf68300424acull,  // 5^-62
+    0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,  // 5^-61
+    0xcdb02555653131b6ull, 0x3792f412cb06794dull,  // 5^-60
+    0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,  // 5^-59
+    0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull,  // 5^-58
+    0xc8de047564d20a8bull, 0xf245825a5a445275ull,  // 5^-57
+    0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull,  // 5^-56
+    0x9ced737bb6c4183dull, 0x55464dd69685606bull,  // 5^-55
+    0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull,  // 5^-54
+    0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,  // 5^-53
+    0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull,  // 5^-52
+    0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,  // 5^-51
+    0xef73d256a5c0f77cull, 0x963e66858f6d4440ull,  // 5^-50
+    0x95a8637627989aadull, 0xdde7001379a44aa8ull,  // 5^-49
+    0xbb127c53b17ec159ull, 0x5560c018580d5d52ull,  // 5^-48
+    0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,  // 5^-47
+    0x9226712162ab070dull, 0xcab3961304ca70e8ull,  // 5^-46
+    0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,  // 5^-45
+    0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull,  // 5^-44
+    0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,  // 5^-43
+    0xb267ed1940f1c61cull, 0x55f038b237591ed3ull,  // 5^-42
+    0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,  // 5^-41
+    0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull,  // 5^-40
+    0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,  // 5^-39
+    0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull,  // 5^-38
+    0x881cea14545c7575ull, 0x7e50d64177da2e54ull,  // 5^-37
+    0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull,  // 5^-36
+    0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,  // 5^-35
+    0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull,  // 5^-34
+    0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,  // 5^-33
+    0xcfb11ead453994baull, 0x67de18eda5814af2ull,  // 5^-32
+    0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,  // 5^-31
+    0xa2425ff75e14fc31ull, 0xa1258379a94d028dull,  // 5^-30
+    0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,  // 5^-29
+    0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull,  // 5^-28
+    0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,  // 5^-27
+    0xc612062576589ddaull, 0x95364afe032a819eull,  // 5^-26
+    0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,  // 5^-25
+    0x9abe14cd44753b52ull, 0xc4926a9672793543ull,  // 5^-24
+    0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,  // 5^-23
+    0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull,  // 5^-22
+    0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,  // 5^-21
+    0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull,  // 5^-20
+    0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,  // 5^-19
+    0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull,  // 5^-18
+    0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,  // 5^-17
+    0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull,  // 5^-16
+    0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,  // 5^-15
+    0xb424dc35095cd80full, 0x538484c19ef38c95ull,  // 5^-14
+    0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,  // 5^-13
+    0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull,  // 5^-12
+    0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,  // 5^-11
+    0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull,  // 5^-10
+    0x89705f4136b4a597ull, 0x31680a88f8953031ull,  // 5^-9
+    0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull,  // 5^-8
+    0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,  // 5^-7
+    0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull,  // 5^-6
+    0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,  // 5^-5
+    0xd1b71758e219652bull, 0xd3c36113404ea4a9ull,  // 5^-4
+    0x83126e978d4fdf3bull, 0x645a1cac083126eaull,  // 5^-3
+    0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull,  // 5^-2
+    0xccccccccccccccccull, 0xcccccccccccccccdull,  // 5^-1
+    0x8000000000000000ull, 0x0000000000000000ull,  // 5^0
+    0xa000000000000000ull, 0x0000000000000000ull,  // 5^1
+    0xc800000000000000ull, 0x0000000000000000ull,  // 5^2
+    0xfa00000000000000ull, 0x0000000000000000ull,  // 5^3
+    0x9c40000000000000ull, 0x0000000000000000ull,  // 5^4
+    0xc350000000000000ull, 0x0000000000000000ull,  // 5^5
+    0xf424000000000000ull, 0x0000000000000000ull,  // 5^6
+    0x9896800000000000ull, 0x0000000000000000ull,  // 5^7
+    0xbebc200000000000ull, 0x0000000000000000ull,  // 5^8
+    0xee6b280000000000ull, 0x0000000000000000ull,  // 5^9
+    0x9502f90000000000ull, 0x0000000000000000ull,  // 5^10
+    0xba43b74000000000ull, 0x0000000000000000ull,  // 5^11
+    0xe8d4a51000000000ull, 0x0000000000000000ull,  // 5^12
+    0x9184e72a00000000ull, 0x0000000000000000ull,  // 5^13
+    0xb5e620f480000000ull, 0x0000000000000000ull,  // 5^14
+    0xe35fa931a0000000ull, 0x0000000000000000ull,  // 5^15
+    0x8e1bc9bf04000000ull, 0x0000000000000000ull,  // 5^16
+    0xb1a2bc2ec5000000ull, 0x0000000000000000ull,  // 5^17
+    0xde0b6b3a76400000ull, 0x0000000000000000ull,  // 5^18
+    0x8ac7230489e80000ull, 0x0000000000000000ull,  // 5^19
+    0xad78ebc5ac620000ull, 0x0000000000000000ull,  // 5^20
+    0xd8d726b7177a8000ull, 0x0000000000000000ull,  // 5^21
+    0x878678326eac9000ull, 0x0000000000000000ull,  // 5^22
+    0xa968163f0a57b400ull, 0x0000000000000000ull,  // 5^23
+    0xd3c21bcecceda100ull, 0x0000000000000000ull,  // 5^24
+    0x84595161401484a0ull, 0x0000000000000000ull,  // 5^25
+    0xa56fa5b99019a5c8ull, 0x0000000000000000ull,  // 5^26
+    0xcecb8f27f4200f3aull, 0x0000000000000000ull,  // 5^27
+    0x813f3978f8940984ull, 0x4000000000000000ull,  // 5^28
+    0xa18f07d736b90be5ull, 0x5000000000000000ull,  // 5^29
+    0xc9f2c9cd04674edeull, 0xa400000000000000ull,  // 5^30
+    0xfc6f7c4045812296ull, 0x4d00000000000000ull,  // 5^31
+    0x9dc5ada82b70b59dull, 0xf020000000000000ull,  // 5^32
+    0xc5371912364ce305ull, 0x6c28000000000000ull,  // 5^33
+    0xf684df56c3e01bc6ull, 0xc732000000000000ull,  // 5^34
+    0x9a130b963a6c115cull, 0x3c7f400000000000ull,  // 5^35
+    0xc097ce7bc90715b3ull, 0x4b9f100000000000ull,  // 5^36
+    0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,  // 5^37
+    0x96769950b50d88f4ull, 0x1314448000000000ull,  // 5^38
+};
+
+struct U128 {
+    uint64_t low;
+    uint64_t high;
+};
+
+inline U128 multiply(uint64_t a, uint64_t b) {
+    U128 r;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128)a * b;
+    r.low = (uint64_t)p;
+    r.high = (uint64_t)(p >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    r.low = _umul128(a, b, &r.high);
+#else
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    r.low = (mid << 32) | (uint32_t)ll;
+    r.high = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+    return r;
+}
+
+inline int leadingZeros(uint64_t x) {
+    int n = 0;
+    if (!(x & 0xFFFFFFFF00000000ull)) { n += 32; x <<= 32; }
+    if (!(x & 0xFFFF000000000000ull)) { n += 16; x <<= 16; }
+    if (!(x & 0xFF00000000000000ull)) { n += 8; x <<= 8; }
+    if (!(x & 0xF000000000000000ull)) { n += 4; x <<= 4; }
+    if (!(x & 0xC000000000000000ull)) { n += 2; x <<= 2; }
+    if (!(x & 0x8000000000000000ull)) { n += 1; }
+    return n;
+}
+
+struct AdjustedMantissa {
+    uint64_t mantissa;
+    int power2;
+};
+
+// w * 10^q rounded to float, as biased exponent and explicit mantissa bits
+AdjustedMantissa computeFloat(int64_t q, uint64_t w) {
+    AdjustedMantissa answer;
+    if (w == 0 || q < kSmallestPowerOfTen) {
+        answer.mantissa = 0;
+        answer.power2 = 0;
+        return answer;
+    }
+    if (q > kLargestPowerOfTen) {
+        answer.mantissa = 0;
+        answer.power2 = kInfinitePower;
+        return answer;
+    }
+
+    int lz = leadingZeros(w);
+    w <<= lz;
+
+    // Only as many product bits as a float needs, refined with the low half of the power if they are ambiguous
+    size_t index = 2 * (size_t)(q - kSmallestPowerOfTen);
+    U128 product = multiply(w, kPowersOfFive[index]);
+    const uint64_t precisionMask = 0xFFFFFFFFFFFFFFFFull >> (kMantissaBits + 3);
+    if ((product.high & precisionMask) == precisionMask) {
+        U128 second = multiply(w, kPowersOfFive[index + 1]);
+        product.low += second.high;
+        if (second.high > product.low) product.high++;
+    }
+
+    int upperBit = (int)(product.high >> 63);
+    int shift = upperBit + 64 - kMantissaBits - 3;
+    answer.mantissa = product.high >> shift;
+    // floor(log2(10^q)) + 63, exact over the float range
+    int power = (int)((((152170 + 65536) * q) >> 16) + 63);
+    answer.power2 = power + upperBit - lz - kMinimumExponent;
+
+    if (answer.power2 <= 0) {
+        // Subnormal
+        if (-answer.power2 + 1 >= 64) {
+            answer.mantissa = 0;
+            answer.power2 = 0;
+            return answer;
+        }
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += answer.mantissa & 1;
+        answer.mantissa >>= 1;
+        answer.power2 = answer.mantissa < (1ull << kMantissaBits) ? 0 : 1;
+        return answer;
+    }
+
+    // Exactly halfway between two floats: round to even
+    if (product.low <= 1 && q >= -17 && q <= 10 && (answer.mantissa & 3) == 1) {
+        if ((answer.mantissa << shift) == product.high) {
+            answer.mantissa &= ~1ull;
+        }
+    }
+
+    answer.mantissa += answer.mantissa & 1;
+    answer.mantissa >>= 1;
+    if (answer.mantissa >= (2ull << kMantissaBits)) {
+        answer.mantissa = 1ull << kMantissaBits;
+        answer.power2++;
+    }
+    answer.mantissa &= ~(1ull << kMantissaBits);
+    if (answer.power2 >= kInfinitePower) {
+        answer.mantissa = 0;
+        answer.power2 = kInfinitePower;
+    }
+    return answer;
+}
+
+inline float toFloat(const AdjustedMantissa& am, bool negative) {
+    uint32_t bits = (uint32_t)am.mantissa | ((uint32_t)am.power2 << kMantissaBits) | ((uint32_t)negative << 31);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+}  // namespace
+
+const char* parseFloat(const char* p, const char* end, float& value) {
+    static const float kExactPowers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t w = 0;
+    int64_t exponent = 0;
+    int digits = 0;
+    bool truncated = false;
+    bool any = false;
+
+    while (p < end && *p == '0') {
+        p++;
+        any = true;
+    }
+    while (p < end && isDigit(*p)) {
+        if (digits < 19) {
+            w = w * 10 + (uint64_t)(*p - '0');
+            digits++;
+        }
+        else {
+            truncated |= *p != '0';
+            exponent++;
+        }
+        p++;
+        any = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (digits == 0) {
+            while (p < end && *p == '0') {
+                exponent--;
+                p++;
+                any = true;
+            }
+        }
+        while (p < end && isDigit(*p)) {
+            if (digits < 19) {
+                w = w * 10 + (uint64_t)(*p - '0');
+                digits++;
+                exponent--;
+            }
+            else {
+                truncated |= *p != '0';
+            }
+            p++;
+            any = true;
+        }
+    }
+    if (!any) return start;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool expNegative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            expNegative = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q)) {
+            int64_t e = 0;
+            while (q < end && isDigit(*q)) {
+                if (e < 100000) e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+
+    // Clinger's fast path: both operands are exact floats, so one rounding
+    if (!truncated && w <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+        float f = (float)w;
+        f = exponent < 0 ? f / kExactPowers[-exponent] : f * kExactPowers[exponent];
+        value = negative ? -f : f;
+        return p;
+    }
+
+    AdjustedMantissa am = computeFloat(exponent, w);
+    if (truncated) {
+        // The dropped digits only matter if they could push w up to the next float
+        AdjustedMantissa upper = computeFloat(exponent, w + 1);
+        if (upper.mantissa != am.mantissa || upper.power2 != am.power2) {
+            char buffer[128];
+            size_t length = (size_t)(p - start);
+            if (length < sizeof(buffer)) {
+                std::memcpy(buffer, start, length);
+                buffer[length] = '\0';
+                value = strtof(buffer, nullptr);
+                return p;
+            }
+        }
+    }
+
+    value = toFloat(am, negative);
+    return p;
+}
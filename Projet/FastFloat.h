@@ -0,0 +1,12 @@
+#ifndef FASTFLOAT_H
+#define FASTFLOAT_H
+
+// Parses a decimal number (optional sign, fraction and exponent) from
+// [p, end) into the nearest float, rounding ties to even like strtof.
+// Uses the Eisel-Lemire algorithm on a 64-bit mantissa; only inputs with
+// more than 19 significant digits that land on a rounding boundary fall
+// back to strtof. Returns the position after the number, or p if there is
+// no number. No allocation, no locale, no NUL terminator needed.
+const char* parseFloat(const char* p, const char* end, float& value);
+
+#endif
@@ -0,0 +1,166 @@
+#include "FileUtil.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool getFileInfo(const std::string& path, FileInfo& info) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+#endif
+    info.size = (uint64_t)st.st_size;
+    info.mtime = (uint64_t)st.st_mtime;
+    return true;
+}
+
+bool replaceFile(const std::string& src, const std::string& dst) {
+#ifdef _WIN32
+    return MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(src.c_str(), dst.c_str()) == 0;
+#endif
+}
+
+std::string canonicalPath(const std::string& path) {
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (!_fullpath(buffer, path.c_str(), _MAX_PATH)) return path;
+    std::string result(buffer);
+    for (char& c : result) {
+        if (c == '/') c = '\\';
+        else c = (char)tolower((unsigned char)c);
+    }
+    return result;
+#else
+    char* resolved = realpath(path.c_str(), nullptr);
+    if (!resolved) return path;
+    std::string result(resolved);
+    free(resolved);
+    return result;
+#endif
+}
+
+// Four independent multiply-xorshift lanes over 32-byte blocks, folded at the end
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint64_t k0 = 0x9e3779b97f4a7c15ull;
+    const uint64_t k1 = 0xbf58476d1ce4e5b9ull;
+    const uint64_t k2 = 0x94d049bb133111ebull;
+    const unsigned char* p = (const unsigned char*)data;
+
+    uint64_t lanes[4] = { seed ^ k0, seed ^ k1, seed ^ k2, seed + k0 };
+    size_t blocks = size / 32;
+    for (size_t b = 0; b < blocks; b++) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t w;
+            std::memcpy(&w, p + b * 32 + l * 8, 8);
+            lanes[l] = (lanes[l] ^ w) * k1;
+            lanes[l] ^= lanes[l] >> 29;
+        }
+    }
+
+    uint64_t h = (uint64_t)size * k0;
+    for (int l = 0; l < 4; l++) {
+        h = (h ^ lanes[l]) * k2;
+        h ^= h >> 32;
+    }
+    for (size_t i = blocks * 32; i < size; i++) {
+        h = (h ^ p[i]) * k1;
+    }
+    h ^= h >> 31;
+    h *= k2;
+    h ^= h >> 29;
+    return h;
+}
+
+bool hashFile(const std::string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    hash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_ = file;
+    mapping_ = mapping;
+    data_ = (const unsigned char*)view;
+    size_ = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    data_ = (const unsigned char*)view;
+    size_ = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle((HANDLE)mapping_);
+    CloseHandle((HANDLE)file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    munmap((void*)data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef FILEUTIL_H
+#define FILEUTIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Size and modification time of a file on disk
+struct FileInfo {
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+};
+
+bool getFileInfo(const std::string& path, FileInfo& info);
+
+// Replaces dst with src in one step so readers never see a half-written file
+bool replaceFile(const std::string& src, const std::string& dst);
+
+// Absolute path with symlinks resolved; on Windows also lower-cased with
+// backslashes so two spellings of the same file compare equal
+std::string canonicalPath(const std::string& path);
+
+// 64-bit content hash used to validate cached assets against their sources
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+bool hashFile(const std::string& path, uint64_t& hash);
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+#endif
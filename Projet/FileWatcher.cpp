@@ -0,0 +1,82 @@
+#include "FileWatcher.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <algorithm>
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    lastPoll_ = std::chrono::steady_clock::now();
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (inotify_ >= 0) close(inotify_);
+#endif
+}
+
+bool FileWatcher::watch(const std::string& path) {
+    std::string file = canonicalPath(path);
+#ifdef __linux__
+    if (inotify_ < 0) return false;
+    size_t slash = file.find_last_of('/');
+    if (slash == std::string::npos) return false;
+    std::string directory = file.substr(0, std::max<size_t>(slash, 1));
+
+    // Editors often save by renaming a new file over the old one, which a
+    // watch on the file itself would lose
+    int wd = inotify_add_watch(inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) return false;
+    directories_[wd] = directory;
+#else
+    FileInfo info;
+    if (!getFileInfo(file, info)) return false;
+    stamps_.emplace(file, info);
+#endif
+    files_.insert(file);
+    return true;
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed) {
+    changed.clear();
+#ifdef __linux__
+    if (inotify_ < 0) return;
+    alignas(inotify_event) char buffer[16384];
+    for (;;) {
+        ssize_t length = read(inotify_, buffer, sizeof(buffer));
+        if (length <= 0) break;  // EAGAIN: nothing more queued
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = (const inotify_event*)p;
+            p += sizeof(inotify_event) + event->len;
+            auto directory = directories_.find(event->wd);
+            if (event->len == 0 || directory == directories_.end()) continue;
+
+            std::string file = directory->second + (directory->second == "/" ? "" : "/") + event->name;
+            if (files_.count(file) && std::find(changed.begin(), changed.end(), file) == changed.end()) {
+                changed.push_back(file);
+            }
+        }
+    }
+#else
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll_ < std::chrono::milliseconds(kFileWatchPollMs)) return;
+    lastPoll_ = now;
+
+    for (auto& entry : stamps_) {
+        FileInfo info;
+        // A file being replaced can be missing for a moment; look again next time
+        if (!getFileInfo(entry.first, info)) continue;
+        if (info.size != entry.second.size || info.mtime != entry.second.mtime) {
+            entry.second = info;
+            changed.push_back(entry.first);
+        }
+    }
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "FileUtil.h"
+
+const int kFileWatchPollMs = 250;
+
+// Reports writes to a set of files. On Linux it listens to inotify on the
+// files' directories, so saves that replace the file (write to a temporary,
+// then rename) are seen as well; elsewhere it compares size and mtime of
+// every watched file, at most every kFileWatchPollMs. Not thread-safe.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watching a file twice is harmless; returns false if it cannot be watched
+    bool watch(const std::string& path);
+
+    // Canonical paths of the watched files written since the last call, each
+    // once. Never blocks.
+    void poll(std::vector<std::string>& changed);
+
+    size_t watchedCount() const { return files_.size(); }
+
+private:
+    std::unordered_set<std::string> files_;
+#ifdef __linux__
+    int inotify_ = -1;
+    std::unordered_map<int, std::string> directories_;  // watch descriptor -> directory
+#else
+    std::unordered_map<std::string, FileInfo> stamps_;
+    std::chrono::steady_clock::time_point lastPoll_;
+#endif
+};
+
+#endif
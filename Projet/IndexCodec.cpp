@@ -0,0 +1,149 @@
+#include "IndexCodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+enum IndexCodecMode : unsigned char { ModeRaw = 0, ModeGrouped = 1 };
+
+// Codes are read 4 bytes at a time, zero-length ones included, so a read
+// starting right at the end of the codes stays inside the buffer
+const size_t kPadding = 4;
+
+const unsigned int kCodeBytes[4] = { 0, 1, 2, 4 };
+const uint32_t kCodeMask[4] = { 0, 0xFF, 0xFFFF, 0xFFFFFFFF };
+
+struct GroupLayout {
+    unsigned char offset[3];
+    unsigned char size;
+};
+
+struct GroupTable {
+    GroupLayout layout[64];
+
+    GroupTable() {
+        for (unsigned int control = 0; control < 64; control++) {
+            unsigned int offset = 0;
+            for (int k = 0; k < 3; k++) {
+                layout[control].offset[k] = (unsigned char)offset;
+                offset += kCodeBytes[(control >> (2 * k)) & 3];
+            }
+            layout[control].size = (unsigned char)offset;
+        }
+    }
+};
+
+const GroupTable& groupTable() {
+    static const GroupTable table;
+    return table;
+}
+
+inline unsigned int lengthCode(uint32_t code) {
+    if (code == 0) return 0;
+    if (code <= 0xFF) return 1;
+    if (code <= 0xFFFF) return 2;
+    return 3;
+}
+
+}  // namespace
+
+void encodeIndexBuffer(std::vector<unsigned char>& out, const unsigned int* indices, size_t indexCount) {
+    out.clear();
+
+    // Deltas only fit the 4-byte codes while indices stay below 2^31
+    bool fits = true;
+    for (size_t i = 0; i < indexCount && fits; i++) fits = indices[i] < 0x80000000u;
+    if (!fits) {
+        out.push_back(ModeRaw);
+        out.resize(1 + indexCount * sizeof(unsigned int));
+        std::memcpy(out.data() + 1, indices, indexCount * sizeof(unsigned int));
+        return;
+    }
+
+    size_t groupCount = (indexCount + 2) / 3;
+    std::vector<unsigned char> codes;
+    codes.reserve(indexCount * 2);
+    out.reserve(1 + groupCount + indexCount * 2 + kPadding);
+    out.push_back(ModeGrouped);
+    out.resize(1 + groupCount);
+
+    unsigned int last = 0, next = 0;
+    for (size_t g = 0; g < groupCount; g++) {
+        unsigned char control = 0;
+        for (int k = 0; k < 3 && g * 3 + k < indexCount; k++) {
+            unsigned int v = indices[g * 3 + k];
+            uint32_t code = 0;
+            if (v != next) {
+                int32_t delta = (int32_t)(v - last);
+                code = (((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31)) + 1;
+            }
+            unsigned int length = lengthCode(code);
+            control |= (unsigned char)(length << (2 * k));
+            for (unsigned int b = 0; b < kCodeBytes[length]; b++) codes.push_back((unsigned char)(code >> (8 * b)));
+
+            last = v;
+            if (v >= next) next = v + 1;
+        }
+        out[1 + g] = control;
+    }
+
+    out.insert(out.end(), codes.begin(), codes.end());
+    out.insert(out.end(), kPadding, 0);
+}
+
+bool decodeIndexBuffer(unsigned int* indices, size_t indexCount, const unsigned char* data, size_t size) {
+    if (size < 1) return false;
+    if (data[0] == ModeRaw) {
+        if (size != 1 + indexCount * sizeof(unsigned int)) return false;
+        std::memcpy(indices, data + 1, indexCount * sizeof(unsigned int));
+        return true;
+    }
+    if (data[0] != ModeGrouped) return false;
+
+    size_t groupCount = (indexCount + 2) / 3;
+    if (size < 1 + groupCount + kPadding) return false;
+    const unsigned char* controls = data + 1;
+    const unsigned char* codes = controls + groupCount;
+    const GroupTable& table = groupTable();
+
+    // Validate the whole stream up front so the loop below needs no bounds checks
+    size_t codeBytes = 0;
+    for (size_t g = 0; g < groupCount; g++) codeBytes += table.layout[controls[g] & 63].size;
+    if (size != 1 + groupCount + codeBytes + kPadding) return false;
+
+    unsigned int last = 0, next = 0;
+    size_t fullGroups = indexCount / 3;
+    for (size_t g = 0; g < fullGroups; g++) {
+        unsigned int control = controls[g] & 63;
+        const GroupLayout& layout = table.layout[control];
+        for (int k = 0; k < 3; k++) {
+            uint32_t code;
+            std::memcpy(&code, codes + layout.offset[k], sizeof(code));
+            code &= kCodeMask[(control >> (2 * k)) & 3];
+
+            uint32_t zigzag = code - 1;
+            unsigned int v = code == 0 ? next : last + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+            indices[g * 3 + k] = v;
+            last = v;
+            next = v >= next ? v + 1 : next;
+        }
+        codes += layout.size;
+    }
+
+    // Index count not a multiple of three: the last group is partial
+    for (size_t i = fullGroups * 3; i < indexCount; i++) {
+        unsigned int control = controls[fullGroups] & 63;
+        int k = (int)(i - fullGroups * 3);
+        uint32_t code;
+        std::memcpy(&code, codes + table.layout[control].offset[k], sizeof(code));
+        code &= kCodeMask[(control >> (2 * k)) & 3];
+
+        uint32_t zigzag = code - 1;
+        unsigned int v = code == 0 ? next : last + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+        indices[i] = v;
+        last = v;
+        next = v >= next ? v + 1 : next;
+    }
+    return true;
+}
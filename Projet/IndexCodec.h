@@ -0,0 +1,19 @@
+#ifndef INDEXCODEC_H
+#define INDEXCODEC_H
+
+#include <cstddef>
+#include <vector>
+
+// Index buffer codec for the mesh cache. Each index is coded against the
+// previous one: 0 for the next never-seen vertex (the common case after
+// first-use renumbering), otherwise the zig-zagged delta + 1. Codes are
+// stored in 0, 1, 2 or 4 bytes, with one control byte per triangle giving
+// the three lengths. Control bytes are stored apart from the codes, so
+// decoding only has to advance one pointer per triangle.
+// Cache-ordered buffers shrink to about 1.2-1.5 bytes per index.
+void encodeIndexBuffer(std::vector<unsigned char>& out, const unsigned int* indices, size_t indexCount);
+
+// Returns false if data is not an encoding of exactly indexCount indices
+bool decodeIndexBuffer(unsigned int* indices, size_t indexCount, const unsigned char* data, size_t size);
+
+#endif
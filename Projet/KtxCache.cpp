@@ -0,0 +1,313 @@
+#include "KtxCache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "FileUtil.h"
+
+static const unsigned char kKtxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const char kSourceKey[] = "ProjetSource";
+static const char kWriterKey[] = "KTXwriter";
+static const char kWriterName[] = "Projet";
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct KtxLevel {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// Value of the kSourceKey entry
+struct KtxSource {
+    uint32_t version;
+    uint32_t channels;
+    uint64_t sourceSize;
+    uint64_t sourceMtime;
+    uint64_t sourceHash;
+};
+
+static_assert(sizeof(KtxHeader) == 80, "KtxHeader layout changed");
+static_assert(sizeof(KtxLevel) == 24, "KtxLevel layout changed");
+static_assert(sizeof(KtxSource) == 32, "KtxSource layout changed");
+
+// The block formats compressImage makes, with their Vulkan format and data
+// format descriptor color model as KTX2 names them
+struct KtxFormat {
+    GLenum format;
+    uint32_t vkFormat;
+    uint8_t colorModel;
+    uint32_t blockBytes;
+};
+
+static const KtxFormat kKtxFormats[] = {
+    { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 131, 128, 8 },   // BC1_RGB_UNORM, KHR_DF_MODEL_BC1A
+    { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 137, 130, 16 }, // BC3_UNORM, KHR_DF_MODEL_BC3
+    { GL_COMPRESSED_RED_RGTC1, 139, 131, 8 },           // BC4_UNORM, KHR_DF_MODEL_BC4
+    { GL_COMPRESSED_RGBA_BPTC_UNORM, 145, 134, 16 },    // BC7_UNORM, KHR_DF_MODEL_BC7
+};
+
+static const KtxFormat* findFormat(GLenum format) {
+    for (const KtxFormat& entry : kKtxFormats) {
+        if (entry.format == format) return &entry;
+    }
+    return nullptr;
+}
+
+static const KtxFormat* findVkFormat(uint32_t vkFormat) {
+    for (const KtxFormat& entry : kKtxFormats) {
+        if (entry.vkFormat == vkFormat) return &entry;
+    }
+    return nullptr;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t levelBytes(const KtxFormat& format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+}
+
+static void put8(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back((unsigned char)value);
+}
+
+static void put16(std::vector<unsigned char>& out, uint32_t value) {
+    put8(out, value);
+    put8(out, value >> 8);
+}
+
+static void put32(std::vector<unsigned char>& out, uint32_t value) {
+    put16(out, value);
+    put16(out, value >> 16);
+}
+
+// Basic data format descriptor: one sample per 64-bit half of the block,
+// so BC3 describes its alpha half and its color half separately
+static void writeDescriptor(std::vector<unsigned char>& out, const KtxFormat& format) {
+    const uint32_t kBasicBlockSize = 24, kSampleSize = 16;
+    const uint32_t kTransferLinear = 1, kPrimariesBt709 = 1;
+    const uint32_t kChannelBc3Alpha = 15;
+    uint32_t samples = format.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 2 : 1;
+    uint32_t blockSize = kBasicBlockSize + samples * kSampleSize;
+
+    put32(out, 4 + blockSize);  // dfdTotalSize
+    put32(out, 0);              // vendorId 0 (Khronos), descriptorType 0 (basic)
+    put16(out, 2);              // versionNumber
+    put16(out, blockSize);
+    put8(out, format.colorModel);
+    put8(out, kPrimariesBt709);
+    put8(out, kTransferLinear);
+    put8(out, 0);               // flags: straight alpha
+    put32(out, 0x00000303);     // texelBlockDimension: 4x4x1x1, each stored minus one
+    put8(out, format.blockBytes);
+    for (int plane = 1; plane < 8; plane++) put8(out, 0);
+
+    for (uint32_t s = 0; s < samples; s++) {
+        uint32_t bits = samples == 1 ? format.blockBytes * 8 : 64;
+        put16(out, s * 64);     // bitOffset
+        put8(out, bits - 1);    // bitLength
+        put8(out, samples == 2 && s == 0 ? kChannelBc3Alpha : 0);
+        put32(out, 0);          // samplePosition
+        put32(out, 0);          // sampleLower
+        put32(out, 0xFFFFFFFF); // sampleUpper
+    }
+}
+
+static void writeKeyValue(std::vector<unsigned char>& out, const char* key, const void* value, size_t size) {
+    size_t keyBytes = strlen(key) + 1;
+    put32(out, (uint32_t)(keyBytes + size));
+    out.insert(out.end(), key, key + keyBytes);
+    out.insert(out.end(), (const unsigned char*)value, (const unsigned char*)value + size);
+    while (out.size() % 4 != 0) out.push_back(0);
+}
+
+std::string ktxCachePath(const std::string& sourcePath) {
+    return sourcePath + ".ktx2";
+}
+
+// Finds the kSourceKey entry; offset is where its value starts in the file
+static bool findSource(const MappedFile& file, const KtxHeader& header, KtxSource& source, uint64_t& offset) {
+    uint64_t position = header.kvdByteOffset, end = (uint64_t)header.kvdByteOffset + header.kvdByteLength;
+    if (end > file.size()) return false;
+    while (position + 4 <= end) {
+        uint32_t length;
+        std::memcpy(&length, file.data() + position, 4);
+        uint64_t entry = position + 4;
+        if (entry + length > end) return false;
+
+        const char* key = (const char*)file.data() + entry;
+        size_t keyBytes = sizeof(kSourceKey);
+        if (length == keyBytes + sizeof(KtxSource) && std::memcmp(key, kSourceKey, keyBytes) == 0) {
+            offset = entry + keyBytes;
+            std::memcpy(&source, file.data() + offset, sizeof(source));
+            return true;
+        }
+        position = alignUp(entry + length, 4);
+    }
+    return false;
+}
+
+bool readKtxCache(const std::string& sourcePath, const CompressionSupport& support, CompressedImage& image) {
+    FileInfo sourceInfo;
+    if (!getFileInfo(sourcePath, sourceInfo)) return false;
+
+    std::string cachePath = ktxCachePath(sourcePath);
+    MappedFile file;
+    if (!file.open(cachePath)) return false;
+    if (file.size() < sizeof(KtxHeader)) return false;
+
+    KtxHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.identifier, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0) return false;
+    const KtxFormat* format = findVkFormat(header.vkFormat);
+    if (!format || !compressedFormatSupported(format->format, support)) return false;
+    if (header.typeSize != 1 || header.pixelDepth != 0 || header.layerCount != 0 || header.faceCount != 1) return false;
+    if (header.supercompressionScheme != 0 || header.levelCount == 0 || header.levelCount > 32) return false;
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > 65536 || header.pixelHeight > 65536) {
+        return false;
+    }
+    if (sizeof(KtxHeader) + (uint64_t)header.levelCount * sizeof(KtxLevel) > file.size()) return false;
+
+    KtxSource source;
+    uint64_t sourceOffset;
+    if (!findSource(file, header, source, sourceOffset)) return false;
+    if (source.version != kKtxCacheVersion || source.sourceSize != sourceInfo.size) return false;
+
+    if (source.sourceMtime != sourceInfo.mtime) {
+        uint64_t hash;
+        if (!hashFile(sourcePath, hash) || hash != source.sourceHash) return false;
+
+        // Same content under a new timestamp (checkout, copy): keep the cache
+        FILE* out = fopen(cachePath.c_str(), "r+b");
+        if (out) {
+            fseek(out, (long)(sourceOffset + offsetof(KtxSource, sourceMtime)), SEEK_SET);
+            fwrite(&sourceInfo.mtime, sizeof(sourceInfo.mtime), 1, out);
+            fclose(out);
+        }
+    }
+
+    const KtxLevel* index = (const KtxLevel*)(file.data() + sizeof(KtxHeader));
+    std::vector<CompressedLevel> levels(header.levelCount);
+    size_t total = 0;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        KtxLevel level;
+        std::memcpy(&level, &index[i], sizeof(level));
+        if (i > 0 && levels[i - 1].width == 1 && levels[i - 1].height == 1) return false;
+        CompressedLevel& out = levels[i];
+        out.width = std::max(1, (int)(header.pixelWidth >> i));
+        out.height = std::max(1, (int)(header.pixelHeight >> i));
+        out.offset = total;
+        out.size = levelBytes(*format, out.width, out.height);
+        // Written so a damaged offset cannot wrap around
+        if (level.byteLength != out.size || level.byteOffset > file.size() ||
+            level.byteLength > file.size() - level.byteOffset) {
+            return false;
+        }
+        total += out.size;
+    }
+
+    image.format = format->format;
+    image.channels = (int)source.channels;
+    image.sourceHash = source.sourceHash;
+    image.levels = std::move(levels);
+    image.blocks.resize(total);
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        KtxLevel level;
+        std::memcpy(&level, &index[i], sizeof(level));
+        std::memcpy(image.blocks.data() + image.levels[i].offset, file.data() + level.byteOffset, image.levels[i].size);
+    }
+    return true;
+}
+
+bool writeKtxCache(const std::string& sourcePath, const CompressedImage& image) {
+    const KtxFormat* format = findFormat(image.format);
+    if (!format || image.levels.empty()) return false;
+
+    FileInfo sourceInfo;
+    if (!getFileInfo(sourcePath, sourceInfo)) return false;
+
+    uint32_t levelCount = (uint32_t)image.levels.size();
+    std::vector<unsigned char> metadata;
+    writeDescriptor(metadata, *format);
+    uint32_t dfdLength = (uint32_t)metadata.size();
+
+    KtxSource source = {};
+    source.version = kKtxCacheVersion;
+    source.channels = (uint32_t)image.channels;
+    source.sourceSize = sourceInfo.size;
+    source.sourceMtime = sourceInfo.mtime;
+    source.sourceHash = image.sourceHash;
+    // Keys in byte order, as KTX2 requires
+    writeKeyValue(metadata, kWriterKey, kWriterName, sizeof(kWriterName));
+    writeKeyValue(metadata, kSourceKey, &source, sizeof(source));
+
+    KtxHeader header = {};
+    std::memcpy(header.identifier, kKtxIdentifier, sizeof(kKtxIdentifier));
+    header.vkFormat = format->vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = (uint32_t)image.width();
+    header.pixelHeight = (uint32_t)image.height();
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = (uint32_t)(sizeof(KtxHeader) + levelCount * sizeof(KtxLevel));
+    header.dfdByteLength = dfdLength;
+    header.kvdByteOffset = header.dfdByteOffset + dfdLength;
+    header.kvdByteLength = (uint32_t)metadata.size() - dfdLength;
+
+    // Level data smallest first, each aligned to the block size
+    std::vector<KtxLevel> index(levelCount);
+    uint64_t offset = alignUp(header.kvdByteOffset + header.kvdByteLength, format->blockBytes);
+    uint64_t dataOffset = offset;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        index[i].byteOffset = offset;
+        index[i].byteLength = index[i].uncompressedByteLength = image.levels[i].size;
+        offset = alignUp(offset + image.levels[i].size, format->blockBytes);
+    }
+
+    std::string cachePath = ktxCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    FILE* out = fopen(tempPath.c_str(), "wb");
+    if (!out) return false;
+
+    static const unsigned char padding[16] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(index.data(), sizeof(KtxLevel), levelCount, out) == levelCount;
+    ok = ok && fwrite(metadata.data(), 1, metadata.size(), out) == metadata.size();
+    uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+    ok = ok && fwrite(padding, 1, (size_t)(dataOffset - written), out) == dataOffset - written;
+    written = dataOffset;
+    for (uint32_t i = levelCount; i-- > 0 && ok;) {
+        ok = fwrite(padding, 1, (size_t)(index[i].byteOffset - written), out) == index[i].byteOffset - written;
+        const CompressedLevel& level = image.levels[i];
+        ok = ok && fwrite(image.blocks.data() + level.offset, 1, level.size, out) == level.size;
+        written = index[i].byteOffset + level.size;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || !replaceFile(tempPath, cachePath)) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
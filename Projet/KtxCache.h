@@ -0,0 +1,26 @@
+#ifndef KTXCACHE_H
+#define KTXCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "Texture.h"
+
+// Bumped whenever the encoder, the mip filter or the size maps are cached
+// at changes, so caches made by an older build are compressed again
+const uint32_t kKtxCacheVersion = 4;
+
+// Compressed textures are cached next to their source image as KTX2 files
+// (Khronos texture container 2): the header, the level index, a data format
+// descriptor for the block format and the level data, smallest level
+// first, without supercompression. A key/value entry records the source
+// file's size, timestamp and content hash, checked the same way as for
+// mesh caches, so other KTX2 tools can read the files as they are.
+std::string ktxCachePath(const std::string& sourcePath);
+
+// Reads the cache of sourcePath if it is valid and its format is one the
+// context samples
+bool readKtxCache(const std::string& sourcePath, const CompressionSupport& support, CompressedImage& image);
+
+bool writeKtxCache(const std::string& sourcePath, const CompressedImage& image);
+
+#endif
@@ -0,0 +1,175 @@
+#include "LzCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LZCODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const size_t kHeaderSize = 8;
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 65535;
+const int kHashBits = 16;
+
+// Literal and match copies may write this far past their end when there is room
+const size_t kWildCopy = 16;
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - kHashBits); }
+
+inline void copy16(unsigned char* destination, const unsigned char* source) {
+#ifdef LZCODEC_SSE2
+    _mm_storeu_si128((__m128i*)destination, _mm_loadu_si128((const __m128i*)source));
+#else
+    std::memcpy(destination, source, 16);
+#endif
+}
+
+// Copies in 16-byte steps, so up to kWildCopy - 1 bytes past count
+inline void wildCopy(unsigned char* destination, const unsigned char* source, size_t count) {
+    unsigned char* end = destination + count;
+    do {
+        copy16(destination, source);
+        destination += 16;
+        source += 16;
+    } while (destination < end);
+}
+
+void writeLength(std::vector<unsigned char>& out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back((unsigned char)length);
+}
+
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& length) {
+    unsigned char b;
+    do {
+        if (ip >= end) return false;
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+// matchLength 0 ends the stream with literals only
+void emitSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalCount,
+    size_t matchLength, size_t offset) {
+    size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+    out.push_back((unsigned char)((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15) writeLength(out, literalCount - 15);
+    out.insert(out.end(), literals, literals + literalCount);
+    if (matchLength == 0) return;
+    out.push_back((unsigned char)(offset & 0xFF));
+    out.push_back((unsigned char)(offset >> 8));
+    if (matchCode >= 15) writeLength(out, matchCode - 15);
+}
+
+}  // namespace
+
+void compressLz(std::vector<unsigned char>& out, const unsigned char* data, size_t size) {
+    out.clear();
+    out.reserve(kHeaderSize + size + size / 255 + 16);
+    uint64_t decodedSize = size;
+    out.resize(kHeaderSize);
+    std::memcpy(out.data(), &decodedSize, kHeaderSize);
+
+    // Greedy: take the first match the hash finds and skip faster through
+    // data that keeps missing
+    std::vector<uint32_t> table(1u << kHashBits, 0);
+    size_t anchor = 0, pos = 0, misses = 0;
+    while (size >= kMinMatch && pos <= size - kMinMatch) {
+        uint32_t sequence = read32(data + pos);
+        uint32_t& slot = table[hash4(sequence)];
+        size_t candidate = slot;
+        slot = (uint32_t)pos;
+        if (candidate >= pos || pos - candidate > kMaxOffset || read32(data + candidate) != sequence) {
+            misses++;
+            pos += 1 + (misses >> 6);
+            continue;
+        }
+
+        size_t length = kMinMatch;
+        while (pos + length + 8 <= size && read64(data + candidate + length) == read64(data + pos + length)) length += 8;
+        while (pos + length < size && data[candidate + length] == data[pos + length]) length++;
+
+        emitSequence(out, data + anchor, pos - anchor, length, pos - candidate);
+        pos += length;
+        anchor = pos;
+        misses = 0;
+        if (pos <= size - kMinMatch) table[hash4(read32(data + pos - 2))] = (uint32_t)(pos - 2);
+    }
+    emitSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+bool lzDecodedSize(const unsigned char* data, size_t size, uint64_t& decodedSize) {
+    if (size < kHeaderSize) return false;
+    std::memcpy(&decodedSize, data, kHeaderSize);
+    return true;
+}
+
+bool decompressLz(unsigned char* out, size_t outSize, const unsigned char* data, size_t size) {
+    uint64_t decodedSize;
+    if (!lzDecodedSize(data, size, decodedSize) || decodedSize != outSize) return false;
+
+    const unsigned char* ip = data + kHeaderSize;
+    const unsigned char* iend = data + size;
+    unsigned char* op = out;
+    unsigned char* oend = out + outSize;
+    for (;;) {
+        if (ip >= iend) return false;
+        unsigned int token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(ip, iend, literals)) return false;
+        if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals) return false;
+        if (literals > 0) {
+            if ((size_t)(iend - ip) >= literals + kWildCopy && (size_t)(oend - op) >= literals + kWildCopy) {
+                wildCopy(op, ip, literals);
+            }
+            else {
+                std::memcpy(op, ip, literals);
+            }
+        }
+        op += literals;
+        ip += literals;
+        if (ip == iend) return op == oend;
+
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(ip, iend, length)) return false;
+        length += kMinMatch;
+        if (offset == 0 || offset > (size_t)(op - out) || (size_t)(oend - op) < length) return false;
+
+        const unsigned char* match = op - offset;
+        if (offset >= 16 && (size_t)(oend - op) >= length + kWildCopy) {
+            wildCopy(op, match, length);
+        }
+        else {
+            // Overlapping runs: each copy doubles the repeated span, so even
+            // offset 1 takes a handful of memcpys
+            unsigned char* end = op + length;
+            for (unsigned char* write = op; write < end;) {
+                size_t chunk = std::min((size_t)(write - match), (size_t)(end - write));
+                std::memcpy(write, match, chunk);
+                write += chunk;
+            }
+        }
+        op += length;
+    }
+}
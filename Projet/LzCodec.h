@@ -0,0 +1,23 @@
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Byte-oriented LZ77 in the spirit of LZ4, used as the last stage of the
+// mesh cache codecs. The stream starts with the decoded size (8 bytes),
+// then sequences of: a token (literal length in the high nibble, match
+// length - 4 in the low one, 15 meaning more length bytes follow), the
+// literals, and a 2-byte match offset. The last sequence has no match.
+// There is no entropy stage; it is meant to run behind filters that turn
+// the data into runs and repeats.
+void compressLz(std::vector<unsigned char>& out, const unsigned char* data, size_t size);
+
+// Decoded size recorded in the stream, or false if it is too short
+bool lzDecodedSize(const unsigned char* data, size_t size, uint64_t& decodedSize);
+
+// Returns false unless data decodes to exactly outSize bytes
+bool decompressLz(unsigned char* out, size_t outSize, const unsigned char* data, size_t size);
+
+#endif
@@ -0,0 +1,36 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+
+void MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this, bytes]() { return closed_ || used_ == 0 || used_ + bytes <= limit_; });
+    used_ += bytes;
+    peak_ = std::max(peak_, used_);
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_ -= std::min(bytes, used_);
+    }
+    released_.notify_all();
+}
+
+void MemoryBudget::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    released_.notify_all();
+}
+
+size_t MemoryBudget::used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+size_t MemoryBudget::peak() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+}
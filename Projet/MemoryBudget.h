@@ -0,0 +1,37 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Caps the bytes a group of threads holds at once, such as decoded images
+// waiting for their upload. acquire blocks until the bytes fit; a request
+// larger than the whole budget is let through once nothing else is held,
+// so it cannot wait forever. Thread-safe.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit) : limit_(limit) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    void acquire(size_t bytes);
+    void release(size_t bytes);
+
+    // Lets every current and later acquire through, for shutdown
+    void close();
+
+    size_t used() const;
+    size_t peak() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t limit_;
+    size_t used_ = 0;
+    size_t peak_ = 0;
+    bool closed_ = false;
+};
+
+#endif
@@ -0,0 +1,572 @@
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshNormals.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+// A face corner as welded: identical corners share one vertex. Corners
+// without a normal also carry their smoothing group, so a position gets one
+// generated normal per group.
+struct CornerKey {
+    tinyobj::index_t index;
+    uint64_t smoothing;
+};
+
+struct CornerHash {
+    size_t operator()(const CornerKey& key) const {
+        size_t h = std::hash<int>()(key.index.vertex_index);
+        h ^= std::hash<int>()(key.index.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<int>()(key.index.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<uint64_t>()(key.smoothing) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct CornerEqual {
+    bool operator()(const CornerKey& a, const CornerKey& b) const {
+        return a.index.vertex_index == b.index.vertex_index && a.index.normal_index == b.index.normal_index &&
+            a.index.texcoord_index == b.index.texcoord_index && a.smoothing == b.smoothing;
+    }
+};
+
+// Smoothing of a corner whose face is in no group: unique to the face, so it stays flat
+const uint64_t kFlatFace = 1ull << 32;
+
+void MeshData::useOwnedStorage() {
+    mapping.reset();
+    vertexData = vertices.data();
+    vertexCount = vertices.size() / kVertexStride;
+    packedData = packing.vertices.size() == vertexCount && vertexCount > 0 ? packing.vertices.data() : nullptr;
+    indexData = indices.data();
+    indexCount = indices.size();
+}
+
+static void copyName(char* destination, size_t capacity, const std::string& source) {
+    size_t length = std::min(source.size(), capacity - 1);
+    std::memcpy(destination, source.data(), length);
+    destination[length] = '\0';
+}
+
+static void buildMaterials(const std::string& name, const std::vector<tinyobj::material_t>& materials,
+    const std::string& baseDir, MeshData& mesh) {
+    mesh.materials.resize(materials.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        const tinyobj::material_t& source = materials[m];
+        MeshMaterial& material = mesh.materials[m];
+        material = MeshMaterial();
+        copyName(material.name, sizeof(material.name), source.name);
+        if (!source.diffuse_texname.empty()) {
+            std::string path = baseDir + source.diffuse_texname;
+            if (path.size() < sizeof(material.diffuseTexture)) {
+                copyName(material.diffuseTexture, sizeof(material.diffuseTexture), path);
+            }
+            else {
+                std::cerr << "WARN: texture path too long in " << name << ": " << path << std::endl;
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            material.diffuse[c] = (float)source.diffuse[c];
+            material.specular[c] = (float)source.specular[c];
+        }
+        material.shininess = (float)source.shininess;
+        material.opacity = (float)source.dissolve;
+    }
+}
+
+void buildMesh(const std::string& name, const tinyobj::attrib_t& attrib,
+    const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials,
+    const std::string& baseDir, MeshData& mesh) {
+    buildMaterials(name, materials, baseDir, mesh);
+
+    // Faces are bucketed by material; unknown ids share the bucket of -1
+    size_t materialCount = materials.size();
+    auto bucketOf = [materialCount](const tinyobj::shape_t& shape, size_t face) {
+        int id = face < shape.mesh.material_ids.size() ? shape.mesh.material_ids[face] : -1;
+        return (id >= 0 && (size_t)id < materialCount) ? (size_t)id + 1 : 0;
+    };
+
+    // Faces with a vertex out of range are skipped, whichever loader made them
+    size_t positionCount = attrib.vertices.size() / 3;
+    auto validFace = [positionCount](const tinyobj::shape_t& shape, size_t face) {
+        for (size_t k = 0; k < 3; k++) {
+            int vertex = shape.mesh.indices[face * 3 + k].vertex_index;
+            if (vertex < 0 || (size_t)vertex >= positionCount) return false;
+        }
+        return true;
+    };
+
+    std::vector<size_t> bucketOffsets(materialCount + 2, 0);
+    size_t corners = 0, skippedFaces = 0;
+    for (const auto& shape : shapes) {
+        size_t faces = shape.mesh.indices.size() / 3;
+        for (size_t f = 0; f < faces; f++) {
+            if (!validFace(shape, f)) {
+                skippedFaces++;
+                continue;
+            }
+            bucketOffsets[bucketOf(shape, f) + 1] += 3;
+            corners += 3;
+        }
+    }
+    if (skippedFaces > 0) {
+        std::cerr << "WARN: skipped " << skippedFaces << " faces with invalid vertex indices in " << name << std::endl;
+    }
+    for (size_t b = 0; b <= materialCount; b++) bucketOffsets[b + 1] += bucketOffsets[b];
+
+    size_t baseOffset = mesh.indices.size();
+    for (size_t b = 0; b <= materialCount; b++) {
+        uint32_t count = (uint32_t)(bucketOffsets[b + 1] - bucketOffsets[b]);
+        if (count > 0) {
+            mesh.submeshes.push_back({ (uint32_t)(baseOffset + bucketOffsets[b]), count, (int32_t)b - 1, 0, 0 });
+        }
+    }
+
+    std::unordered_map<CornerKey, unsigned int, CornerHash, CornerEqual> uniqueVertices;
+    uniqueVertices.reserve(corners);
+    mesh.indices.resize(baseOffset + corners);
+    std::vector<size_t> cursor(bucketOffsets.begin(), bucketOffsets.end() - 1);
+
+    // Generated normals are shared by position and smoothing group
+    std::unordered_map<CornerKey, uint32_t, CornerHash, CornerEqual> smoothKeyOf;
+    std::vector<uint32_t> smoothKeys(mesh.vertices.size() / kVertexStride, kKeepNormal);
+    size_t faceSerial = 0;
+
+    for (const auto& shape : shapes) {
+        size_t faces = shape.mesh.indices.size() / 3;
+        for (size_t f = 0; f < faces; f++, faceSerial++) {
+            if (!validFace(shape, f)) continue;
+            size_t& write = cursor[bucketOf(shape, f)];
+            unsigned int group = f < shape.mesh.smoothing_group_ids.size() ? shape.mesh.smoothing_group_ids[f] : 0;
+            for (size_t k = 0; k < 3; k++) {
+                CornerKey key = { shape.mesh.indices[f * 3 + k], 0 };
+                tinyobj::index_t& index = key.index;
+                bool hasNormal = index.normal_index >= 0 && 3 * (size_t)index.normal_index + 2 < attrib.normals.size();
+                if (!hasNormal) {
+                    index.normal_index = -1;
+                    key.smoothing = group != 0 ? group : kFlatFace | faceSerial;
+                }
+                bool hasTexcoord =
+                    index.texcoord_index >= 0 && 2 * (size_t)index.texcoord_index + 1 < attrib.texcoords.size();
+                if (!hasTexcoord) index.texcoord_index = -1;
+
+                auto it = uniqueVertices.find(key);
+                if (it != uniqueVertices.end()) {
+                    mesh.indices[baseOffset + write++] = it->second;
+                    continue;
+                }
+
+                unsigned int newIndex = (unsigned int)(mesh.vertices.size() / kVertexStride);
+                uniqueVertices.emplace(key, newIndex);
+
+                mesh.vertices.push_back(attrib.vertices[3 * index.vertex_index + 0]);
+                mesh.vertices.push_back(attrib.vertices[3 * index.vertex_index + 1]);
+                mesh.vertices.push_back(attrib.vertices[3 * index.vertex_index + 2]);
+
+                if (hasNormal) {
+                    mesh.vertices.push_back(attrib.normals[3 * index.normal_index + 0]);
+                    mesh.vertices.push_back(attrib.normals[3 * index.normal_index + 1]);
+                    mesh.vertices.push_back(attrib.normals[3 * index.normal_index + 2]);
+                    smoothKeys.push_back(kKeepNormal);
+                }
+                else {
+                    mesh.vertices.insert(mesh.vertices.end(), 3, 0.0f);
+                    CornerKey position = { { index.vertex_index, -1, -1 }, key.smoothing };
+                    smoothKeys.push_back(smoothKeyOf.emplace(position, (uint32_t)smoothKeyOf.size()).first->second);
+                }
+
+                if (hasTexcoord) {
+                    mesh.vertices.push_back(attrib.texcoords[2 * index.texcoord_index + 0]);
+                    mesh.vertices.push_back(attrib.texcoords[2 * index.texcoord_index + 1]);
+                }
+                else {
+                    mesh.vertices.push_back(0.0f);
+                    mesh.vertices.push_back(0.0f);
+                }
+
+                // Filled in by generateTangents
+                mesh.vertices.insert(mesh.vertices.end(), 4, 0.0f);
+
+                mesh.indices[baseOffset + write++] = newIndex;
+            }
+        }
+    }
+
+    if (!smoothKeyOf.empty()) {
+        generateNormals(mesh, smoothKeys, smoothKeyOf.size());
+        printf("Normals generated: %s %zu smooth normals\n", name.c_str(), smoothKeyOf.size());
+    }
+    generateTangents(mesh);
+
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    for (int c = 0; c < 3; c++) {
+        mesh.boundsMin[c] = vertexCount ? mesh.vertices[c] : 0.0f;
+        mesh.boundsMax[c] = mesh.boundsMin[c];
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        for (int c = 0; c < 3; c++) {
+            float p = mesh.vertices[v * kVertexStride + c];
+            mesh.boundsMin[c] = std::min(mesh.boundsMin[c], p);
+            mesh.boundsMax[c] = std::max(mesh.boundsMax[c], p);
+        }
+    }
+
+    mesh.useOwnedStorage();
+
+    size_t unique = uniqueVertices.size();
+    printf("Model loaded: %s vertices : %zu unique / %zu corners (dedup %.2fx)\n",
+        name.c_str(), unique, corners, unique ? (double)corners / (double)unique : 0.0);
+}
+
+static const unsigned int kUnusedVertex = ~0u;
+
+// A submesh on compact local ids so per-vertex work stays proportional to its size
+struct LocalRange {
+    std::vector<unsigned int> toLocal;  // sized to the mesh, kUnusedVertex outside gather
+    std::vector<unsigned int> toGlobal;
+    std::vector<unsigned int> indices;
+    std::vector<float> positions;
+
+    void gather(const MeshData& mesh, const unsigned int* range, uint32_t count) {
+        toLocal.resize(mesh.vertices.size() / kVertexStride, kUnusedVertex);
+        toGlobal.clear();
+        indices.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            unsigned int& id = toLocal[range[i]];
+            if (id == kUnusedVertex) {
+                id = (unsigned int)toGlobal.size();
+                toGlobal.push_back(range[i]);
+            }
+            indices[i] = id;
+        }
+        for (unsigned int v : toGlobal) toLocal[v] = kUnusedVertex;
+
+        positions.resize(toGlobal.size() * 3);
+        for (size_t v = 0; v < toGlobal.size(); v++) {
+            std::copy_n(&mesh.vertices[toGlobal[v] * kVertexStride], 3, &positions[v * 3]);
+        }
+    }
+
+    void reorder(uint32_t flags) {
+        if (flags & MeshOptimizeVertexCache) {
+            optimizeVertexCache(indices.data(), indices.size(), toGlobal.size());
+        }
+        if (flags & MeshOptimizeOverdraw) {
+            optimizeOverdraw(indices.data(), indices.size(), positions.data(), toGlobal.size(), 3);
+        }
+    }
+};
+
+void optimizeMesh(MeshData& mesh, uint32_t flags) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    mesh.stats.cacheBefore = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+    mesh.stats.overdrawBefore = analyzeOverdraw(mesh.indices.data(), mesh.indices.size(),
+        mesh.vertices.data(), vertexCount, kVertexStride);
+
+    LocalRange local;
+    if (flags & (MeshOptimizeVertexCache | MeshOptimizeOverdraw)) {
+        for (const Submesh& submesh : mesh.submeshes) {
+            unsigned int* range = mesh.indices.data() + submesh.indexOffset;
+            local.gather(mesh, range, submesh.indexCount);
+            local.reorder(flags);
+            for (uint32_t i = 0; i < submesh.indexCount; i++) range[i] = local.toGlobal[local.indices[i]];
+        }
+    }
+
+    // Measured on the final triangle order so it shows what renumbering alone gains
+    mesh.stats.fetchBefore = analyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), vertexCount, kVertexStride);
+    if (flags & MeshOptimizeVertexFetch) {
+        std::vector<float> reordered(mesh.vertices.size());
+        vertexCount = optimizeVertexFetch(reordered.data(), mesh.indices.data(), mesh.indices.size(),
+            mesh.vertices.data(), vertexCount, kVertexStride);
+        reordered.resize(vertexCount * kVertexStride);
+        mesh.vertices.swap(reordered);
+    }
+    splitForShortIndices(mesh);
+    vertexCount = mesh.vertices.size() / kVertexStride;
+
+    size_t baseIndexCount = mesh.indices.size();
+    buildLods(mesh, flags);
+    clusterSubmeshes(mesh, flags);
+
+    // Full detail only, on the order that gets drawn
+    mesh.stats.cacheAfter = analyzeVertexCache(mesh.indices.data(), baseIndexCount, vertexCount);
+    mesh.stats.fetchAfter = analyzeVertexFetch(mesh.indices.data(), baseIndexCount, vertexCount, kVertexStride);
+    mesh.stats.overdrawAfter = analyzeOverdraw(mesh.indices.data(), baseIndexCount,
+        mesh.vertices.data(), vertexCount, kVertexStride);
+    mesh.optimizeFlags = flags;
+    mesh.useOwnedStorage();
+}
+
+void printMeshStats(const std::string& name, const MeshData& mesh) {
+    const MeshStats& stats = mesh.stats;
+    printf("Vertex cache: %s ACMR %.3f -> %.3f ATVR %.3f -> %.3f\n", name.c_str(),
+        stats.cacheBefore.acmr, stats.cacheAfter.acmr, stats.cacheBefore.atvr, stats.cacheAfter.atvr);
+    printf("Overdraw: %s %.3f -> %.3f\n", name.c_str(), stats.overdrawBefore.overdraw, stats.overdrawAfter.overdraw);
+    printf("Vertex fetch: %s overfetch %.3f -> %.3f\n", name.c_str(), stats.fetchBefore.overfetch, stats.fetchAfter.overfetch);
+    printf("Materials: %s %zu materials, %u submeshes at full detail\n", name.c_str(), mesh.materials.size(),
+        mesh.lods.empty() ? (unsigned)mesh.submeshes.size() : mesh.lods[0].submeshCount);
+    for (size_t level = 0; level < mesh.lods.size(); level++) {
+        const MeshLod& lod = mesh.lods[level];
+        size_t indexCount = 0;
+        for (uint32_t s = 0; s < lod.submeshCount; s++) indexCount += mesh.submeshes[lod.submeshOffset + s].indexCount;
+        printf("LOD %zu: %s %zu triangles, error %.4g\n", level, name.c_str(), indexCount / 3, lod.error);
+    }
+}
+
+void splitForShortIndices(MeshData& mesh) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    if (vertexCount <= kMaxShortIndexSpan) return;
+
+    // Each chunk gets its own vertex block in first-use order; vertices on
+    // chunk borders are duplicated
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> localId(vertexCount, unused);
+    std::vector<unsigned int> chunkVertices;
+    std::vector<float> vertices;
+    vertices.reserve(mesh.vertices.size() + mesh.vertices.size() / 16);
+    std::vector<Submesh> chunks;
+
+    for (const Submesh& submesh : mesh.submeshes) {
+        unsigned int* range = mesh.indices.data() + submesh.indexOffset;
+        uint32_t start = 0;
+
+        auto flush = [&](uint32_t end) {
+            unsigned int base = (unsigned int)(vertices.size() / kVertexStride);
+            for (unsigned int v : chunkVertices) {
+                vertices.insert(vertices.end(), &mesh.vertices[v * kVertexStride], &mesh.vertices[v * kVertexStride] + kVertexStride);
+            }
+            for (uint32_t i = start; i < end; i++) range[i] = base + localId[range[i]];
+            for (unsigned int v : chunkVertices) localId[v] = unused;
+            chunkVertices.clear();
+            if (end > start) chunks.push_back({ submesh.indexOffset + start, end - start, submesh.materialId, 0, 0 });
+            start = end;
+        };
+
+        for (uint32_t i = 0; i + 2 < submesh.indexCount; i += 3) {
+            size_t added = 0;
+            for (int k = 0; k < 3; k++) {
+                bool repeated = (k > 0 && range[i + k] == range[i]) || (k > 1 && range[i + k] == range[i + 1]);
+                if (localId[range[i + k]] == unused && !repeated) added++;
+            }
+            if (chunkVertices.size() + added > kMaxShortIndexSpan) flush(i);
+            for (int k = 0; k < 3; k++) {
+                unsigned int& id = localId[range[i + k]];
+                if (id == unused) {
+                    id = (unsigned int)chunkVertices.size();
+                    chunkVertices.push_back(range[i + k]);
+                }
+            }
+        }
+        flush(submesh.indexCount);
+    }
+
+    printf("Index split: %zu submeshes -> %zu 16-bit chunks, %zu -> %zu vertices\n",
+        mesh.submeshes.size(), chunks.size(), vertexCount, vertices.size() / kVertexStride);
+    mesh.vertices.swap(vertices);
+    mesh.submeshes.swap(chunks);
+}
+
+// Position bits, so vertices that differ only in normal or texcoord match
+struct PositionKey {
+    uint32_t bits[3];
+    bool operator==(const PositionKey& other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+// Key for a position, with -0 folded into +0
+static PositionKey makePositionKey(const float* position) {
+    PositionKey key;
+    for (int c = 0; c < 3; c++) {
+        float value = position[c] + 0.0f;
+        std::memcpy(&key.bits[c], &value, sizeof(value));
+    }
+    return key;
+}
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const {
+        return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+    }
+};
+
+// Flags vertices whose position is used by more than one submesh
+static void findSharedPositions(const MeshData& mesh, std::vector<unsigned char>& shared) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    const int none = -1, several = -2;
+    std::vector<int> owner(vertexCount, none);
+    for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+        const Submesh& submesh = mesh.submeshes[s];
+        for (uint32_t i = 0; i < submesh.indexCount; i++) {
+            int& o = owner[mesh.indices[submesh.indexOffset + i]];
+            o = (o == none || o == (int)s) ? (int)s : several;
+        }
+    }
+
+    std::unordered_map<PositionKey, int, PositionKeyHash> positionOwner;
+    positionOwner.reserve(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (owner[v] == none) continue;
+        PositionKey key = makePositionKey(&mesh.vertices[v * kVertexStride]);
+        auto it = positionOwner.emplace(key, owner[v]).first;
+        if (it->second != owner[v]) it->second = several;
+    }
+
+    shared.assign(vertexCount, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (owner[v] == none) continue;
+        PositionKey key = makePositionKey(&mesh.vertices[v * kVertexStride]);
+        shared[v] = positionOwner[key] == several;
+    }
+}
+
+// A level has to drop at least this share of the previous one to be kept
+const float kMinLodReduction = 0.2f;
+// Levels below this many triangles are not worth another draw range
+const size_t kMinLodTriangles = 64;
+
+void buildLods(MeshData& mesh, uint32_t flags) {
+    uint32_t baseCount = (uint32_t)mesh.submeshes.size();
+    mesh.lods.assign(1, { 0, baseCount, 0.0f });
+    if (!(flags & MeshOptimizeLods)) return;
+
+    std::vector<unsigned char> shared;
+    findSharedPositions(mesh, shared);
+
+    // Each level is simplified from the previous one, so errors add up
+    std::vector<float> submeshError(baseCount, 0.0f);
+    size_t previousIndices = mesh.indices.size();
+    LocalRange local;
+    std::vector<unsigned char> locked;
+
+    while (mesh.lods.size() < (size_t)kMaxLodLevels && previousIndices / 3 >= 2 * kMinLodTriangles) {
+        MeshLod previous = mesh.lods.back();
+        MeshLod lod = { (uint32_t)mesh.submeshes.size(), baseCount, previous.error };
+        size_t levelStart = mesh.indices.size();
+
+        for (uint32_t s = 0; s < baseCount; s++) {
+            Submesh source = mesh.submeshes[previous.submeshOffset + s];
+            local.gather(mesh, mesh.indices.data() + source.indexOffset, source.indexCount);
+            locked.resize(local.toGlobal.size());
+            for (size_t v = 0; v < locked.size(); v++) locked[v] = shared[local.toGlobal[v]];
+
+            float error = 0.0f;
+            size_t target = source.indexCount / 6 * 3;
+            size_t count = simplifyMesh(local.indices.data(), local.indices.data(), local.indices.size(),
+                local.positions.data(), local.toGlobal.size(), 3, target, std::numeric_limits<float>::max(),
+                locked.data(), &error);
+            local.indices.resize(count);
+            local.reorder(flags & MeshOptimizeVertexCache);
+
+            submeshError[s] += error;
+            lod.error = std::max(lod.error, submeshError[s]);
+
+            mesh.submeshes.push_back({ (uint32_t)mesh.indices.size(), (uint32_t)count, source.materialId, 0, 0 });
+            for (unsigned int index : local.indices) mesh.indices.push_back(local.toGlobal[index]);
+        }
+
+        size_t levelIndices = mesh.indices.size() - levelStart;
+        if (levelIndices > previousIndices * (1.0f - kMinLodReduction)) {
+            mesh.indices.resize(levelStart);
+            mesh.submeshes.resize(lod.submeshOffset);
+            break;
+        }
+        mesh.lods.push_back(lod);
+        previousIndices = levelIndices;
+    }
+}
+
+// Every edge of level 0 meets another one running the other way, comparing positions
+static bool isClosedMesh(const MeshData& mesh, size_t indexCount) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstVertex;
+    firstVertex.reserve(vertexCount);
+    std::vector<unsigned int> remap(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        PositionKey key = makePositionKey(&mesh.vertices[v * kVertexStride]);
+        remap[v] = firstVertex.emplace(key, (unsigned int)v).first->second;
+    }
+
+    std::unordered_map<uint64_t, int> balance;
+    balance.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = remap[mesh.indices[i + k]], b = remap[mesh.indices[i + (k + 1) % 3]];
+            if (a == b) continue;
+            if (a < b) balance[(a << 32) | b]++;
+            else balance[(b << 32) | a]--;
+        }
+    }
+    for (const auto& edge : balance) {
+        if (edge.second != 0) return false;
+    }
+    return true;
+}
+
+void clusterSubmeshes(MeshData& mesh, uint32_t flags) {
+    mesh.meshlets.clear();
+    for (Submesh& submesh : mesh.submeshes) {
+        submesh.meshletOffset = 0;
+        submesh.meshletCount = 0;
+    }
+    if (!(flags & MeshOptimizeMeshlets)) return;
+
+    size_t baseIndexCount = 0;
+    for (uint32_t s = 0; s < mesh.lods[0].submeshCount; s++) baseIndexCount += mesh.submeshes[s].indexCount;
+    bool cones = isClosedMesh(mesh, baseIndexCount);
+
+    LocalRange local;
+    for (Submesh& submesh : mesh.submeshes) {
+        unsigned int* range = mesh.indices.data() + submesh.indexOffset;
+        local.gather(mesh, range, submesh.indexCount);
+        submesh.meshletOffset = (uint32_t)mesh.meshlets.size();
+        submesh.meshletCount = (uint32_t)buildMeshlets(mesh.meshlets, local.indices.data(), local.indices.size(),
+            local.positions.data(), local.toGlobal.size(), 3, cones);
+        for (uint32_t i = 0; i < submesh.indexCount; i++) range[i] = local.toGlobal[local.indices[i]];
+    }
+
+    printf("Meshlets: %zu over %zu submeshes, %s\n", mesh.meshlets.size(), mesh.submeshes.size(),
+        cones ? "closed mesh, cone culling on" : "open mesh, no cone culling");
+}
+
+bool loadModel(const std::string& path, MeshData& mesh, uint32_t optimizeFlags) {
+    if (readMeshCache(path, mesh, optimizeFlags)) {
+        printf("Model loaded from cache: %s vertices : %zu indices : %zu\n", path.c_str(), mesh.vertexCount, mesh.indexCount);
+        printMeshStats(path, mesh);
+        return true;
+    }
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    size_t slash = path.find_last_of("/\\");
+    std::string baseDir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    bool success = loadObjParallel(path, attrib, shapes, materials, warn, err, baseDir);
+    if (!warn.empty()) std::cerr << "WARN: " << warn << std::endl;
+    if (!err.empty()) std::cerr << "ERR: " << err << std::endl;
+    if (!success) return false;
+
+    buildMesh(path, attrib, shapes, materials, baseDir, mesh);
+    optimizeMesh(mesh, optimizeFlags);
+    // Quantized here rather than at upload so cache hits map it as it is
+    packVertices(mesh.vertices.data(), mesh.vertexCount, mesh.boundsMin, mesh.boundsMax, mesh.packing);
+    mesh.useOwnedStorage();
+    printMeshStats(path, mesh);
+    hashFile(path, mesh.sourceHash);
+
+    if (!writeMeshCache(path, mesh, meshCacheCompression())) {
+        std::cerr << "WARN: could not write mesh cache for " << path << std::endl;
+    }
+
+    return true;
+}
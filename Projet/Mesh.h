@@ -0,0 +1,155 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+#include "FileUtil.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "VertexFormat.h"
+
+// Floats per interleaved vertex: position (3), normal (3), texcoord (2),
+// tangent (4, w is the bitangent sign)
+const int kVertexStride = 12;
+const int kNormalOffset = 3;
+const int kTexcoordOffset = 6;
+const int kTangentOffset = 8;
+
+// Contiguous index range drawn with a single material, and the run of
+// MeshData::meshlets that tiles it (none without MeshOptimizeMeshlets)
+struct Submesh {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    int32_t materialId;
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+};
+
+// Optional passes run on a freshly built mesh, recorded in the cache
+enum MeshOptimizeFlags : uint32_t {
+    MeshOptimizeVertexCache = 1,
+    MeshOptimizeOverdraw = 2,  // runs after the cache pass and mostly keeps its gains
+    MeshOptimizeVertexFetch = 4,  // renumbers vertices in final index order
+    MeshOptimizeLods = 8,  // appends simplified levels of detail
+    MeshOptimizeMeshlets = 16,  // last: regroups every submesh of every level into culling clusters
+};
+
+const uint32_t kDefaultMeshOptimizations = MeshOptimizeVertexCache | MeshOptimizeOverdraw | MeshOptimizeVertexFetch |
+    MeshOptimizeLods | MeshOptimizeMeshlets;
+
+// Material record as stored in the cache. Texture paths are resolved
+// against the OBJ's directory.
+struct MeshMaterial {
+    char name[64];
+    char diffuseTexture[256];  // empty: no diffuse map
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    float opacity;
+};
+
+// One level of detail: a run of submeshes in MeshData::submeshes, one per
+// submesh of level 0, and its geometric error in model units. All levels
+// share the vertex buffer.
+struct MeshLod {
+    uint32_t submeshOffset;
+    uint32_t submeshCount;
+    float error;
+};
+
+// Including the full-detail level
+const int kMaxLodLevels = 5;
+
+// Effect of the optimization passes, stored in the cache for reporting
+struct MeshStats {
+    VertexCacheStats cacheBefore;
+    VertexCacheStats cacheAfter;
+    OverdrawStats overdrawBefore;
+    OverdrawStats overdrawAfter;
+    VertexFetchStats fetchBefore;
+    VertexFetchStats fetchAfter;
+};
+
+struct MeshData {
+    // Owned storage, filled when the mesh is built from an OBJ
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Submesh> submeshes;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshMaterial> materials;  // Submesh::materialId indexes this, -1 is none
+
+    float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+    float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+
+    // Content hash of the source file the mesh was built from
+    uint64_t sourceHash = 0;
+
+    uint32_t optimizeFlags = 0;
+    MeshStats stats;
+
+    // The vertices quantized once when the mesh is built, and the transform
+    // that restores them; packing.vertices is the owned storage
+    PackedMesh packing;
+
+    // Keeps a mapped cache file alive while the views below point into it
+    std::shared_ptr<MappedFile> mapping;
+
+    // What Setup uploads: either the vectors above or the mapped cache
+    const float* vertexData = nullptr;
+    const PackedVertex* packedData = nullptr;  // vertexCount of them, or null if never packed
+    size_t vertexCount = 0;
+    const unsigned int* indexData = nullptr;
+    size_t indexCount = 0;
+
+    // Points the views at the owned vectors
+    void useOwnedStorage();
+};
+
+// Welds face corners into unique vertices and builds one submesh per
+// material, gathering that material's faces from every shape. materials
+// become the mesh's material table, with texture paths resolved against
+// baseDir. Corners without a normal get a generated smooth one within
+// their smoothing group (flat outside of any), then every vertex gets a
+// tangent. Faces with a vertex index out of range are skipped, and corners
+// with a texcoord or normal index out of range go without.
+void buildMesh(const std::string& name, const tinyobj::attrib_t& attrib,
+    const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials,
+    const std::string& baseDir, MeshData& mesh);
+
+// Runs the passes in flags on the owned index buffer, one submesh at a time
+// so material ranges stay intact, then splitForShortIndices, buildLods and
+// clusterSubmeshes
+void optimizeMesh(MeshData& mesh, uint32_t flags);
+
+void printMeshStats(const std::string& name, const MeshData& mesh);
+
+// Largest vertex range a submesh can address with 16-bit indices
+const uint32_t kMaxShortIndexSpan = 65536;
+
+// Meshes with more than kMaxShortIndexSpan vertices are cut into chunks of
+// consecutive triangles that each reference at most that many vertices,
+// and every chunk gets its own vertex block so it can be drawn with 16-bit
+// indices and a base vertex. Smaller meshes are left as they are.
+void splitForShortIndices(MeshData& mesh);
+
+// Sets mesh.lods to level 0 and, with MeshOptimizeLods, appends up to
+// kMaxLodLevels - 1 levels that each halve the triangles of the previous
+// one. Positions shared between submeshes are locked so materials and
+// 16-bit chunks keep meeting without cracks. The chain stops early once a
+// level no longer gets meaningfully smaller.
+void buildLods(MeshData& mesh, uint32_t flags);
+
+// Splits every submesh into meshlets with MeshOptimizeMeshlets. Cones are
+// only kept on closed meshes: with no culling in the renderer, the back
+// faces of an open mesh can show through its holes.
+void clusterSubmeshes(MeshData& mesh, uint32_t flags);
+
+// Loads a mesh from its binary cache, or parses the OBJ, optimizes it and
+// writes the cache, compressed if meshCacheCompression is on. A cache built with other optimizations is rebuilt.
+bool loadModel(const std::string& path, MeshData& mesh, uint32_t optimizeFlags = kDefaultMeshOptimizations);
+
+#endif
@@ -0,0 +1,329 @@
+#include "MeshCache.h"
+#include "IndexCodec.h"
+#include "LzCodec.h"
+#include "VertexCodec.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static_assert(sizeof(MeshCacheHeader) == 80, "MeshCacheHeader layout changed");
+static_assert(sizeof(MeshCacheSection) == 24, "MeshCacheSection layout changed");
+static_assert(sizeof(MeshCachePacking) == 48, "MeshCachePacking layout changed");
+
+static const uint64_t kSectionAlignment = 16;
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+}
+
+static std::atomic<bool> compressCaches{ false };
+
+void setMeshCacheCompression(bool compress) {
+    compressCaches = compress;
+}
+
+bool meshCacheCompression() {
+    return compressCaches;
+}
+
+std::string meshCachePath(const std::string& sourcePath) {
+    return sourcePath + ".mcache";
+}
+
+static const MeshCacheSection* findSection(const MappedFile& file, const MeshCacheHeader& header, uint32_t type) {
+    const MeshCacheSection* sections = (const MeshCacheSection*)(file.data() + sizeof(MeshCacheHeader));
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        if (sections[i].type == type) return &sections[i];
+    }
+    return nullptr;
+}
+
+// compressLz cannot expand data by more than this, so a larger decoded size
+// means a damaged header
+const uint64_t kMaxLzRatio = 256;
+
+// Bytes of a section, run back through compressLz when it has that stage;
+// storage holds the decoded bytes
+static bool sectionPayload(const MappedFile& file, const MeshCacheSection& section,
+    std::vector<unsigned char>& storage, const unsigned char*& data, size_t& size) {
+    data = file.data() + section.offset;
+    size = (size_t)section.size;
+    if (!(section.flags & kMeshSectionLz)) return true;
+
+    uint64_t decodedSize;
+    if (!lzDecodedSize(data, size, decodedSize) || decodedSize > section.size * kMaxLzRatio) return false;
+    storage.resize((size_t)decodedSize);
+    if (!decompressLz(storage.data(), storage.size(), data, size)) return false;
+    data = storage.data();
+    size = storage.size();
+    return true;
+}
+
+// Copies a section holding an array of T into items
+template <typename T>
+static bool readTable(const MappedFile& file, const MeshCacheSection& section, std::vector<T>& items) {
+    std::vector<unsigned char> storage;
+    const unsigned char* data;
+    size_t size;
+    if (!sectionPayload(file, section, storage, data, size) || size % sizeof(T) != 0) return false;
+    items.resize(size / sizeof(T));
+    if (size > 0) std::memcpy(items.data(), data, size);
+    return true;
+}
+
+// Drops what a rejected cache left behind so the mesh can be rebuilt from the source
+static bool rejectCache(MeshData& mesh) {
+    mesh.vertices.clear();
+    mesh.packing.vertices.clear();
+    mesh.indices.clear();
+    mesh.submeshes.clear();
+    mesh.lods.clear();
+    mesh.meshlets.clear();
+    mesh.materials.clear();
+    return false;
+}
+
+bool readMeshCache(const std::string& sourcePath, MeshData& mesh, uint32_t optimizeFlags) {
+    FileInfo sourceInfo;
+    if (!getFileInfo(sourcePath, sourceInfo)) return false;
+
+    std::string cachePath = meshCachePath(sourcePath);
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(cachePath)) return false;
+    if (file->size() < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMeshCacheMagic, 4) != 0) return false;
+    if (header.version != kMeshCacheVersion) return false;
+    if (header.vertexStride != kVertexStride) return false;
+    if (header.optimizeFlags != optimizeFlags) return false;
+    if (header.sourceSize != sourceInfo.size) return false;
+    if (sizeof(MeshCacheHeader) + (uint64_t)header.sectionCount * sizeof(MeshCacheSection) > file->size()) return false;
+
+    if (header.sourceMtime != sourceInfo.mtime) {
+        uint64_t hash;
+        if (!hashFile(sourcePath, hash) || hash != header.sourceHash) return false;
+
+        // Same content under a new timestamp (checkout, copy): keep the cache
+        FILE* out = fopen(cachePath.c_str(), "r+b");
+        if (out) {
+            fseek(out, (long)offsetof(MeshCacheHeader, sourceMtime), SEEK_SET);
+            fwrite(&sourceInfo.mtime, sizeof(sourceInfo.mtime), 1, out);
+            fclose(out);
+        }
+    }
+
+    const MeshCacheSection* submeshes = findSection(*file, header, MeshSectionSubmeshes);
+    const MeshCacheSection* vertices = findSection(*file, header, MeshSectionVertices);
+    const MeshCacheSection* indices = findSection(*file, header, MeshSectionIndices);
+    const MeshCacheSection* stats = findSection(*file, header, MeshSectionStats);
+    const MeshCacheSection* lods = findSection(*file, header, MeshSectionLods);
+    const MeshCacheSection* meshlets = findSection(*file, header, MeshSectionMeshlets);
+    const MeshCacheSection* materials = findSection(*file, header, MeshSectionMaterials);
+    const MeshCacheSection* packedVertices = findSection(*file, header, MeshSectionPackedVertices);
+    const MeshCacheSection* packing = findSection(*file, header, MeshSectionPacking);
+    if (!submeshes || !vertices || !indices || !stats || !lods || !meshlets || !materials || !packedVertices ||
+        !packing) {
+        return false;
+    }
+
+    for (const MeshCacheSection* s : { submeshes, vertices, indices, stats, lods, meshlets, materials,
+        packedVertices, packing }) {
+        if (s->offset > file->size() || s->size > file->size() - s->offset) return false;
+    }
+    uint64_t vertexBytes = (uint64_t)header.vertexCount * header.vertexStride * sizeof(float);
+    uint64_t packedBytes = (uint64_t)header.vertexCount * sizeof(PackedVertex);
+    if (!(vertices->flags & kMeshSectionCompressed) && vertices->size != vertexBytes) return false;
+    if (!(packedVertices->flags & kMeshSectionCompressed) && packedVertices->size != packedBytes) return false;
+    if (!(indices->flags & kMeshSectionCompressed)) return false;
+    if (stats->size != sizeof(MeshStats) || stats->flags != 0) return false;
+    if (packing->size != sizeof(MeshCachePacking) || packing->flags != 0) return false;
+
+    mesh.vertices.clear();
+    mesh.packing.vertices.clear();
+    mesh.indices.clear();
+    if (vertices->flags & kMeshSectionCompressed) {
+        if (vertexBytes > vertices->size * kMaxLzRatio) return false;
+        mesh.vertices.resize((size_t)header.vertexCount * header.vertexStride);
+        if (!decodeVertexBuffer(mesh.vertices.data(), header.vertexCount, header.vertexStride * sizeof(float),
+            file->data() + vertices->offset, (size_t)vertices->size)) {
+            return rejectCache(mesh);
+        }
+    }
+    if (packedVertices->flags & kMeshSectionCompressed) {
+        if (packedBytes > packedVertices->size * kMaxLzRatio) return rejectCache(mesh);
+        mesh.packing.vertices.resize(header.vertexCount);
+        if (!decodeVertexBuffer(mesh.packing.vertices.data(), header.vertexCount, sizeof(PackedVertex),
+            file->data() + packedVertices->offset, (size_t)packedVertices->size)) {
+            return rejectCache(mesh);
+        }
+    }
+
+    std::vector<unsigned char> indexStorage;
+    const unsigned char* indexData;
+    size_t indexSize;
+    if (!sectionPayload(*file, *indices, indexStorage, indexData, indexSize)) return rejectCache(mesh);
+    mesh.indices.resize(header.indexCount);
+    if (!decodeIndexBuffer(mesh.indices.data(), mesh.indices.size(), indexData, indexSize)) {
+        return rejectCache(mesh);
+    }
+    for (unsigned int index : mesh.indices) {
+        if (index >= header.vertexCount) return rejectCache(mesh);
+    }
+    if (!readTable(*file, *submeshes, mesh.submeshes) || !readTable(*file, *lods, mesh.lods) ||
+        !readTable(*file, *meshlets, mesh.meshlets) || !readTable(*file, *materials, mesh.materials)) {
+        return rejectCache(mesh);
+    }
+    if (mesh.lods.empty()) return rejectCache(mesh);
+    for (MeshMaterial& material : mesh.materials) {
+        material.name[sizeof(material.name) - 1] = '\0';
+        material.diffuseTexture[sizeof(material.diffuseTexture) - 1] = '\0';
+    }
+    for (const Submesh& submesh : mesh.submeshes) {
+        if ((uint64_t)submesh.indexOffset + submesh.indexCount > header.indexCount) return rejectCache(mesh);
+        if (submesh.materialId < -1 || submesh.materialId >= (int32_t)mesh.materials.size()) return rejectCache(mesh);
+        if ((uint64_t)submesh.meshletOffset + submesh.meshletCount > mesh.meshlets.size()) return rejectCache(mesh);
+        for (uint32_t m = 0; m < submesh.meshletCount; m++) {
+            const Meshlet& meshlet = mesh.meshlets[submesh.meshletOffset + m];
+            if ((uint64_t)meshlet.indexOffset + meshlet.triangleCount * 3ull > submesh.indexCount) return rejectCache(mesh);
+        }
+    }
+    for (const MeshLod& lod : mesh.lods) {
+        if ((uint64_t)lod.submeshOffset + lod.submeshCount > mesh.submeshes.size()) return rejectCache(mesh);
+    }
+    std::memcpy(mesh.boundsMin, header.boundsMin, sizeof(mesh.boundsMin));
+    std::memcpy(mesh.boundsMax, header.boundsMax, sizeof(mesh.boundsMax));
+    std::memcpy(&mesh.stats, file->data() + stats->offset, sizeof(MeshStats));
+    mesh.optimizeFlags = header.optimizeFlags;
+
+    MeshCachePacking storedPacking;
+    std::memcpy(&storedPacking, file->data() + packing->offset, sizeof(storedPacking));
+    std::memcpy(mesh.packing.positionOffset, storedPacking.positionOffset, sizeof(mesh.packing.positionOffset));
+    std::memcpy(mesh.packing.positionScale, storedPacking.positionScale, sizeof(mesh.packing.positionScale));
+    mesh.packing.halfTexcoords = storedPacking.halfTexcoords != 0;
+    mesh.packing.error = storedPacking.error;
+
+    // Raw vertex sections are used in place, and the mapping kept for them
+    mesh.sourceHash = header.sourceHash;
+    bool mapped = !(vertices->flags & kMeshSectionCompressed) || !(packedVertices->flags & kMeshSectionCompressed);
+    mesh.vertexData = mesh.vertices.empty() ? (const float*)(file->data() + vertices->offset) : mesh.vertices.data();
+    mesh.packedData = mesh.packing.vertices.empty() ?
+        (const PackedVertex*)(file->data() + packedVertices->offset) : mesh.packing.vertices.data();
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexData = mesh.indices.data();
+    mesh.indexCount = header.indexCount;
+    mesh.mapping = mapped ? file : nullptr;
+    return true;
+}
+
+bool writeMeshCache(const std::string& sourcePath, const MeshData& mesh, bool compress) {
+    FileInfo sourceInfo;
+    if (!getFileInfo(sourcePath, sourceInfo)) return false;
+
+    // The cache always holds a packed stream; a mesh built without one cannot be cached
+    if (!mesh.packedData && mesh.vertexCount > 0) return false;
+
+    std::vector<unsigned char> encodedIndices;
+    encodeIndexBuffer(encodedIndices, mesh.indexData, mesh.indexCount);
+
+    MeshCachePacking packing = {};
+    std::memcpy(packing.positionOffset, mesh.packing.positionOffset, sizeof(packing.positionOffset));
+    std::memcpy(packing.positionScale, mesh.packing.positionScale, sizeof(packing.positionScale));
+    packing.halfTexcoords = mesh.packing.halfTexcoords ? 1 : 0;
+    packing.error = mesh.packing.error;
+
+    struct Payload {
+        uint32_t type;
+        uint32_t flags;
+        const void* data;
+        uint64_t size;
+    };
+    Payload payloads[] = {
+        { MeshSectionSubmeshes, 0, mesh.submeshes.data(), mesh.submeshes.size() * sizeof(Submesh) },
+        { MeshSectionVertices, 0, mesh.vertexData, (uint64_t)mesh.vertexCount * kVertexStride * sizeof(float) },
+        { MeshSectionIndices, kMeshSectionCompressed, encodedIndices.data(), encodedIndices.size() },
+        { MeshSectionStats, 0, &mesh.stats, sizeof(MeshStats) },
+        { MeshSectionLods, 0, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod) },
+        { MeshSectionMeshlets, 0, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet) },
+        { MeshSectionMaterials, 0, mesh.materials.data(), mesh.materials.size() * sizeof(MeshMaterial) },
+        { MeshSectionPackedVertices, 0, mesh.packedData, (uint64_t)mesh.vertexCount * sizeof(PackedVertex) },
+        { MeshSectionPacking, 0, &packing, sizeof(MeshCachePacking) },
+    };
+
+    // Stats and packing stay raw: they are tiny and read with a plain copy
+    std::vector<std::vector<unsigned char>> compressed;
+    if (compress) {
+        compressed.reserve(sizeof(payloads) / sizeof(payloads[0]));
+        for (Payload& payload : payloads) {
+            if (payload.type == MeshSectionStats || payload.type == MeshSectionPacking) continue;
+            compressed.emplace_back();
+            if (payload.type == MeshSectionVertices) {
+                encodeVertexBuffer(compressed.back(), mesh.vertexData, mesh.vertexCount, kVertexStride * sizeof(float));
+                payload.flags |= kMeshSectionCompressed;
+            }
+            else if (payload.type == MeshSectionPackedVertices) {
+                encodeVertexBuffer(compressed.back(), mesh.packedData, mesh.vertexCount, sizeof(PackedVertex));
+                payload.flags |= kMeshSectionCompressed;
+            }
+            else {
+                compressLz(compressed.back(), (const unsigned char*)payload.data, (size_t)payload.size);
+                payload.flags |= kMeshSectionLz;
+            }
+            payload.data = compressed.back().data();
+            payload.size = compressed.back().size();
+        }
+    }
+    const uint32_t sectionCount = sizeof(payloads) / sizeof(payloads[0]);
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, kMeshCacheMagic, 4);
+    header.version = kMeshCacheVersion;
+    header.sourceSize = sourceInfo.size;
+    header.sourceMtime = sourceInfo.mtime;
+    header.sourceHash = mesh.sourceHash;
+    header.vertexStride = kVertexStride;
+    header.vertexCount = (uint32_t)mesh.vertexCount;
+    header.indexCount = (uint32_t)mesh.indexCount;
+    header.sectionCount = sectionCount;
+    header.optimizeFlags = mesh.optimizeFlags;
+    std::memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+
+    std::vector<MeshCacheSection> sections(sectionCount);
+    uint64_t offset = alignUp(sizeof(MeshCacheHeader) + sectionCount * sizeof(MeshCacheSection));
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        sections[i].type = payloads[i].type;
+        sections[i].flags = payloads[i].flags;
+        sections[i].offset = offset;
+        sections[i].size = payloads[i].size;
+        offset = alignUp(offset + payloads[i].size);
+    }
+
+    std::string cachePath = meshCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    FILE* out = fopen(tempPath.c_str(), "wb");
+    if (!out) return false;
+
+    static const char padding[kSectionAlignment] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(sections.data(), sizeof(MeshCacheSection), sectionCount, out) == sectionCount;
+    uint64_t written = sizeof(header) + sectionCount * sizeof(MeshCacheSection);
+    for (uint32_t i = 0; i < sectionCount && ok; i++) {
+        ok = fwrite(padding, 1, (size_t)(sections[i].offset - written), out) == sections[i].offset - written;
+        if (ok && payloads[i].size > 0) {
+            ok = fwrite(payloads[i].data, 1, (size_t)payloads[i].size, out) == payloads[i].size;
+        }
+        written = sections[i].offset + payloads[i].size;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || !replaceFile(tempPath, cachePath)) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
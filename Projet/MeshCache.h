@@ -0,0 +1,84 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "Mesh.h"
+
+// Binary mesh cache written next to the source OBJ (<source>.mcache).
+// The file is a header, a section table and 16-byte aligned payloads. The
+// vertices are stored twice, as floats and as PackedVertex with the
+// transform that restores them. A raw vertex section is used in place from
+// the mapping; a compressed one is decoded, like the index section.
+const char kMeshCacheMagic[4] = { 'P', 'M', 'S', 'H' };
+const uint32_t kMeshCacheVersion = 12;
+
+enum MeshCacheSectionType : uint32_t {
+    MeshSectionSubmeshes = 1,
+    MeshSectionVertices = 2,
+    MeshSectionIndices = 3,
+    MeshSectionStats = 4,
+    MeshSectionLods = 5,
+    MeshSectionMeshlets = 6,
+    MeshSectionMaterials = 7,
+    MeshSectionPackedVertices = 8,
+    MeshSectionPacking = 9,
+};
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    uint64_t sourceMtime;
+    uint64_t sourceHash;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t sectionCount;
+    uint32_t optimizeFlags;
+    uint32_t reserved;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// MeshSectionPacking: PackedMesh without its vertices
+struct MeshCachePacking {
+    float positionOffset[3];
+    float positionScale[3];
+    uint32_t halfTexcoords;
+    QuantizationError error;
+};
+
+// Section payload is encoded (indices: IndexCodec, vertices: VertexCodec)
+// rather than raw
+const uint32_t kMeshSectionCompressed = 1;
+// Payload, after any encoding above, went through compressLz
+const uint32_t kMeshSectionLz = 2;
+
+struct MeshCacheSection {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+};
+
+std::string meshCachePath(const std::string& sourcePath);
+
+// Maps the cache for sourcePath if it is still valid for the source file and
+// was built with optimizeFlags.
+// A changed mtime alone does not invalidate it: the source is re-hashed and
+// the cache is kept (with its mtime refreshed) when the content is the same.
+bool readMeshCache(const std::string& sourcePath, MeshData& mesh, uint32_t optimizeFlags);
+
+// Expects mesh.sourceHash to hold the hash of the source file. The cache is
+// raw by default so a hit uploads the vertices straight from the mapping.
+// compress stores the vertices with VertexCodec and runs the other tables
+// through compressLz, for a smaller file that is decoded on every load;
+// readMeshCache takes either form.
+bool writeMeshCache(const std::string& sourcePath, const MeshData& mesh, bool compress = false);
+
+// Whether loadModel writes compressed caches (off by default). Any thread.
+void setMeshCacheCompression(bool compress);
+bool meshCacheCompression();
+
+#endif
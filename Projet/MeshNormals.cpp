@@ -0,0 +1,318 @@
+#include "MeshNormals.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHNORMALS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Fewer items than this per thread are not worth spawning it
+const size_t kMinBatch = 4096;
+
+const float kPi = 3.14159265f;
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline Vec3 scale(const Vec3& v, float s) { return { v.x * s, v.y * s, v.z * s }; }
+inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+inline Vec3 normalize(const Vec3& v) {
+    float length = std::sqrt(dot(v, v));
+    return length > 0.0f ? Vec3{ v.x / length, v.y / length, v.z / length } : Vec3{ 0.0f, 0.0f, 0.0f };
+}
+
+inline Vec3 load(const float* v) { return { v[0], v[1], v[2] }; }
+
+// Abramowitz & Stegun 4.4.45, within 7e-5 radians; plenty for a weight
+inline float acosApprox(float x) {
+    x = std::max(-1.0f, std::min(1.0f, x));
+    float a = std::fabs(x);
+    float r = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+    return x < 0.0f ? kPi - r : r;
+}
+
+// 0 when either edge is degenerate
+inline float angleBetween(const Vec3& a, const Vec3& b) {
+    float lengths = std::sqrt(dot(a, a) * dot(b, b));
+    return lengths > 0.0f ? acosApprox(dot(a, b) / lengths) : 0.0f;
+}
+
+// Unit face normal of triangle t and the angle at each of its corners
+void faceGeometry(const float* vertices, const unsigned int* indices, size_t t, Vec3& normal, float angles[3]) {
+    Vec3 p0 = load(vertices + indices[t * 3 + 0] * kVertexStride);
+    Vec3 p1 = load(vertices + indices[t * 3 + 1] * kVertexStride);
+    Vec3 p2 = load(vertices + indices[t * 3 + 2] * kVertexStride);
+    Vec3 e01 = sub(p1, p0), e02 = sub(p2, p0), e12 = sub(p2, p1);
+    normal = normalize(cross(e01, e02));
+    angles[0] = angleBetween(e01, e02);
+    angles[1] = angleBetween(scale(e01, -1.0f), e12);
+    angles[2] = angleBetween(e02, e12);
+}
+
+#ifdef MESHNORMALS_SSE2
+
+// Four triangles at once, one per lane
+struct Vec3x4 {
+    __m128 x, y, z;
+};
+
+inline Vec3x4 sub4(const Vec3x4& a, const Vec3x4& b) {
+    return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+}
+
+inline __m128 dot4(const Vec3x4& a, const Vec3x4& b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+inline Vec3x4 cross4(const Vec3x4& a, const Vec3x4& b) {
+    return { _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+        _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+        _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+}
+
+inline Vec3x4 gather4(const float* vertices, const unsigned int* indices, size_t t, int corner) {
+    const float* p0 = vertices + indices[(t + 0) * 3 + corner] * kVertexStride;
+    const float* p1 = vertices + indices[(t + 1) * 3 + corner] * kVertexStride;
+    const float* p2 = vertices + indices[(t + 2) * 3 + corner] * kVertexStride;
+    const float* p3 = vertices + indices[(t + 3) * 3 + corner] * kVertexStride;
+    return { _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]), _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]),
+        _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]) };
+}
+
+inline __m128 acosApprox4(__m128 x) {
+    x = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(_mm_set1_ps(1.0f), x));
+    __m128 a = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    __m128 poly = _mm_add_ps(_mm_set1_ps(0.0742610f), _mm_mul_ps(a, _mm_set1_ps(-0.0187293f)));
+    poly = _mm_add_ps(_mm_set1_ps(-0.2121144f), _mm_mul_ps(a, poly));
+    poly = _mm_add_ps(_mm_set1_ps(1.5707288f), _mm_mul_ps(a, poly));
+    __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), poly);
+    __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(kPi), r)), _mm_andnot_ps(negative, r));
+}
+
+inline __m128 angleBetween4(const Vec3x4& a, const Vec3x4& b) {
+    __m128 lengths = _mm_sqrt_ps(_mm_mul_ps(dot4(a, a), dot4(b, b)));
+    __m128 valid = _mm_cmpgt_ps(lengths, _mm_setzero_ps());
+    __m128 cosine = _mm_div_ps(dot4(a, b), _mm_max_ps(lengths, _mm_set1_ps(FLT_MIN)));
+    return _mm_and_ps(valid, acosApprox4(cosine));
+}
+
+inline Vec3x4 normalize4(const Vec3x4& v) {
+    __m128 length = _mm_sqrt_ps(dot4(v, v));
+    __m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+    length = _mm_max_ps(length, _mm_set1_ps(FLT_MIN));
+    return { _mm_and_ps(valid, _mm_div_ps(v.x, length)), _mm_and_ps(valid, _mm_div_ps(v.y, length)),
+        _mm_and_ps(valid, _mm_div_ps(v.z, length)) };
+}
+
+#endif
+
+// Writes normal * corner angle for the corners of triangles [begin, end),
+// four floats per corner
+void weightedFaceNormals(const float* vertices, const unsigned int* indices, size_t begin, size_t end, float* out) {
+    size_t t = begin;
+#ifdef MESHNORMALS_SSE2
+    for (; t + 4 <= end; t += 4) {
+        Vec3x4 p0 = gather4(vertices, indices, t, 0);
+        Vec3x4 p1 = gather4(vertices, indices, t, 1);
+        Vec3x4 p2 = gather4(vertices, indices, t, 2);
+        Vec3x4 e01 = sub4(p1, p0), e02 = sub4(p2, p0), e12 = sub4(p2, p1), e10 = sub4(p0, p1);
+        Vec3x4 normal = normalize4(cross4(e01, e02));
+        __m128 angles[3] = { angleBetween4(e01, e02), angleBetween4(e10, e12), angleBetween4(e02, e12) };
+
+        for (int k = 0; k < 3; k++) {
+            // Rows become one corner each: x, y, z, 0
+            __m128 x = _mm_mul_ps(normal.x, angles[k]);
+            __m128 y = _mm_mul_ps(normal.y, angles[k]);
+            __m128 z = _mm_mul_ps(normal.z, angles[k]);
+            __m128 w = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(out + ((t + 0) * 3 + k) * 4, x);
+            _mm_storeu_ps(out + ((t + 1) * 3 + k) * 4, y);
+            _mm_storeu_ps(out + ((t + 2) * 3 + k) * 4, z);
+            _mm_storeu_ps(out + ((t + 3) * 3 + k) * 4, w);
+        }
+    }
+#endif
+    for (; t < end; t++) {
+        Vec3 normal;
+        float angles[3];
+        faceGeometry(vertices, indices, t, normal, angles);
+        for (int k = 0; k < 3; k++) {
+            float* corner = out + (t * 3 + k) * 4;
+            corner[0] = normal.x * angles[k];
+            corner[1] = normal.y * angles[k];
+            corner[2] = normal.z * angles[k];
+            corner[3] = 0.0f;
+        }
+    }
+}
+
+// Corners bucketed by group (counting sort), in index order within a
+// group so sums do not depend on the thread count. Corners whose group is
+// not below groupCount are left out.
+struct CornerGroups {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+
+    template <typename GroupOf>
+    void build(size_t cornerCount, size_t groupCount, GroupOf groupOf) {
+        offsets.assign(groupCount + 1, 0);
+        for (size_t c = 0; c < cornerCount; c++) {
+            uint32_t group = groupOf(c);
+            if (group < groupCount) offsets[group + 1]++;
+        }
+        for (size_t g = 0; g < groupCount; g++) offsets[g + 1] += offsets[g];
+        corners.resize(offsets[groupCount]);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t c = 0; c < cornerCount; c++) {
+            uint32_t group = groupOf(c);
+            if (group < groupCount) corners[cursor[group]++] = (uint32_t)c;
+        }
+    }
+};
+
+}  // namespace
+
+void tangentBasis(const float normal[3], float b1[3], float b2[3]) {
+    float sign = normal[2] >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + normal[2]);
+    float b = normal[0] * normal[1] * a;
+    b1[0] = 1.0f + sign * normal[0] * normal[0] * a;
+    b1[1] = sign * b;
+    b1[2] = -sign * normal[0];
+    b2[0] = b;
+    b2[1] = sign + normal[1] * normal[1] * a;
+    b2[2] = -normal[1];
+}
+
+void generateNormals(MeshData& mesh, const std::vector<uint32_t>& smoothKeys, size_t keyCount, unsigned threadCount) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    size_t triangleCount = mesh.indices.size() / 3;
+    if (keyCount == 0) return;
+
+    std::vector<float> corners(triangleCount * 3 * 4);
+    parallelFor(triangleCount, kMinBatch, threadCount, [&](size_t begin, size_t end) {
+        weightedFaceNormals(mesh.vertices.data(), mesh.indices.data(), begin, end, corners.data());
+    });
+
+    CornerGroups groups;
+    groups.build(triangleCount * 3, keyCount, [&](size_t c) { return smoothKeys[mesh.indices[c]]; });
+
+    std::vector<Vec3> keyNormals(keyCount);
+    parallelFor(keyCount, kMinBatch, threadCount, [&](size_t begin, size_t end) {
+        for (size_t key = begin; key < end; key++) {
+            Vec3 sum = { 0.0f, 0.0f, 0.0f };
+            for (uint32_t i = groups.offsets[key]; i < groups.offsets[key + 1]; i++) {
+                const float* corner = &corners[groups.corners[i] * 4];
+                sum = { sum.x + corner[0], sum.y + corner[1], sum.z + corner[2] };
+            }
+            // Only degenerate faces: any unit vector beats a zero one in the shader
+            Vec3 normal = normalize(sum);
+            keyNormals[key] = dot(normal, normal) > 0.0f ? normal : Vec3{ 0.0f, 0.0f, 1.0f };
+        }
+    });
+
+    parallelFor(vertexCount, kMinBatch, threadCount, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            if (smoothKeys[v] == kKeepNormal) continue;
+            const Vec3& normal = keyNormals[smoothKeys[v]];
+            float* out = &mesh.vertices[v * kVertexStride + kNormalOffset];
+            out[0] = normal.x;
+            out[1] = normal.y;
+            out[2] = normal.z;
+        }
+    });
+}
+
+void generateTangents(MeshData& mesh, unsigned threadCount) {
+    size_t vertexCount = mesh.vertices.size() / kVertexStride;
+    size_t triangleCount = mesh.indices.size() / 3;
+    const float* vertices = mesh.vertices.data();
+    const unsigned int* indices = mesh.indices.data();
+
+    // Per corner: the face tangent in the plane of the corner's normal,
+    // times the corner angle, and the signed angle as w
+    std::vector<float> corners(triangleCount * 3 * 4);
+    parallelFor(triangleCount, kMinBatch, threadCount, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            Vec3 faceNormal;
+            float angles[3];
+            faceGeometry(vertices, indices, t, faceNormal, angles);
+
+            const float* v0 = vertices + indices[t * 3 + 0] * kVertexStride;
+            const float* v1 = vertices + indices[t * 3 + 1] * kVertexStride;
+            const float* v2 = vertices + indices[t * 3 + 2] * kVertexStride;
+            Vec3 e01 = sub(load(v1), load(v0)), e02 = sub(load(v2), load(v0));
+            float du1 = v1[kTexcoordOffset] - v0[kTexcoordOffset], dv1 = v1[kTexcoordOffset + 1] - v0[kTexcoordOffset + 1];
+            float du2 = v2[kTexcoordOffset] - v0[kTexcoordOffset], dv2 = v2[kTexcoordOffset + 1] - v0[kTexcoordOffset + 1];
+            float signedArea = du1 * dv2 - du2 * dv1;
+
+            // Dividing by |area| keeps the direction; the sign goes to w
+            Vec3 faceTangent = normalize(sub(scale(e01, dv2), scale(e02, dv1)));
+            if (signedArea < 0.0f) faceTangent = scale(faceTangent, -1.0f);
+            float handedness = signedArea > 0.0f ? 1.0f : signedArea < 0.0f ? -1.0f : 0.0f;
+            if (dot(faceTangent, faceTangent) == 0.0f) handedness = 0.0f;
+
+            for (int k = 0; k < 3; k++) {
+                float* corner = &corners[(t * 3 + k) * 4];
+                Vec3 normal = load(vertices + indices[t * 3 + k] * kVertexStride + kNormalOffset);
+                Vec3 tangent = normalize(sub(faceTangent, scale(normal, dot(normal, faceTangent))));
+                float weight = handedness != 0.0f ? angles[k] : 0.0f;
+                corner[0] = tangent.x * weight;
+                corner[1] = tangent.y * weight;
+                corner[2] = tangent.z * weight;
+                corner[3] = handedness * weight;
+            }
+        }
+    });
+
+    CornerGroups groups;
+    groups.build(triangleCount * 3, vertexCount, [&](size_t c) { return indices[c]; });
+
+    parallelFor(vertexCount, kMinBatch, threadCount, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            float handedness = 0.0f;
+            for (uint32_t i = groups.offsets[v]; i < groups.offsets[v + 1]; i++) {
+                handedness += corners[groups.corners[i] * 4 + 3];
+            }
+            float sign = handedness < 0.0f ? -1.0f : 1.0f;
+
+            Vec3 sum = { 0.0f, 0.0f, 0.0f };
+            for (uint32_t i = groups.offsets[v]; i < groups.offsets[v + 1]; i++) {
+                const float* corner = &corners[groups.corners[i] * 4];
+                if (corner[3] * sign <= 0.0f) continue;
+                sum = { sum.x + corner[0], sum.y + corner[1], sum.z + corner[2] };
+            }
+
+            float* vertex = &mesh.vertices[v * kVertexStride];
+            Vec3 normal = normalize(load(vertex + kNormalOffset));
+            Vec3 tangent = normalize(sub(sum, scale(normal, dot(normal, sum))));
+            if (dot(tangent, tangent) == 0.0f) {
+                float n[3] = { normal.x, normal.y, normal.z }, b1[3], b2[3];
+                if (dot(normal, normal) == 0.0f) n[2] = 1.0f;
+                tangentBasis(n, b1, b2);
+                tangent = load(b1);
+                sign = 1.0f;
+            }
+            float* out = vertex + kTangentOffset;
+            out[0] = tangent.x;
+            out[1] = tangent.y;
+            out[2] = tangent.z;
+            out[3] = sign;
+        }
+    });
+}
@@ -0,0 +1,36 @@
+#ifndef MESHNORMALS_H
+#define MESHNORMALS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MeshData;
+
+// smoothKeys entry for a vertex whose normal came from the file
+const uint32_t kKeepNormal = ~0u;
+
+// Angle-weighted smooth normals for the owned vertices of mesh. Vertices
+// with the same key in smoothKeys (one per vertex, keys below keyCount)
+// share one normal, summed over the faces of all of them: a key stands for
+// a position within one smoothing group, so UV seams stay smooth and group
+// borders stay hard. Vertices with kKeepNormal are left as they are.
+// The passes are split by parallelFor into threadCount batches, 0 for one
+// per core or, on a ThreadPool worker, one per worker of its pool.
+void generateNormals(MeshData& mesh, const std::vector<uint32_t>& smoothKeys, size_t keyCount,
+    unsigned threadCount = 0);
+
+// Per-vertex tangents in the MikkTSpace convention: each face's texture
+// space tangent is projected onto the plane of every corner's normal,
+// weighted by the corner angle and summed per vertex, and w is the
+// bitangent sign, so bitangent = w * cross(normal, tangent). Vertices only
+// split by handedness in MikkTSpace keep the handedness of the larger
+// side. Vertices without usable texcoords get an arbitrary tangent
+// orthogonal to their normal. Runs after the normals are final.
+void generateTangents(MeshData& mesh, unsigned threadCount = 0);
+
+// Orthonormal basis around a unit normal (Duff et al. 2017); the vertex
+// shader builds the same one to decode packed tangents
+void tangentBasis(const float normal[3], float b1[3], float b2[3]);
+
+#endif
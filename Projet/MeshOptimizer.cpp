@@ -0,0 +1,446 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Forsyth's scoring parameters; the LRU is larger than any real FIFO so
+// the order also holds up on hardware with bigger caches
+const int kMaxCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+const int kMaxValence = 32;
+
+struct ScoreTables {
+    float cache[kMaxCacheSize];
+    float valence[kMaxValence + 1];
+
+    ScoreTables() {
+        for (int i = 0; i < kMaxCacheSize; i++) {
+            if (i < 3) {
+                // Vertices of the last triangle: reusing them right away gains little
+                cache[i] = kLastTriangleScore;
+            }
+            else {
+                float scaler = 1.0f / (kMaxCacheSize - 3);
+                cache[i] = std::pow(1.0f - (i - 3) * scaler, kCacheDecayPower);
+            }
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i <= kMaxValence; i++) {
+            valence[i] = kValenceBoostScale * std::pow((float)i, -kValenceBoostPower);
+        }
+    }
+};
+
+const ScoreTables& scoreTables() {
+    static const ScoreTables tables;
+    return tables;
+}
+
+inline float vertexScore(int cachePosition, unsigned int liveTriangles) {
+    if (liveTriangles == 0) return -1.0f;
+    const ScoreTables& tables = scoreTables();
+    float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    // Favor vertices with few remaining triangles so they get finished off
+    return score + tables.valence[std::min(liveTriangles, (unsigned int)kMaxValence)];
+}
+
+}  // namespace
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+    unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0) return stats;
+
+    // A vertex is still cached if fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    size_t time = cacheSize + 1;
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int v = indices[i];
+        if (time - loadedAt[v] > cacheSize) {
+            loadedAt[v] = time++;
+            misses++;
+        }
+    }
+
+    stats.acmr = (float)misses / (float)(indexCount / 3);
+    stats.atvr = (float)misses / (float)vertexCount;
+    return stats;
+}
+
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+
+    // Vertex -> triangle adjacency, packed
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) liveTriangles[indices[i]]++;
+
+    std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) scores[v] = vertexScore(-1, liveTriangles[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output(triangleCount * 3);
+    unsigned int cache[kMaxCacheSize + 3];
+    unsigned int nextCache[kMaxCacheSize + 3];
+    int cacheCount = 0;
+    size_t scanCursor = 0;
+
+    size_t best = 0;
+    for (size_t t = 1; t < triangleCount; t++) {
+        if (triangleScores[t] > triangleScores[best]) best = t;
+    }
+
+    for (size_t out = 0; out < triangleCount; out++) {
+        const unsigned int* tri = indices + best * 3;
+        output[out * 3 + 0] = tri[0];
+        output[out * 3 + 1] = tri[1];
+        output[out * 3 + 2] = tri[2];
+        emitted[best] = true;
+
+        // Move the triangle's vertices to the front of the LRU
+        int nextCount = 0;
+        for (int k = 0; k < 3; k++) nextCache[nextCount++] = tri[k];
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) nextCache[nextCount++] = v;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            unsigned int* begin = &adjacency[adjacencyStart[v]];
+            unsigned int* end = begin + liveTriangles[v];
+            *std::find(begin, end, (unsigned int)best) = end[-1];
+            liveTriangles[v]--;
+        }
+
+        // Rescore everything that was in the cache, including vertices that fell out
+        for (int i = 0; i < nextCount; i++) {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < kMaxCacheSize ? i : -1;
+            float score = vertexScore(cachePosition[v], liveTriangles[v]);
+            float delta = score - scores[v];
+            scores[v] = score;
+            const unsigned int* begin = &adjacency[adjacencyStart[v]];
+            for (unsigned int j = 0; j < liveTriangles[v]; j++) triangleScores[begin[j]] += delta;
+        }
+        cacheCount = std::min(nextCount, kMaxCacheSize);
+        for (int i = 0; i < cacheCount; i++) cache[i] = nextCache[i];
+
+        // Best triangle touching the cache; otherwise the next unused one in file order
+        float bestScore = -1.0f;
+        bool found = false;
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            const unsigned int* begin = &adjacency[adjacencyStart[v]];
+            for (unsigned int j = 0; j < liveTriangles[v]; j++) {
+                unsigned int t = begin[j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            while (scanCursor < triangleCount && emitted[scanCursor]) scanCursor++;
+            if (scanCursor == triangleCount) break;
+            best = scanCursor;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+namespace {
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline Vec3 operator+(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline Vec3 operator*(const Vec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+inline Vec3 normalize(const Vec3& v) {
+    float length = std::sqrt(dot(v, v));
+    return length > 0.0f ? v * (1.0f / length) : v;
+}
+
+inline Vec3 position(const float* positions, size_t stride, unsigned int index) {
+    const float* p = positions + index * stride;
+    return { p[0], p[1], p[2] };
+}
+
+struct DepthBuffer {
+    std::vector<float> depth;
+    uint64_t shaded = 0;
+};
+
+// Screen space x, y in pixels and view depth z (smaller is closer)
+void rasterize(DepthBuffer& buffer, Vec3 a, Vec3 b, Vec3 c) {
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0.0f) return;
+    if (area < 0.0f) {
+        // No culling: back faces are drawn too, just wound the other way
+        std::swap(b, c);
+        area = -area;
+    }
+
+    int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+    int maxX = std::min(kOverdrawResolution - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+    int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+    int maxY = std::min(kOverdrawResolution - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+    float inverseArea = 1.0f / area;
+
+    for (int y = minY; y <= maxY; y++) {
+        float py = y + 0.5f;
+        for (int x = minX; x <= maxX; x++) {
+            float px = x + 0.5f;
+            float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+            float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+            float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+            float z = (w0 * a.z + w1 * b.z + w2 * c.z) * inverseArea;
+            float& stored = buffer.depth[y * kOverdrawResolution + x];
+            if (z < stored) {
+                stored = z;
+                buffer.shaded++;
+            }
+        }
+    }
+}
+
+// FIFO cache misses for one triangle; advancing time by more than the
+// cache size empties the cache
+unsigned int cacheMisses(const unsigned int* triangle, std::vector<size_t>& loadedAt, size_t& time) {
+    unsigned int misses = 0;
+    for (int k = 0; k < 3; k++) {
+        unsigned int v = triangle[k];
+        if (time - loadedAt[v] > kVertexCacheSize) {
+            loadedAt[v] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+}  // namespace
+
+OverdrawStats analyzeOverdraw(const unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride) {
+    OverdrawStats stats;
+    if (indexCount < 3 || vertexCount == 0) return stats;
+
+    Vec3 boundsMin = position(positions, positionStride, 0), boundsMax = boundsMin;
+    for (size_t v = 1; v < vertexCount; v++) {
+        Vec3 p = position(positions, positionStride, (unsigned int)v);
+        boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+        boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+    }
+    Vec3 center = (boundsMin + boundsMax) * 0.5f;
+
+    DepthBuffer buffer;
+    uint64_t shaded = 0, covered = 0;
+    std::vector<Vec3> projected(vertexCount);
+
+    for (int view = 0; view < kOverdrawViews; view++) {
+        // Fibonacci sphere: evenly spread directions without favoring an axis
+        float z = 1.0f - (2.0f * view + 1.0f) / kOverdrawViews;
+        float r = std::sqrt(1.0f - z * z);
+        float angle = view * 2.39996323f;
+        Vec3 direction = { r * std::cos(angle), r * std::sin(angle), z };
+
+        // Right-handed screen basis so counter-clockwise stays front-facing
+        Vec3 up = std::fabs(direction.y) < 0.99f ? Vec3{ 0.0f, 1.0f, 0.0f } : Vec3{ 1.0f, 0.0f, 0.0f };
+        Vec3 back = direction * -1.0f;
+        Vec3 right = normalize(cross(up, back));
+        up = cross(back, right);
+
+        float minX = std::numeric_limits<float>::max(), maxX = -minX, minY = minX, maxY = -minX;
+        for (size_t v = 0; v < vertexCount; v++) {
+            Vec3 p = position(positions, positionStride, (unsigned int)v) - center;
+            projected[v] = { dot(p, right), dot(p, up), dot(p, direction) };
+            minX = std::min(minX, projected[v].x);
+            maxX = std::max(maxX, projected[v].x);
+            minY = std::min(minY, projected[v].y);
+            maxY = std::max(maxY, projected[v].y);
+        }
+
+        // Stretch each axis to the viewport so thin meshes still cover pixels
+        float scaleX = maxX > minX ? kOverdrawResolution / (maxX - minX) : 0.0f;
+        float scaleY = maxY > minY ? kOverdrawResolution / (maxY - minY) : 0.0f;
+        for (Vec3& p : projected) {
+            p.x = (p.x - minX) * scaleX;
+            p.y = (p.y - minY) * scaleY;
+        }
+
+        buffer.depth.assign(kOverdrawResolution * kOverdrawResolution, std::numeric_limits<float>::max());
+        buffer.shaded = 0;
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            rasterize(buffer, projected[indices[i]], projected[indices[i + 1]], projected[indices[i + 2]]);
+        }
+
+        shaded += buffer.shaded;
+        for (float depth : buffer.depth) covered += depth != std::numeric_limits<float>::max();
+    }
+
+    stats.overdraw = covered ? (float)((double)shaded / (double)covered) : 0.0f;
+    return stats;
+}
+
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, float threshold) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t time = kVertexCacheSize + 1;
+
+    // Hard boundaries: a triangle that misses on all three vertices starts
+    // a new region, so the cache order does not depend on what came before
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (cacheMisses(indices + t * 3, loadedAt, time) == 3) hard.push_back(t);
+    }
+    if (hard.empty() || hard[0] != 0) hard.insert(hard.begin(), 0);
+    hard.push_back(triangleCount);
+
+    // Soft boundaries: inside a region, cut as soon as the part so far is
+    // about as cache friendly as the whole region
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t begin = hard[h], end = hard[h + 1];
+
+        time += kVertexCacheSize + 1;
+        size_t regionMisses = 0;
+        for (size_t t = begin; t < end; t++) regionMisses += cacheMisses(indices + t * 3, loadedAt, time);
+        float regionThreshold = threshold * (float)regionMisses / (float)(end - begin);
+
+        time += kVertexCacheSize + 1;
+        size_t start = begin, misses = 0;
+        clusters.push_back(begin);
+        for (size_t t = begin; t < end; t++) {
+            misses += cacheMisses(indices + t * 3, loadedAt, time);
+            if (t + 1 < end && (float)misses / (float)(t - start + 1) <= regionThreshold) {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                time += kVertexCacheSize + 1;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+    size_t clusterCount = clusters.size() - 1;
+
+    // Area weighted centroid of the whole mesh
+    Vec3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+    float meshArea = 0.0f;
+    std::vector<Vec3> clusterCentroid(clusterCount, meshCentroid), clusterNormal(clusterCount, meshCentroid);
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            Vec3 a = position(positions, positionStride, indices[t * 3 + 0]);
+            Vec3 b = position(positions, positionStride, indices[t * 3 + 1]);
+            Vec3 d = position(positions, positionStride, indices[t * 3 + 2]);
+            Vec3 normal = cross(b - a, d - a);
+            float area = std::sqrt(dot(normal, normal));
+            Vec3 centroid = (a + b + d) * (1.0f / 3.0f);
+            clusterCentroid[c] = clusterCentroid[c] + centroid * area;
+            clusterNormal[c] = clusterNormal[c] + normal;
+            clusterArea[c] += area;
+        }
+        meshCentroid = meshCentroid + clusterCentroid[c];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea > 0.0f) meshCentroid = meshCentroid * (1.0f / meshArea);
+
+    // Clusters facing away from the middle are likely in front: draw them first
+    std::vector<float> keys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        Vec3 centroid = clusterArea[c] > 0.0f ? clusterCentroid[c] * (1.0f / clusterArea[c]) : meshCentroid;
+        keys[c] = dot(centroid - meshCentroid, normalize(clusterNormal[c]));
+    }
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (size_t c : order) {
+        output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+VertexFetchStats analyzeVertexFetch(const unsigned int* indices, size_t indexCount,
+    size_t vertexCount, size_t vertexStride) {
+    const size_t lineSize = 64;
+    VertexFetchStats stats;
+    if (indexCount == 0 || vertexCount == 0) return stats;
+
+    size_t vertexSize = vertexStride * sizeof(float);
+    size_t lineCount = (vertexCount * vertexSize + lineSize - 1) / lineSize;
+    std::vector<size_t> vertexLoadedAt(vertexCount, 0), lineLoadedAt(lineCount, 0);
+    size_t vertexTime = kVertexCacheSize + 1, lineTime = kFetchCacheLines + 1;
+    size_t bytesFetched = 0;
+
+    // Both caches are FIFO: a hit leaves an entry's load time alone
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int v = indices[i];
+        if (vertexTime - vertexLoadedAt[v] <= kVertexCacheSize) continue;
+        vertexLoadedAt[v] = vertexTime++;
+
+        size_t first = v * vertexSize / lineSize, last = ((v + 1) * vertexSize - 1) / lineSize;
+        for (size_t line = first; line <= last; line++) {
+            if (lineTime - lineLoadedAt[line] > kFetchCacheLines) {
+                lineLoadedAt[line] = lineTime++;
+                bytesFetched += lineSize;
+            }
+        }
+    }
+
+    stats.overfetch = (float)((double)bytesFetched / (double)(vertexCount * vertexSize));
+    return stats;
+}
+
+size_t optimizeVertexFetch(float* destination, unsigned int* indices, size_t indexCount,
+    const float* vertices, size_t vertexCount, size_t vertexStride) {
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertexCount, unused);
+    unsigned int next = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int& target = remap[indices[i]];
+        if (target == unused) {
+            std::copy_n(vertices + indices[i] * vertexStride, vertexStride, destination + next * vertexStride);
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    return next;
+}
@@ -0,0 +1,64 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Size of the simulated post-transform cache used for the statistics
+const unsigned int kVertexCacheSize = 16;
+
+struct VertexCacheStats {
+    float acmr = 0.0f;  // transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    float atvr = 0.0f;  // transformed vertices per vertex (1 is ideal)
+};
+
+// Pixels shaded per pixel covered, averaged over views around the mesh (1 is ideal)
+struct OverdrawStats {
+    float overdraw = 0.0f;
+};
+
+// Bytes read from memory per byte of vertex data (1 is ideal: every vertex
+// fetched once, no partially used cache lines)
+struct VertexFetchStats {
+    float overfetch = 0.0f;
+};
+
+// Replays the index buffer through a FIFO cache of cacheSize entries
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+    unsigned int cacheSize = kVertexCacheSize);
+
+// Reorders triangles in place for post-transform cache reuse using Tom
+// Forsyth's linear-speed algorithm. Indices refer to [0, vertexCount).
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Rasterizes the mesh in index order on the CPU from kOverdrawViews
+// directions spread over the sphere, with a depth test and no culling like
+// the renderer. positionStride is the distance between positions in floats.
+const int kOverdrawViews = 16;
+const int kOverdrawResolution = 256;
+
+OverdrawStats analyzeOverdraw(const unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride);
+
+// Splits a cache-optimized index buffer into clusters where the cache
+// order allows it, then draws outward-facing clusters first (Sander et al.).
+// A cluster is cut once its ACMR is within threshold of the buffer's, so
+// threshold trades cache efficiency for finer sorting.
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, float threshold = 1.05f);
+
+// Post-transform cache misses, as analyzeVertexCache counts them, replayed
+// against a FIFO of kFetchCacheLines 64-byte lines over the vertex buffer;
+// vertexStride is in floats
+const unsigned int kFetchCacheLines = 256;
+
+VertexFetchStats analyzeVertexFetch(const unsigned int* indices, size_t indexCount,
+    size_t vertexCount, size_t vertexStride);
+
+// Renumbers vertices in the order the index buffer first uses them and
+// writes them to destination in that order, dropping unused vertices.
+// Indices are rewritten in place; returns the new vertex count.
+size_t optimizeVertexFetch(float* destination, unsigned int* indices, size_t indexCount,
+    const float* vertices, size_t vertexCount, size_t vertexStride);
+
+#endif
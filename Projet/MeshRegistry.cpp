@@ -0,0 +1,385 @@
+#include "MeshRegistry.h"
+
+#include "VertexFormat.h"
+
+#include <gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+GpuMesh::~GpuMesh() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
+
+void GpuMesh::setDiffuseMap(const std::string& path, const TextureHandle& texture) {
+    for (GpuMaterial& material : materials) {
+        if (material.diffuseTexture == path) material.diffuseMap = texture;
+    }
+}
+
+// Packs each submesh as 16-bit indices relative to its lowest vertex when
+// its range allows it, 32-bit otherwise. 32-bit ranges go first so they
+// stay 4-byte aligned. Sets the draws and the buffer size; writeIndices
+// fills it.
+static void layoutIndexBuffer(GpuMesh& gpu, const MeshData& mesh)
+{
+    gpu.draws.clear();
+    gpu.draws.reserve(mesh.submeshes.size());
+    for (const Submesh& submesh : mesh.submeshes) {
+        const unsigned int* range = mesh.indexData + submesh.indexOffset;
+        unsigned int low = ~0u, high = 0;
+        for (uint32_t i = 0; i < submesh.indexCount; i++) {
+            low = std::min(low, range[i]);
+            high = std::max(high, range[i]);
+        }
+        bool fitsShort = submesh.indexCount > 0 && high - low < kMaxShortIndexSpan;
+        gpu.draws.push_back({ fitsShort ? (GLenum)GL_UNSIGNED_SHORT : (GLenum)GL_UNSIGNED_INT, 0,
+            (GLsizei)submesh.indexCount, fitsShort ? (GLint)low : 0, submesh.materialId,
+            submesh.meshletOffset, submesh.meshletCount });
+    }
+
+    size_t bytes = 0;
+    for (GLenum type : { (GLenum)GL_UNSIGNED_INT, (GLenum)GL_UNSIGNED_SHORT }) {
+        for (GpuDraw& draw : gpu.draws) {
+            if (draw.indexType != type) continue;
+            draw.indexByteOffset = bytes;
+            bytes += draw.indexCount * (type == GL_UNSIGNED_INT ? sizeof(unsigned int) : sizeof(uint16_t));
+        }
+    }
+    gpu.indexBytes = bytes;
+}
+
+// Writes bytes [begin, end) of the index buffer to out. Both must fall on
+// index boundaries, which any multiple of 4 does.
+static void writeIndices(const GpuMesh& gpu, const MeshData& mesh, size_t begin, size_t end, unsigned char* out)
+{
+    for (size_t d = 0; d < gpu.draws.size(); d++) {
+        const GpuDraw& draw = gpu.draws[d];
+        size_t indexSize = draw.indexType == GL_UNSIGNED_INT ? sizeof(unsigned int) : sizeof(uint16_t);
+        size_t first = std::max(begin, draw.indexByteOffset);
+        size_t last = std::min(end, draw.indexByteOffset + draw.indexCount * indexSize);
+        if (first >= last) continue;
+
+        const unsigned int* range = mesh.indexData + mesh.submeshes[d].indexOffset + (first - draw.indexByteOffset) / indexSize;
+        size_t count = (last - first) / indexSize;
+        if (draw.indexType == GL_UNSIGNED_INT) {
+            std::memcpy(out + (first - begin), range, count * sizeof(unsigned int));
+        }
+        else {
+            uint16_t* target = (uint16_t*)(out + (first - begin));
+            for (size_t i = 0; i < count; i++) target[i] = (uint16_t)(range[i] - draw.baseVertex);
+        }
+    }
+}
+
+// Buffers that keep their size are overwritten instead of reallocated
+static void uploadBuffer(GLenum target, size_t currentBytes, const void* data, size_t bytes)
+{
+    if (bytes == currentBytes && bytes > 0) glBufferSubData(target, 0, bytes, data);
+    else glBufferData(target, bytes, data, GL_STATIC_DRAW);
+}
+
+static void printPacking(const GpuMesh& gpu, const PackedMesh& packing)
+{
+    const QuantizationError& error = packing.error;
+    printf("Packed vertices: %s %zu -> %zu bytes, position error %.3g (%.4f%% of extent), normal error %.3f deg, "
+        "tangent error %.3f deg, %s uv error %.3g\n",
+        gpu.path.c_str(), kVertexStride * sizeof(float), sizeof(PackedVertex), error.position,
+        error.positionRelative * 100.0f, error.normalDegrees, error.tangentDegrees,
+        packing.halfTexcoords ? "half" : "unorm", error.texcoord);
+}
+
+// Creates the GL objects of gpu, or reuses them when gpu is already
+// uploaded, and sets up everything but the buffer contents: vertex layout,
+// draws, materials and LODs. A mesh without a packed stream uploads its
+// floats. Leaves the VAO bound.
+static void Setup(GpuMesh& gpu, const MeshData& mesh, bool packed)
+{
+    packed = packed && mesh.packedData;
+    if (!gpu.VAO) {
+        glGenVertexArrays(1, &gpu.VAO);
+        glGenBuffers(1, &gpu.VBO);
+        glGenBuffers(1, &gpu.EBO);
+    }
+
+    glBindVertexArray(gpu.VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.VBO);
+    if (packed) {
+        const PackedMesh& packing = mesh.packing;
+        const GLsizei stride = sizeof(PackedVertex);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+        glVertexAttribPointer(2, 2, packing.halfTexcoords ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT,
+            packing.halfTexcoords ? GL_FALSE : GL_TRUE, stride, (void*)offsetof(PackedVertex, texcoord));
+        // The raw code as a float; the vertex shader decodes it
+        glVertexAttribPointer(3, 1, GL_UNSIGNED_SHORT, GL_FALSE, stride, (void*)offsetof(PackedVertex, tangent));
+
+        gpu.dequantize = glm::mat4(1.0f);
+        for (int c = 0; c < 3; c++) {
+            gpu.dequantize[c][c] = packing.positionScale[c];
+            gpu.dequantize[3][c] = packing.positionOffset[c];
+        }
+        gpu.vertexSize = sizeof(PackedVertex);
+    }
+    else {
+        const GLsizei stride = kVertexStride * sizeof(float);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(kNormalOffset * sizeof(float)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(kTexcoordOffset * sizeof(float)));
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(kTangentOffset * sizeof(float)));
+
+        gpu.dequantize = glm::mat4(1.0f);
+        gpu.vertexSize = kVertexStride * sizeof(float);
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.EBO);
+    layoutIndexBuffer(gpu, mesh);
+
+    gpu.packed = packed;
+    gpu.sourceHash = mesh.sourceHash;
+    gpu.vertexCount = mesh.vertexCount;
+    gpu.indexCount = mesh.indexCount;
+    gpu.submeshes = mesh.submeshes;
+    gpu.meshlets = mesh.meshlets;
+
+    // A diffuse map carries the color itself; Kd only colors untextured materials.
+    // On a reload, maps already loaded for a path are kept.
+    std::vector<GpuMaterial> previous = std::move(gpu.materials);
+    gpu.materials.clear();
+    for (const MeshMaterial& source : mesh.materials) {
+        GpuMaterial material;
+        material.diffuseTexture = source.diffuseTexture;
+        for (const GpuMaterial& old : previous) {
+            if (!material.diffuseTexture.empty() && old.diffuseTexture == material.diffuseTexture) {
+                material.diffuseMap = old.diffuseMap;
+            }
+        }
+        if (material.diffuseTexture.empty()) material.diffuseColor = glm::make_vec3(source.diffuse);
+        material.specular = glm::make_vec3(source.specular);
+        material.shininess = std::max(source.shininess, 1.0f);
+        gpu.materials.push_back(material);
+    }
+
+    // Draws follow the submeshes one to one
+    gpu.lods.clear();
+    for (const MeshLod& lod : mesh.lods) {
+        gpu.lods.push_back({ lod.submeshOffset, lod.submeshCount, lod.error });
+    }
+    if (gpu.lods.empty()) {
+        gpu.lods.push_back({ 0, gpu.draws.size(), 0.0f });
+    }
+    for (int c = 0; c < 3; c++) {
+        gpu.boundsMin[c] = mesh.boundsMin[c];
+        gpu.boundsMax[c] = mesh.boundsMax[c];
+    }
+}
+
+// Setup and upload from the calling thread in one go
+static void uploadMesh(GpuMesh& gpu, const MeshData& mesh, bool packed)
+{
+    size_t currentVertexBytes = gpu.VAO ? gpu.vertexCount * gpu.vertexSize : 0;
+    size_t currentIndexBytes = gpu.VAO ? gpu.indexBytes : 0;
+    Setup(gpu, mesh, packed);
+
+    if (gpu.packed) {
+        uploadBuffer(GL_ARRAY_BUFFER, currentVertexBytes, mesh.packedData, mesh.vertexCount * sizeof(PackedVertex));
+        printPacking(gpu, mesh.packing);
+    }
+    else {
+        uploadBuffer(GL_ARRAY_BUFFER, currentVertexBytes, mesh.vertexData, mesh.vertexCount * kVertexStride * sizeof(float));
+    }
+
+    std::vector<unsigned char> indexBuffer(gpu.indexBytes);
+    writeIndices(gpu, mesh, 0, gpu.indexBytes, indexBuffer.data());
+    uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, currentIndexBytes, indexBuffer.data(), indexBuffer.size());
+
+    glBindVertexArray(0);
+}
+
+MeshUpload::MeshUpload(const MeshHandle& mesh, std::shared_ptr<const MeshData> data, bool packed)
+    : mesh_(mesh), data_(std::move(data)) {
+    Setup(*mesh_, *data_, packed);
+    glBindVertexArray(0);
+
+    // Storage only; step fills it
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh_->VBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, mesh_->vertexCount * mesh_->vertexSize, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh_->EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, mesh_->indexBytes, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool MeshUpload::step(StagingRing& ring) {
+    GpuMesh& gpu = *mesh_;
+    const MeshData& mesh = *data_;
+    // Reloaded before this upload finished: the buffers hold the newer file
+    if (gpu.sourceHash != mesh.sourceHash) return true;
+
+    // Indices are narrowed right into the ring
+    while (verticesDone_ < gpu.vertexCount) {
+        size_t count = std::min(kStagingChunk / gpu.vertexSize, gpu.vertexCount - verticesDone_);
+        size_t bytes = count * gpu.vertexSize;
+        size_t offset;
+        unsigned char* staging = ring.allocate(bytes, offset);
+        if (!staging) return false;
+
+        if (gpu.packed) std::memcpy(staging, mesh.packedData + verticesDone_, bytes);
+        else std::memcpy(staging, mesh.vertexData + verticesDone_ * kVertexStride, bytes);
+        ring.copyToBuffer(offset, bytes, gpu.VBO, verticesDone_ * gpu.vertexSize);
+        verticesDone_ += count;
+    }
+
+    while (indexBytesDone_ < gpu.indexBytes) {
+        size_t bytes = std::min(kStagingChunk, gpu.indexBytes - indexBytesDone_);
+        size_t offset;
+        unsigned char* staging = ring.allocate(bytes, offset);
+        if (!staging) return false;
+
+        writeIndices(gpu, mesh, indexBytesDone_, indexBytesDone_ + bytes, staging);
+        ring.copyToBuffer(offset, bytes, gpu.EBO, indexBytesDone_);
+        indexBytesDone_ += bytes;
+    }
+
+    if (!gpu.ready) {
+        if (gpu.packed) printPacking(gpu, mesh.packing);
+        gpu.ready = true;
+    }
+    return true;
+}
+
+size_t selectLod(const GpuMesh& mesh, float objectScale, float distance, float pixelScale, float maxPixels) {
+    if (distance <= 0.0f) return 0;
+    for (size_t level = mesh.lods.size(); level-- > 1;) {
+        if (mesh.lods[level].error * objectScale * pixelScale / distance <= maxPixels) return level;
+    }
+    return 0;
+}
+
+MeshHandle MeshRegistry::acquire(const std::string& path, TextureCache& textures) {
+    if (MeshHandle mesh = find(path)) return mesh;
+
+    MeshData data;
+    if (!loadModel(path, data)) return nullptr;
+    MeshHandle mesh = add(path, data);
+    if (!mesh->texturesRequested) {
+        mesh->texturesRequested = true;
+        for (const GpuMaterial& material : mesh->materials) {
+            if (!material.diffuseTexture.empty() && !material.diffuseMap) {
+                mesh->setDiffuseMap(material.diffuseTexture, textures.acquire(material.diffuseTexture));
+            }
+        }
+    }
+    return mesh;
+}
+
+MeshHandle MeshRegistry::find(const std::string& path) {
+    requests_++;
+    auto byPath = byPath_.find(canonicalPath(path));
+    if (byPath == byPath_.end()) return nullptr;
+    MeshHandle mesh = byPath->second.lock();
+    return mesh && mesh->ready ? mesh : nullptr;
+}
+
+MeshHandle MeshRegistry::add(const std::string& path, const MeshData& data) {
+    std::string key = canonicalPath(path);
+
+    // Same bytes under another path: alias it instead of uploading again
+    auto byHash = byHash_.find(data.sourceHash);
+    if (byHash != byHash_.end()) {
+        MeshHandle mesh = byHash->second.lock();
+        if (mesh && mesh->ready) {
+            byPath_[key] = mesh;
+            return mesh;
+        }
+    }
+
+    MeshHandle mesh = std::make_shared<GpuMesh>();
+    mesh->path = key;
+    uploadMesh(*mesh, data, packedVertices_);
+    loads_++;
+
+    byPath_[key] = mesh;
+    byHash_[data.sourceHash] = mesh;
+    return mesh;
+}
+
+MeshHandle MeshRegistry::addStreamed(const std::string& path, std::shared_ptr<const MeshData> data,
+    std::shared_ptr<MeshUpload>& upload) {
+    upload = nullptr;
+    std::string key = canonicalPath(path);
+    auto byHash = byHash_.find(data->sourceHash);
+    if (byHash != byHash_.end()) {
+        MeshHandle mesh = byHash->second.lock();
+        if (mesh && mesh->ready) {
+            byPath_[key] = mesh;
+            return mesh;
+        }
+    }
+
+    MeshHandle mesh = std::make_shared<GpuMesh>();
+    mesh->path = key;
+    mesh->ready = false;
+    upload = std::make_shared<MeshUpload>(mesh, data, packedVertices_);
+    loads_++;
+
+    byPath_[key] = mesh;
+    byHash_[data->sourceHash] = mesh;
+    return mesh;
+}
+
+MeshHandle MeshRegistry::reload(const std::string& path, const MeshData& data) {
+    std::string key = canonicalPath(path);
+    auto byPath = byPath_.find(key);
+    MeshHandle mesh = byPath != byPath_.end() ? byPath->second.lock() : nullptr;
+    if (!mesh || data.sourceHash == mesh->sourceHash) return mesh;
+
+    // Other paths that aliased these bytes still hold the old file; drop
+    // them so their next request loads it again. Objects placed from them
+    // already share the handle and follow the new data.
+    for (auto entry = byPath_.begin(); entry != byPath_.end();) {
+        if (entry->first != key && entry->second.lock() == mesh) entry = byPath_.erase(entry);
+        else ++entry;
+    }
+    byHash_.erase(mesh->sourceHash);
+
+    // A mesh still streaming in is uploaded whole now, and its MeshUpload
+    // stops at its next step
+    uploadMesh(*mesh, data, mesh->packed);
+    mesh->ready = true;
+    mesh->texturesRequested = false;
+    reloads_++;
+    byHash_[data.sourceHash] = mesh;
+    return mesh;
+}
+
+size_t MeshRegistry::liveCount() const {
+    size_t count = 0;
+    for (const auto& entry : byHash_) {
+        if (!entry.second.expired()) count++;
+    }
+    return count;
+}
+
+size_t MeshRegistry::gpuBytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : byHash_) {
+        if (MeshHandle mesh = entry.second.lock()) {
+            bytes += mesh->vertexCount * mesh->vertexSize + mesh->indexBytes;
+        }
+    }
+    return bytes;
+}
+
+void MeshRegistry::printStats() const {
+    printf("Mesh registry: %zu requests, %zu uploads, %zu reloads, %zu live meshes, %.2f MB on GPU\n",
+        requests_, loads_, reloads_, liveCount(), gpuBytes() / (1024.0 * 1024.0));
+}
@@ -0,0 +1,158 @@
+#ifndef MESHREGISTRY_H
+#define MESHREGISTRY_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mesh.h"
+#include "StagingRing.h"
+#include "TextureCache.h"
+#include "VertexFormat.h"
+
+// One glDrawElementsBaseVertex call: a submesh, or a 16-bit chunk of one,
+// with the meshlets that tile its index range
+struct GpuDraw {
+    GLenum indexType;
+    size_t indexByteOffset;
+    GLsizei indexCount;
+    GLint baseVertex;
+    int32_t materialId;
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+};
+
+// A level of detail as a run of draws, with its error in model units
+struct GpuLod {
+    size_t drawOffset;
+    size_t drawCount;
+    float error;
+};
+
+// Material as the frame loop binds it. The diffuse map is filled in once
+// its texture is loaded; materials using the same file share it.
+struct GpuMaterial {
+    glm::vec3 diffuseColor = glm::vec3(1.0f);  // multiplies the diffuse map
+    glm::vec3 specular = glm::vec3(0.0f);
+    float shininess = 1.0f;
+    std::string diffuseTexture;  // empty: no diffuse map
+    TextureHandle diffuseMap;
+};
+
+// One GPU upload of a mesh. The GL objects are released with the last
+// handle, so handles must not outlive the GL context.
+struct GpuMesh {
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+
+    std::string path;
+    uint64_t sourceHash = 0;
+    size_t vertexCount = 0;
+    size_t vertexSize = 0;
+    size_t indexCount = 0;
+    size_t indexBytes = 0;
+    std::vector<GpuDraw> draws;
+    std::vector<GpuLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<GpuMaterial> materials;  // GpuDraw::materialId indexes this, -1 is none
+    bool texturesRequested = false;
+    bool ready = true;  // false while a MeshUpload is still filling the buffers
+
+    // Packed meshes store positions relative to their bounds and normals
+    // octahedral-encoded; draw with model * dequantize and tell the shader
+    bool packed = false;
+    glm::mat4 dequantize = glm::mat4(1.0f);
+    std::vector<Submesh> submeshes;
+    float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+    float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+
+    // Hands a loaded texture to every material that uses path
+    void setDiffuseMap(const std::string& path, const TextureHandle& texture);
+
+    GpuMesh() = default;
+    GpuMesh(const GpuMesh&) = delete;
+    GpuMesh& operator=(const GpuMesh&) = delete;
+    ~GpuMesh();
+};
+
+using MeshHandle = std::shared_ptr<GpuMesh>;
+
+// Streamed upload of one mesh through a StagingRing. The constructor sets
+// the mesh up with empty buffers; step copies the vertices and narrows the
+// indices straight into the ring and copies them over, as much as the ring
+// takes this frame, so a large mesh arrives over several frames with no
+// copy in between. The mesh is ready once step returns true. GL thread only.
+class MeshUpload {
+public:
+    MeshUpload(const MeshHandle& mesh, std::shared_ptr<const MeshData> data, bool packed);
+
+    bool step(StagingRing& ring);
+
+private:
+    MeshHandle mesh_;
+    std::shared_ptr<const MeshData> data_;
+    size_t verticesDone_ = 0;
+    size_t indexBytesDone_ = 0;
+};
+
+// Largest error in pixels a level of detail may show on screen
+const float kLodPixelError = 1.0f;
+
+// Picks the coarsest level whose error, scaled by objectScale and seen from
+// distance (world units), projects to at most maxPixels. pixelScale is the
+// viewport height over 2 tan(fov / 2).
+size_t selectLod(const GpuMesh& mesh, float objectScale, float distance, float pixelScale,
+    float maxPixels = kLodPixelError);
+
+// Loads and uploads each mesh file once. Meshes are looked up by canonical
+// path first and by content hash second, so copies of the same file under
+// another name share the upload as well.
+class MeshRegistry {
+public:
+    // Loads and uploads on the calling thread, which must own the GL
+    // context, with the diffuse maps from textures
+    MeshHandle acquire(const std::string& path, TextureCache& textures);
+
+    // Split form of acquire for loaders that parse elsewhere: find returns a
+    // live mesh or null, add uploads a mesh parsed from path (GL thread only)
+    MeshHandle find(const std::string& path);
+    MeshHandle add(const std::string& path, const MeshData& data);
+
+    // Streamed form of add: registers the mesh at once and returns in upload
+    // the MeshUpload that fills it. find skips the mesh until it is ready.
+    // A mesh already uploaded with the same bytes is returned with no upload.
+    MeshHandle addStreamed(const std::string& path, std::shared_ptr<const MeshData> data,
+        std::shared_ptr<MeshUpload>& upload);
+
+    // Replaces the upload of a live mesh with data re-imported from its path,
+    // in place, so every handle sees the new mesh from the next draw on.
+    // Buffers of unchanged size are refilled with glBufferSubData. A mesh
+    // still streaming in gets the new data at once and its MeshUpload is
+    // abandoned. Returns null if path has no live mesh. GL thread only; call
+    // between frames.
+    MeshHandle reload(const std::string& path, const MeshData& data);
+
+    // Upload new meshes as their cached 16-byte PackedVertex stream instead
+    // of kVertexStride floats (default on)
+    void setPackedVertices(bool packed) { packedVertices_ = packed; }
+
+    // Meshes still referenced by at least one handle
+    size_t liveCount() const;
+    size_t gpuBytes() const;
+
+    void printStats() const;
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<GpuMesh>> byPath_;
+    std::unordered_map<uint64_t, std::weak_ptr<GpuMesh>> byHash_;
+    bool packedVertices_ = true;
+    size_t requests_ = 0;
+    size_t loads_ = 0;
+    size_t reloads_ = 0;
+};
+
+#endif
@@ -0,0 +1,441 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+enum VertexKind : unsigned char {
+    KindManifold,  // interior: may move anywhere
+    KindBorder,    // on one open edge loop: moves along it
+    KindSeam,      // one of two vertices at a position with a UV seam: moves along the seam
+    KindLocked,    // corners, non-manifold fans and vertices locked by the caller
+    KindCount
+};
+
+// Whether a vertex of the first kind may collapse onto one of the second
+const bool kCanCollapse[KindCount][KindCount] = {
+    { true, true, true, true },
+    { false, true, false, false },
+    { false, false, true, false },
+    { false, false, false, false },
+};
+
+// Edges between these kinds appear in both directions, so one is enough
+const bool kHasOpposite[KindCount][KindCount] = {
+    { true, true, true, true },
+    { true, false, true, false },
+    { true, true, true, true },
+    { true, false, true, false },
+};
+
+// Open edges pull harder than faces so outlines and seams keep their shape
+const float kBoundaryWeight = 10.0f;
+
+const unsigned int kInvalid = ~0u;
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// Sum of squared distances to weighted planes, as a symmetric 3x3 matrix,
+// a vector and a constant
+struct Quadric {
+    float a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+    float b0 = 0, b1 = 0, b2 = 0, c = 0;
+    float w = 0;
+
+    void addPlane(const Vec3& n, float d, float weight) {
+        a00 += weight * n.x * n.x;
+        a11 += weight * n.y * n.y;
+        a22 += weight * n.z * n.z;
+        a10 += weight * n.y * n.x;
+        a20 += weight * n.z * n.x;
+        a21 += weight * n.z * n.y;
+        b0 += weight * n.x * d;
+        b1 += weight * n.y * d;
+        b2 += weight * n.z * d;
+        c += weight * d * d;
+        w += weight;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a10 += q.a10; a20 += q.a20; a21 += q.a21;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        w += q.w;
+    }
+
+    // Weighted mean of squared plane distances at p
+    float error(const Vec3& p) const {
+        float rx = a00 * p.x + a10 * p.y + a20 * p.z;
+        float ry = a10 * p.x + a11 * p.y + a21 * p.z;
+        float rz = a20 * p.x + a21 * p.y + a22 * p.z;
+        float r = rx * p.x + ry * p.y + rz * p.z + 2.0f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return w > 0.0f ? std::fabs(r) / w : 0.0f;
+    }
+};
+
+// Triangles around each vertex, as the two other corners in winding order
+struct Adjacency {
+    struct Edge {
+        unsigned int next;
+        unsigned int prev;
+    };
+    std::vector<unsigned int> offsets;
+    std::vector<Edge> edges;
+
+    void build(const unsigned int* indices, size_t indexCount, size_t vertexCount) {
+        offsets.assign(vertexCount + 1, 0);
+        for (size_t i = 0; i < indexCount; i++) offsets[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+
+        edges.resize(indexCount);
+        std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            edges[cursor[a]++] = { b, c };
+            edges[cursor[b]++] = { c, a };
+            edges[cursor[c]++] = { a, b };
+        }
+    }
+
+    const Edge* begin(unsigned int v) const { return edges.data() + offsets[v]; }
+    const Edge* end(unsigned int v) const { return edges.data() + offsets[v + 1]; }
+
+    bool hasEdge(unsigned int a, unsigned int b) const {
+        for (const Edge* e = begin(a); e != end(a); e++) {
+            if (e->next == b) return true;
+        }
+        return false;
+    }
+};
+
+struct PositionHash {
+    const Vec3* positions;
+    size_t operator()(unsigned int v) const {
+        unsigned int bits[3];
+        std::memcpy(bits, &positions[v], sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual {
+    const Vec3* positions;
+    bool operator()(unsigned int a, unsigned int b) const {
+        return std::memcmp(&positions[a], &positions[b], sizeof(Vec3)) == 0;
+    }
+};
+
+// remap points every vertex at the first vertex with the same position;
+// wedge links the vertices of one position in a cycle
+void buildPositionRemap(std::vector<unsigned int>& remap, std::vector<unsigned int>& wedge,
+    const std::vector<Vec3>& positions) {
+    size_t vertexCount = positions.size();
+    std::unordered_map<unsigned int, unsigned int, PositionHash, PositionEqual> firstVertex(
+        vertexCount, PositionHash{ positions.data() }, PositionEqual{ positions.data() });
+
+    remap.resize(vertexCount);
+    wedge.resize(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        unsigned int r = firstVertex.emplace(v, v).first->second;
+        remap[v] = r;
+        wedge[v] = v;
+        if (r != v) {
+            wedge[v] = wedge[r];
+            wedge[r] = v;
+        }
+    }
+}
+
+// loop and loopback hold the open edge leaving and entering each vertex
+// (the vertex itself when there is more than one)
+void classifyVertices(std::vector<unsigned char>& kind, std::vector<unsigned int>& loop,
+    std::vector<unsigned int>& loopback, const Adjacency& adjacency, const std::vector<unsigned int>& remap,
+    const std::vector<unsigned int>& wedge, const unsigned char* lockedVertices) {
+    size_t vertexCount = remap.size();
+    loop.assign(vertexCount, kInvalid);
+    loopback.assign(vertexCount, kInvalid);
+
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        for (const Adjacency::Edge* e = adjacency.begin(v); e != adjacency.end(v); e++) {
+            unsigned int target = e->next;
+            if (target == v) {
+                loop[v] = loopback[v] = v;
+            }
+            else if (!adjacency.hasEdge(target, v)) {
+                loopback[target] = loopback[target] == kInvalid ? v : target;
+                loop[v] = loop[v] == kInvalid ? target : v;
+            }
+        }
+    }
+
+    auto isOpenEnd = [](unsigned int end, unsigned int v) { return end != kInvalid && end != v; };
+
+    kind.assign(vertexCount, KindLocked);
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        if (remap[v] != v) continue;
+
+        if (wedge[v] == v) {
+            if (loop[v] == kInvalid && loopback[v] == kInvalid) {
+                kind[v] = KindManifold;
+            }
+            else if (isOpenEnd(loop[v], v) && isOpenEnd(loopback[v], v)) {
+                kind[v] = KindBorder;
+            }
+        }
+        else if (wedge[wedge[v]] == v) {
+            // Both sides of the seam must run along the same pair of positions
+            unsigned int w = wedge[v];
+            if (isOpenEnd(loop[v], v) && isOpenEnd(loopback[v], v) && isOpenEnd(loop[w], w) && isOpenEnd(loopback[w], w) &&
+                remap[loopback[v]] == remap[loop[w]] && remap[loop[v]] == remap[loopback[w]]) {
+                kind[v] = KindSeam;
+            }
+        }
+    }
+
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        if (lockedVertices && lockedVertices[v]) kind[remap[v]] = KindLocked;
+    }
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        kind[v] = kind[remap[v]];
+    }
+}
+
+void fillQuadrics(std::vector<Quadric>& quadrics, const unsigned int* indices, size_t indexCount,
+    const std::vector<Vec3>& positions, const std::vector<unsigned int>& remap, const Adjacency& adjacency) {
+    quadrics.assign(positions.size(), Quadric());
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        unsigned int corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        const Vec3& p0 = positions[corners[0]];
+        Vec3 normal = cross(sub(positions[corners[1]], p0), sub(positions[corners[2]], p0));
+        float length = std::sqrt(dot(normal, normal));
+        if (length == 0.0f) continue;
+        normal = { normal.x / length, normal.y / length, normal.z / length };
+
+        Quadric face;
+        face.addPlane(normal, -dot(normal, p0), length * 0.5f);
+        for (unsigned int v : corners) quadrics[remap[v]].add(face);
+
+        // Open edges (borders, seams, submesh boundaries) get a plane through
+        // the edge, perpendicular to the triangle
+        for (int k = 0; k < 3; k++) {
+            unsigned int i0 = corners[k], i1 = corners[(k + 1) % 3];
+            if (adjacency.hasEdge(i1, i0)) continue;
+
+            Vec3 edge = sub(positions[i1], positions[i0]);
+            Vec3 side = cross(edge, normal);
+            float sideLength = std::sqrt(dot(side, side));
+            if (sideLength == 0.0f) continue;
+            side = { side.x / sideLength, side.y / sideLength, side.z / sideLength };
+
+            Quadric boundary;
+            boundary.addPlane(side, -dot(side, positions[i0]), dot(edge, edge) * kBoundaryWeight);
+            quadrics[remap[i0]].add(boundary);
+            quadrics[remap[i1]].add(boundary);
+        }
+    }
+}
+
+struct Collapse {
+    unsigned int v0;
+    unsigned int v1;
+    bool bidirectional;
+    float error;
+};
+
+void pickCollapses(std::vector<Collapse>& collapses, const unsigned int* indices, size_t indexCount,
+    const std::vector<unsigned char>& kind, const std::vector<unsigned int>& remap, const std::vector<unsigned int>& loop) {
+    collapses.clear();
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int i0 = indices[i + k], i1 = indices[i + (k + 1) % 3];
+            unsigned char k0 = kind[i0], k1 = kind[i1];
+            if (!kCanCollapse[k0][k1] && !kCanCollapse[k1][k0]) continue;
+            if (kHasOpposite[k0][k1] && remap[i1] > remap[i0]) continue;
+
+            // Border and seam vertices only slide along their own loop
+            if (k0 == k1 && (k0 == KindBorder || k0 == KindSeam) && loop[i0] != i1) continue;
+
+            if (kCanCollapse[k0][k1]) {
+                collapses.push_back({ i0, i1, kCanCollapse[k1][k0], 0.0f });
+            }
+            else {
+                collapses.push_back({ i1, i0, false, 0.0f });
+            }
+        }
+    }
+}
+
+// Whether moving v0 (and its wedges) onto v1 turns a surviving triangle
+// by more than about 75 degrees
+bool hasTriangleFlips(const Adjacency& adjacency, const std::vector<Vec3>& positions,
+    const std::vector<unsigned int>& remap, const std::vector<unsigned int>& wedge,
+    const std::vector<unsigned int>& collapseRemap, unsigned int v0, unsigned int v1) {
+    const Vec3& from = positions[v0];
+    const Vec3& to = positions[v1];
+
+    unsigned int v = v0;
+    do {
+        for (const Adjacency::Edge* e = adjacency.begin(v); e != adjacency.end(v); e++) {
+            unsigned int a = collapseRemap[e->next], b = collapseRemap[e->prev];
+            if (remap[a] == remap[v1] || remap[b] == remap[v1]) continue;
+
+            Vec3 before = cross(sub(positions[a], from), sub(positions[b], from));
+            Vec3 after = cross(sub(positions[a], to), sub(positions[b], to));
+            if (dot(before, after) <= 0.25f * std::sqrt(dot(before, before) * dot(after, after))) return true;
+        }
+        v = wedge[v];
+    } while (v != v0);
+    return false;
+}
+
+void remapLoops(std::vector<unsigned int>& loop, const std::vector<unsigned int>& collapseRemap) {
+    for (unsigned int v = 0; v < loop.size(); v++) {
+        if (loop[v] == kInvalid) continue;
+        unsigned int l = loop[v];
+        unsigned int r = collapseRemap[l];
+        // The edge leaving v was collapsed onto v itself: skip to the next one
+        loop[v] = (v == r) ? loop[l] : r;
+    }
+}
+
+}  // namespace
+
+size_t simplifyMesh(unsigned int* destination, const unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride,
+    size_t targetIndexCount, float targetError,
+    const unsigned char* lockedVertices, float* resultError) {
+    indexCount -= indexCount % 3;
+    if (destination != indices) std::copy_n(indices, indexCount, destination);
+    if (resultError) *resultError = 0.0f;
+    if (indexCount <= targetIndexCount || vertexCount == 0) return indexCount;
+
+    // Work in a unit cube so the quadrics keep their precision on any scale
+    float boundsMin[3], boundsMax[3];
+    for (int c = 0; c < 3; c++) boundsMin[c] = boundsMax[c] = positions[c];
+    for (size_t v = 0; v < vertexCount; v++) {
+        for (int c = 0; c < 3; c++) {
+            boundsMin[c] = std::min(boundsMin[c], positions[v * positionStride + c]);
+            boundsMax[c] = std::max(boundsMax[c], positions[v * positionStride + c]);
+        }
+    }
+    float extent = std::max(boundsMax[0] - boundsMin[0], std::max(boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]));
+    float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+
+    std::vector<Vec3> unit(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        const float* p = positions + v * positionStride;
+        unit[v] = { (p[0] - boundsMin[0]) * scale, (p[1] - boundsMin[1]) * scale, (p[2] - boundsMin[2]) * scale };
+    }
+
+    std::vector<unsigned int> remap, wedge;
+    buildPositionRemap(remap, wedge, unit);
+
+    Adjacency adjacency;
+    adjacency.build(destination, indexCount, vertexCount);
+
+    std::vector<unsigned char> kind;
+    std::vector<unsigned int> loop, loopback;
+    classifyVertices(kind, loop, loopback, adjacency, remap, wedge, lockedVertices);
+
+    std::vector<Quadric> quadrics;
+    fillQuadrics(quadrics, destination, indexCount, unit, remap, adjacency);
+
+    float errorLimit = targetError * scale * targetError * scale;
+    float worstError = 0.0f;
+
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> order;
+    std::vector<unsigned int> collapseRemap(vertexCount);
+    std::vector<unsigned char> collapseLocked(vertexCount);
+
+    size_t resultCount = indexCount;
+    while (resultCount > targetIndexCount) {
+        adjacency.build(destination, resultCount, vertexCount);
+
+        pickCollapses(collapses, destination, resultCount, kind, remap, loop);
+        if (collapses.empty()) break;
+
+        for (Collapse& collapse : collapses) {
+            collapse.error = quadrics[remap[collapse.v0]].error(unit[collapse.v1]);
+            if (collapse.bidirectional) {
+                float reverse = quadrics[remap[collapse.v1]].error(unit[collapse.v0]);
+                if (reverse < collapse.error) {
+                    std::swap(collapse.v0, collapse.v1);
+                    collapse.error = reverse;
+                }
+            }
+        }
+
+        order.resize(collapses.size());
+        for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&collapses](unsigned int a, unsigned int b) {
+            return collapses[a].error < collapses[b].error;
+        });
+
+        // Every vertex moves at most once per pass, so the cheapest
+        // collapses spread over the whole mesh
+        for (unsigned int v = 0; v < vertexCount; v++) collapseRemap[v] = v;
+        std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+
+        size_t triangleGoal = std::max<size_t>((resultCount - targetIndexCount) / 3, 1);
+        size_t trianglesRemoved = 0;
+        size_t collapsed = 0;
+        for (unsigned int i : order) {
+            const Collapse& collapse = collapses[i];
+            if (collapse.error > errorLimit) break;
+
+            unsigned int v0 = collapse.v0, v1 = collapse.v1;
+            unsigned int r0 = remap[v0], r1 = remap[v1];
+            if (collapseLocked[r0] || collapseLocked[r1]) continue;
+            if (hasTriangleFlips(adjacency, unit, remap, wedge, collapseRemap, v0, v1)) continue;
+
+            if (kind[v0] == KindSeam) {
+                // The other side of the seam follows along its own edge
+                unsigned int s0 = wedge[v0];
+                unsigned int s1 = loop[v0] == v1 ? loopback[s0] : loop[s0];
+                if (s1 == kInvalid || remap[s1] != r1) continue;
+                collapseRemap[s0] = s1;
+            }
+            collapseRemap[v0] = v1;
+            collapseLocked[r0] = collapseLocked[r1] = 1;
+            quadrics[r1].add(quadrics[r0]);
+
+            worstError = std::max(worstError, collapse.error);
+            trianglesRemoved += kind[v0] == KindBorder ? 1 : 2;
+            collapsed++;
+            if (trianglesRemoved >= triangleGoal) break;
+        }
+        if (collapsed == 0) break;
+
+        size_t write = 0;
+        for (size_t t = 0; t < resultCount; t += 3) {
+            unsigned int a = collapseRemap[destination[t]];
+            unsigned int b = collapseRemap[destination[t + 1]];
+            unsigned int c = collapseRemap[destination[t + 2]];
+            if (a == b || b == c || a == c) continue;
+            destination[write++] = a;
+            destination[write++] = b;
+            destination[write++] = c;
+        }
+        resultCount = write;
+
+        remapLoops(loop, collapseRemap);
+        remapLoops(loopback, collapseRemap);
+    }
+
+    if (resultError) *resultError = std::sqrt(worstError) * extent;
+    return resultCount;
+}
@@ -0,0 +1,25 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+
+// Collapses edges in order of quadric error (Garland & Heckbert) until the
+// index count reaches targetIndexCount or the next collapse would exceed
+// targetError. The vertex buffer is kept: the result only references a
+// subset of it.
+//
+// Vertices that share a position but not their attributes form a UV seam;
+// seam and open border vertices only move along the seam or border, so
+// texture coordinates and outlines stay intact. Vertices flagged in
+// lockedVertices (optional, one byte per vertex) never move; use it for
+// vertices shared with other submeshes.
+//
+// positionStride is the distance between positions in floats. targetError
+// and resultError (optional) are distances in position units. Returns the
+// new index count; destination needs room for indexCount indices.
+size_t simplifyMesh(unsigned int* destination, const unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride,
+    size_t targetIndexCount, float targetError,
+    const unsigned char* lockedVertices = nullptr, float* resultError = nullptr);
+
+#endif
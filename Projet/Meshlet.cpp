@@ -0,0 +1,220 @@
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// How much a candidate's normal turning away from the cluster's adds to its
+// distance; keeps the cones narrow enough to cull
+const float kConeWeight = 2.0f;
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+inline Vec3 normalize(const Vec3& v) {
+    float length = std::sqrt(dot(v, v));
+    return length > 0.0f ? Vec3{ v.x / length, v.y / length, v.z / length } : Vec3{ 0.0f, 0.0f, 0.0f };
+}
+
+inline Vec3 position(const float* positions, size_t stride, unsigned int v) {
+    const float* p = positions + v * stride;
+    return { p[0], p[1], p[2] };
+}
+
+// Sphere around the cluster's vertices, centered on their bounding box
+void computeSphere(Meshlet& meshlet, const unsigned int* indices, const float* positions, size_t stride) {
+    Vec3 lo = position(positions, stride, indices[0]);
+    Vec3 hi = lo;
+    for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++) {
+        Vec3 p = position(positions, stride, indices[i]);
+        lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+        hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+    }
+    Vec3 center = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++) {
+        Vec3 d = sub(position(positions, stride, indices[i]), center);
+        radius = std::max(radius, dot(d, d));
+    }
+    meshlet.center[0] = center.x;
+    meshlet.center[1] = center.y;
+    meshlet.center[2] = center.z;
+    meshlet.radius = std::sqrt(radius);
+}
+
+// Normal cone with its apex pulled back so every triangle plane lies in
+// front of it (the test in Meshlet then holds for any camera position)
+void computeCone(Meshlet& meshlet, const unsigned int* indices, const float* positions, size_t stride) {
+    meshlet.coneCutoff = kMeshletNoCone;
+    std::copy_n(meshlet.center, 3, meshlet.coneApex);
+    meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+
+    Vec3 sum = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+        Vec3 p0 = position(positions, stride, indices[t * 3 + 0]);
+        Vec3 n = cross(sub(position(positions, stride, indices[t * 3 + 1]), p0), sub(position(positions, stride, indices[t * 3 + 2]), p0));
+        sum = { sum.x + n.x, sum.y + n.y, sum.z + n.z };
+    }
+    Vec3 axis = normalize(sum);
+    if (dot(axis, axis) == 0.0f) return;
+
+    Vec3 center = { meshlet.center[0], meshlet.center[1], meshlet.center[2] };
+    float minDot = 1.0f;
+    float maxT = 0.0f;
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+        Vec3 p0 = position(positions, stride, indices[t * 3 + 0]);
+        Vec3 n = normalize(cross(sub(position(positions, stride, indices[t * 3 + 1]), p0), sub(position(positions, stride, indices[t * 3 + 2]), p0)));
+        if (dot(n, n) == 0.0f) continue;
+
+        float d = dot(axis, n);
+        minDot = std::min(minDot, d);
+        if (d > 0.0f) maxT = std::max(maxT, dot(sub(center, p0), n) / d);
+    }
+
+    // Past about 84 degrees the cone almost never culls
+    if (minDot <= 0.1f) return;
+
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    meshlet.coneApex[0] = center.x - axis.x * maxT;
+    meshlet.coneApex[1] = center.y - axis.y * maxT;
+    meshlet.coneApex[2] = center.z - axis.z * maxT;
+}
+
+}  // namespace
+
+size_t buildMeshlets(std::vector<Meshlet>& meshlets, unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride, bool cones) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return 0;
+
+    // Triangles around each vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) vertexTriangles[cursor[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<Vec3> centroids(triangleCount);
+    std::vector<Vec3> normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        Vec3 a = position(positions, positionStride, indices[t * 3 + 0]);
+        Vec3 b = position(positions, positionStride, indices[t * 3 + 1]);
+        Vec3 c = position(positions, positionStride, indices[t * 3 + 2]);
+        centroids[t] = { (a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f };
+        normals[t] = normalize(cross(sub(b, a), sub(c, a)));
+    }
+
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> localId(vertexCount, unused);  // slot in the open cluster
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> clusterVertices;
+    std::vector<unsigned int> clusterIndices;
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+
+    size_t firstMeshlet = meshlets.size();
+    size_t seed = 0;
+    while (result.size() < triangleCount * 3) {
+        while (emitted[seed]) seed++;
+
+        clusterVertices.clear();
+        clusterIndices.clear();
+        Vec3 centroidSum = { 0.0f, 0.0f, 0.0f };
+        Vec3 normalSum = { 0.0f, 0.0f, 0.0f };
+        size_t next = seed;
+
+        while (next != unused) {
+            emitted[next] = 1;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[next * 3 + k];
+                if (localId[v] == unused) {
+                    localId[v] = (unsigned int)clusterVertices.size();
+                    clusterVertices.push_back(v);
+                }
+                clusterIndices.push_back(localId[v]);
+            }
+            centroidSum = { centroidSum.x + centroids[next].x, centroidSum.y + centroids[next].y, centroidSum.z + centroids[next].z };
+            normalSum = { normalSum.x + normals[next].x, normalSum.y + normals[next].y, normalSum.z + normals[next].z };
+            if (clusterIndices.size() / 3 == kMeshletMaxTriangles) break;
+
+            // Grow across the cluster's vertices: fewest new vertices first,
+            // then closest to the cluster with a similar facing
+            float count = (float)(clusterIndices.size() / 3);
+            Vec3 centroid = { centroidSum.x / count, centroidSum.y / count, centroidSum.z / count };
+            Vec3 normal = normalize(normalSum);
+            next = unused;
+            unsigned int bestExtra = 3;
+            float bestCost = std::numeric_limits<float>::max();
+            for (unsigned int v : clusterVertices) {
+                for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++) {
+                    unsigned int t = vertexTriangles[i];
+                    if (emitted[t]) continue;
+
+                    unsigned int extra = 0;
+                    for (int k = 0; k < 3; k++) extra += localId[indices[t * 3 + k]] == unused;
+                    if (clusterVertices.size() + extra > kMeshletMaxVertices || extra > bestExtra) continue;
+
+                    Vec3 d = sub(centroids[t], centroid);
+                    float cost = std::sqrt(dot(d, d)) * (1.0f + kConeWeight * (1.0f - dot(normals[t], normal)));
+                    if (extra < bestExtra || cost < bestCost) {
+                        next = t;
+                        bestExtra = extra;
+                        bestCost = cost;
+                    }
+                }
+            }
+
+            // Disconnected pieces: keep filling from the original order
+            if (next == unused) {
+                size_t t = seed;
+                while (t < triangleCount && emitted[t]) t++;
+                if (t < triangleCount) {
+                    unsigned int extra = 0;
+                    for (int k = 0; k < 3; k++) extra += localId[indices[t * 3 + k]] == unused;
+                    if (clusterVertices.size() + extra <= kMeshletMaxVertices) next = (unsigned int)t;
+                }
+            }
+        }
+
+        // Cache order inside the cluster, on its local ids
+        optimizeVertexCache(clusterIndices.data(), clusterIndices.size(), clusterVertices.size());
+
+        Meshlet meshlet = {};
+        meshlet.indexOffset = (uint32_t)result.size();
+        meshlet.triangleCount = (uint32_t)(clusterIndices.size() / 3);
+        for (unsigned int id : clusterIndices) result.push_back(clusterVertices[id]);
+        for (unsigned int v : clusterVertices) localId[v] = unused;
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+    for (size_t m = firstMeshlet; m < meshlets.size(); m++) {
+        Meshlet& meshlet = meshlets[m];
+        const unsigned int* range = indices + meshlet.indexOffset;
+        computeSphere(meshlet, range, positions, positionStride);
+        if (cones) {
+            computeCone(meshlet, range, positions, positionStride);
+        }
+        else {
+            meshlet.coneCutoff = kMeshletNoCone;
+            std::copy_n(meshlet.center, 3, meshlet.coneApex);
+        }
+    }
+    return meshlets.size() - firstMeshlet;
+}
@@ -0,0 +1,38 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Cluster limits, sized for mesh shader hardware so the clusters can move
+// there later
+const unsigned int kMeshletMaxVertices = 64;
+const unsigned int kMeshletMaxTriangles = 124;
+
+// Cone cutoff of a cluster that can always face the camera
+const float kMeshletNoCone = 2.0f;
+
+// A run of triangles drawn together, with what is needed to cull it: the
+// bounding sphere, and a cone holding every triangle normal. The cluster
+// faces away from a camera at eye when
+// dot(normalize(coneApex - eye), coneAxis) >= coneCutoff.
+struct Meshlet {
+    uint32_t indexOffset;  // relative to the start of its submesh
+    uint32_t triangleCount;
+    float center[3];
+    float radius;
+    float coneApex[3];
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+// Regroups the triangles in place into clusters of at most
+// kMeshletMaxVertices vertices and kMeshletMaxTriangles triangles, grown
+// across shared vertices from the current order, and appends one Meshlet
+// per cluster. Without cones every cluster gets kMeshletNoCone, for meshes
+// whose back faces can be seen. Returns the number of clusters added.
+size_t buildMeshlets(std::vector<Meshlet>& meshlets, unsigned int* indices, size_t indexCount,
+    const float* positions, size_t vertexCount, size_t positionStride, bool cones);
+
+#endif
@@ -0,0 +1,240 @@
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define MIPGENERATOR_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPGENERATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Destination texels below this many are not worth a thread
+const size_t kMinTexelsPerThread = 16384;
+
+// Half-width of the Kaiser filter in destination texels, and its window shape
+const float kKaiserWidth = 3.0f;
+const float kKaiserAlpha = 4.0f;
+
+// Rows of floats are read four at a time from any texel, so they carry this
+// much slack past the last one
+const size_t kRowPadding = 4;
+
+const int kSrgbSteps = 4096;
+
+// sRGB transfer both ways: decoding looks up the 8-bit value, encoding
+// looks up linear light quantized to kSrgbSteps
+struct SrgbTables {
+    float toLinear[256];
+    unsigned char toSrgb[kSrgbSteps];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; i++) {
+            float v = i / 255.0f;
+            toLinear[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < kSrgbSteps; i++) {
+            float v = (float)i / (kSrgbSteps - 1);
+            float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (unsigned char)(s * 255.0f + 0.5f);
+        }
+    }
+};
+
+const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+float besselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 32 && term > 1e-8f * sum; k++) {
+        float t = x / (2.0f * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+float kaiser(float x) {
+    const float kPi = 3.14159265358979f;
+    float t = x / kKaiserWidth;
+    if (std::fabs(t) >= 1.0f) return 0.0f;
+    float sinc = x == 0.0f ? 1.0f : std::sin(kPi * x) / (kPi * x);
+    return sinc * besselI0(kKaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kKaiserAlpha);
+}
+
+// Source texels and normalised weights behind each destination texel along
+// one axis, with wrapped indices
+struct Taps {
+    std::vector<int> begin;  // destination count + 1 entries
+    std::vector<int> index;
+    std::vector<float> weight;
+    int maxCount = 0;
+
+    void build(int source, int destination, MipFilter filter) {
+        float scale = (float)source / destination;
+        float support = filter == MipFilter::Box ? scale * 0.5f : scale * kKaiserWidth;
+        begin.assign(1, 0);
+        index.clear();
+        weight.clear();
+        for (int d = 0; d < destination; d++) {
+            float center = (d + 0.5f) * scale;
+            int first = (int)std::floor(center - support), last = (int)std::ceil(center + support);
+            size_t start = weight.size();
+            float sum = 0.0f;
+            for (int i = first; i < last; i++) {
+                float w = filter == MipFilter::Box
+                    ? std::min(i + 1.0f, center + support) - std::max((float)i, center - support)
+                    : kaiser((i + 0.5f - center) / scale);
+                if (std::fabs(w) < 1e-6f) continue;
+                index.push_back(((i % source) + source) % source);
+                weight.push_back(w);
+                sum += w;
+            }
+            for (size_t t = start; t < weight.size(); t++) weight[t] /= sum;
+            begin.push_back((int)weight.size());
+            maxCount = std::max(maxCount, (int)(weight.size() - start));
+        }
+    }
+};
+
+void decodeRow(const unsigned char* src, size_t texels, int channels, int colorChannels, float* out) {
+    const float* toLinear = srgbTables().toLinear;
+    for (size_t i = 0; i < texels; i++) {
+        for (int c = 0; c < channels; c++, src++, out++) {
+            *out = c < colorChannels ? toLinear[*src] : *src * (1.0f / 255.0f);
+        }
+    }
+}
+
+void encodeRow(const float* src, size_t texels, int channels, int colorChannels, unsigned char* out) {
+    const unsigned char* toSrgb = srgbTables().toSrgb;
+    for (size_t i = 0; i < texels; i++) {
+        for (int c = 0; c < channels; c++, src++, out++) {
+            // The Kaiser filter's negative lobes can overshoot either way
+            float v = std::min(1.0f, std::max(0.0f, *src));
+            *out = c < colorChannels ? toSrgb[(int)(v * (kSrgbSteps - 1) + 0.5f)] : (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+// sum += row * weight over count floats
+void accumulateRow(float* sum, const float* row, float weight, size_t count) {
+    size_t i = 0;
+#ifdef MIPGENERATOR_AVX2
+    __m256 weight8 = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        __m256 product = _mm256_mul_ps(_mm256_loadu_ps(row + i), weight8);
+        _mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), product));
+    }
+#endif
+#ifdef MIPGENERATOR_SSE2
+    __m128 weight4 = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(row + i), weight4);
+        _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), product));
+    }
+#endif
+    for (; i < count; i++) sum[i] += row[i] * weight;
+}
+
+// Horizontal pass over one vertically filtered row. With SSE2 each texel is
+// one vector whatever its channel count: lanes past the last channel pick
+// up the next texel and are overwritten by its own store, in order.
+void filterRow(const float* row, const Taps& taps, int channels, int width, float* out) {
+    for (int x = 0; x < width; x++) {
+#ifdef MIPGENERATOR_SSE2
+        __m128 sum = _mm_setzero_ps();
+        for (int t = taps.begin[x]; t < taps.begin[x + 1]; t++) {
+            __m128 texel = _mm_loadu_ps(row + (size_t)taps.index[t] * channels);
+            sum = _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(taps.weight[t])));
+        }
+        _mm_storeu_ps(out + (size_t)x * channels, sum);
+#else
+        float sum[4] = {};
+        for (int t = taps.begin[x]; t < taps.begin[x + 1]; t++) {
+            const float* texel = row + (size_t)taps.index[t] * channels;
+            for (int c = 0; c < channels; c++) sum[c] += texel[c] * taps.weight[t];
+        }
+        for (int c = 0; c < channels; c++) out[(size_t)x * channels + c] = sum[c];
+#endif
+    }
+}
+
+void downsample(const unsigned char* src, int srcWidth, int srcHeight, int channels, int colorChannels,
+    MipFilter filter, unsigned char* dst, int width, int height, unsigned threadCount) {
+    Taps columns, rows;
+    columns.build(srcWidth, width, filter);
+    rows.build(srcHeight, height, filter);
+
+    size_t srcFloats = (size_t)srcWidth * channels;
+    size_t minRows = std::max<size_t>(1, kMinTexelsPerThread / width);
+    parallelFor((size_t)height, minRows, threadCount, [&](size_t begin, size_t end) {
+        // Decoded source rows, kept for the destination rows below that
+        // share them; a row's slot is its index modulo the slot count
+        int slots = rows.maxCount + 1;
+        std::vector<float> decoded((size_t)slots * srcFloats);
+        std::vector<int> decodedRow(slots, -1);
+        std::vector<float> vertical(srcFloats + kRowPadding);
+        std::vector<float> horizontal((size_t)width * channels + kRowPadding);
+
+        for (size_t y = begin; y < end; y++) {
+            std::fill(vertical.begin(), vertical.begin() + srcFloats, 0.0f);
+            for (int t = rows.begin[y]; t < rows.begin[y + 1]; t++) {
+                int sy = rows.index[t], slot = sy % slots;
+                float* row = &decoded[(size_t)slot * srcFloats];
+                if (decodedRow[slot] != sy) {
+                    decodeRow(src + (size_t)sy * srcFloats, srcWidth, channels, colorChannels, row);
+                    decodedRow[slot] = sy;
+                }
+                accumulateRow(vertical.data(), row, rows.weight[t], srcFloats);
+            }
+            filterRow(vertical.data(), columns, channels, width, horizontal.data());
+            encodeRow(horizontal.data(), width, channels, colorChannels, dst + y * width * channels);
+        }
+    });
+}
+
+} // namespace
+
+size_t mipChainBytes(int width, int height, int channels) {
+    size_t bytes = 0;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        bytes += (size_t)width * height * channels;
+    }
+    return bytes;
+}
+
+void generateMips(const unsigned char* texels, int width, int height, int channels, bool srgb, MipFilter filter,
+    MipChain& chain, unsigned threadCount) {
+    int colorChannels = !srgb ? 0 : (channels == 2 || channels == 4 ? channels - 1 : channels);
+    chain.levels.clear();
+    chain.texels.resize(mipChainBytes(width, height, channels));
+
+    const unsigned char* src = texels;
+    size_t offset = 0;
+    while (width > 1 || height > 1) {
+        MipLevel level;
+        level.width = std::max(1, width / 2);
+        level.height = std::max(1, height / 2);
+        level.offset = offset;
+        chain.levels.push_back(level);
+
+        unsigned char* dst = chain.texels.data() + offset;
+        downsample(src, width, height, channels, colorChannels, filter, dst, level.width, level.height, threadCount);
+        src = dst;
+        width = level.width;
+        height = level.height;
+        offset += (size_t)width * height * channels;
+    }
+}
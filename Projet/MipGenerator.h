@@ -0,0 +1,43 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <cstddef>
+#include <vector>
+
+// Downsampling filter between mip levels:
+//   Box     averages the source texels under each destination texel
+//   Kaiser  Kaiser-windowed sinc, three destination texels wide: sharper
+//           levels without the aliasing of the box, at several times the cost
+enum class MipFilter {
+    Box,
+    Kaiser,
+};
+
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;  // into MipChain::texels
+};
+
+// Levels 1 and up of an image, down to 1x1, tightly packed with the
+// source's channel count. Level 0 stays with the source.
+struct MipChain {
+    std::vector<MipLevel> levels;
+    std::vector<unsigned char> texels;
+};
+
+// Bytes generateMips allocates for an image of that size
+size_t mipChainBytes(int width, int height, int channels);
+
+// Builds the chain of width x height texels of channels 8-bit components,
+// each level from the one above. Sampling wraps around the edges, as the
+// textures repeat. With srgb the color channels (all but the alpha of a
+// two- or four-channel image) are decoded to linear light before filtering
+// and encoded again after. Each level's rows are split by parallelFor into
+// threadCount batches, 0 for one per core or, on a ThreadPool worker, one
+// per worker of its pool. Uses AVX2 when the build targets it, SSE2
+// otherwise.
+void generateMips(const unsigned char* texels, int width, int height, int channels, bool srgb, MipFilter filter,
+    MipChain& chain, unsigned threadCount = 0);
+
+#endif
@@ -0,0 +1,880 @@
+#include "ObjParser.h"
+#include "FastFloat.h"
+#include "FileUtil.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace {
+
+// Below this size a single chunk is faster than spawning threads
+const size_t kMinChunkSize = 1 << 20;
+
+enum CommandType { CmdUseMtl, CmdGroup, CmdObject, CmdSmoothing, CmdMtlLib };
+
+// Non-geometry statement, replayed in file order once all chunks are parsed
+struct Command {
+    CommandType type;
+    size_t face;  // number of faces in the chunk before this statement
+    std::string arg;
+    unsigned int smoothing;
+};
+
+enum RelativeFlags : uint8_t { RelVertex = 1, RelTexcoord = 2, RelNormal = 4 };
+
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    std::vector<tinyobj::real_t> v, weights, colors, vn, vt;
+    bool allColors = true;
+
+    // Face corners as written; negative (relative) indices are resolved
+    // against the chunk-local counts and flagged for the global fix-up
+    std::vector<tinyobj::index_t> corners;
+    std::vector<uint8_t> relative;
+    std::vector<uint32_t> faceStart;
+
+    std::vector<tinyobj::index_t> triangles;
+    std::vector<uint32_t> faceTriStart;
+
+    std::vector<Command> commands;
+
+    size_t vOffset = 0, vnOffset = 0, vtOffset = 0;
+    size_t lines = 0;
+    size_t errorLine = 0;
+    std::string error;
+    std::string warn;
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+inline bool isLineEnd(char c) { return c == '\r' || c == '\n'; }
+
+inline const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) p++;
+    return p;
+}
+
+// Number after optional leading blanks; found is false if there is none
+inline const char* parseReal(const char* p, const char* end, tinyobj::real_t& out, bool& found) {
+    p = skipSpace(p, end);
+    float value;
+    const char* next = parseFloat(p, end, value);
+    found = next != p;
+    if (found) out = (tinyobj::real_t)value;
+    return next;
+}
+
+inline const char* parseReal(const char* p, const char* end, tinyobj::real_t& out, tinyobj::real_t fallback) {
+    bool found;
+    p = parseReal(p, end, out, found);
+    if (!found) out = fallback;
+    return p;
+}
+
+const char* parseInt(const char* p, const char* end, int& out, bool& found) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    int value = 0;
+    found = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+        found = true;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+std::string parseWord(const char*& p, const char* end) {
+    p = skipSpace(p, end);
+    const char* start = p;
+    while (p < end && !isSpace(*p) && !isLineEnd(*p)) p++;
+    return std::string(start, p);
+}
+
+// Resolves one OBJ index (1-based or negative) to a chunk-local 0-based one
+bool resolveIndex(int raw, size_t localCount, int& out, bool& relative) {
+    if (raw > 0) {
+        out = raw - 1;
+        relative = false;
+        return true;
+    }
+    if (raw < 0) {
+        out = (int)localCount + raw;
+        relative = true;
+        return true;
+    }
+    return false;
+}
+
+bool parseCorner(const char*& p, const char* end, Chunk& chunk) {
+    tinyobj::index_t index = { -1, -1, -1 };
+    uint8_t flags = 0;
+    bool found, relative;
+    int raw;
+
+    p = parseInt(p, end, raw, found);
+    if (!found || !resolveIndex(raw, chunk.v.size() / 3, index.vertex_index, relative)) return false;
+    if (relative) flags |= RelVertex;
+
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = parseInt(p, end, raw, found);
+            if (found) {
+                if (!resolveIndex(raw, chunk.vt.size() / 2, index.texcoord_index, relative)) return false;
+                if (relative) flags |= RelTexcoord;
+            }
+        }
+        if (p < end && *p == '/') {
+            p++;
+            p = parseInt(p, end, raw, found);
+            if (found) {
+                if (!resolveIndex(raw, chunk.vn.size() / 3, index.normal_index, relative)) return false;
+                if (relative) flags |= RelNormal;
+            }
+        }
+    }
+
+    if (p < end && !isSpace(*p) && !isLineEnd(*p) && *p != '#') return false;
+
+    chunk.corners.push_back(index);
+    chunk.relative.push_back(flags);
+    return true;
+}
+
+void tokenizeChunk(Chunk& chunk) {
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    chunk.faceStart.push_back(0);
+
+    while (p < end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (!lineEnd) lineEnd = end;
+        chunk.lines++;
+
+        const char* t = skipSpace(p, lineEnd);
+        const char* next = lineEnd < end ? lineEnd + 1 : end;
+        size_t remaining = (size_t)(lineEnd - t);
+
+        if (remaining == 0 || isLineEnd(*t) || *t == '#') {
+            p = next;
+            continue;
+        }
+
+        if (remaining > 1 && t[0] == 'v' && isSpace(t[1])) {
+            tinyobj::real_t x, y, z, r, g, b;
+            bool hasR, hasG, hasB;
+            t = parseReal(t + 2, lineEnd, x, 0.0f);
+            t = parseReal(t, lineEnd, y, 0.0f);
+            t = parseReal(t, lineEnd, z, 0.0f);
+            t = parseReal(t, lineEnd, r, hasR);
+            t = parseReal(t, lineEnd, g, hasG);
+            t = parseReal(t, lineEnd, b, hasB);
+            // Same rules as tinyobj: xyz, xyzw (w stored in r) or xyzrgb
+            if (!hasR) r = 1.0f;
+            if (!hasG || !hasB) {
+                g = b = 1.0f;
+                if (hasG) r = 1.0f;
+            }
+            chunk.allColors &= hasR && hasG && hasB;
+            chunk.v.push_back(x);
+            chunk.v.push_back(y);
+            chunk.v.push_back(z);
+            chunk.weights.push_back(r);
+            chunk.colors.push_back(r);
+            chunk.colors.push_back(g);
+            chunk.colors.push_back(b);
+        }
+        else if (remaining > 2 && t[0] == 'v' && t[1] == 'n' && isSpace(t[2])) {
+            tinyobj::real_t x, y, z;
+            t = parseReal(t + 3, lineEnd, x, 0.0f);
+            t = parseReal(t, lineEnd, y, 0.0f);
+            t = parseReal(t, lineEnd, z, 0.0f);
+            chunk.vn.push_back(x);
+            chunk.vn.push_back(y);
+            chunk.vn.push_back(z);
+        }
+        else if (remaining > 2 && t[0] == 'v' && t[1] == 't' && isSpace(t[2])) {
+            tinyobj::real_t x, y;
+            t = parseReal(t + 3, lineEnd, x, 0.0f);
+            t = parseReal(t, lineEnd, y, 0.0f);
+            chunk.vt.push_back(x);
+            chunk.vt.push_back(y);
+        }
+        else if (remaining > 1 && t[0] == 'f' && isSpace(t[1])) {
+            t = skipSpace(t + 2, lineEnd);
+            while (t < lineEnd && !isLineEnd(*t) && *t != '#') {
+                if (!parseCorner(t, lineEnd, chunk)) {
+                    chunk.error = "Failed to parse `f' line (e.g. a zero value for vertex index or invalid relative vertex index).";
+                    chunk.errorLine = chunk.lines;
+                    return;
+                }
+                t = skipSpace(t, lineEnd);
+            }
+            chunk.faceStart.push_back((uint32_t)chunk.corners.size());
+        }
+        else if (remaining > 6 && strncmp(t, "usemtl", 6) == 0) {
+            t += 6;
+            chunk.commands.push_back({ CmdUseMtl, chunk.faceStart.size() - 1, parseWord(t, lineEnd), 0 });
+        }
+        else if (remaining > 6 && strncmp(t, "mtllib", 6) == 0 && isSpace(t[6])) {
+            const char* argEnd = lineEnd;
+            while (argEnd > t + 7 && isLineEnd(argEnd[-1])) argEnd--;
+            chunk.commands.push_back({ CmdMtlLib, chunk.faceStart.size() - 1, std::string(t + 7, argEnd), 0 });
+        }
+        else if (remaining > 1 && t[0] == 'g' && isSpace(t[1])) {
+            t += 2;
+            std::string name;
+            for (std::string word = parseWord(t, lineEnd); !word.empty() && word[0] != '#'; word = parseWord(t, lineEnd)) {
+                if (!name.empty()) name += ' ';
+                name += word;
+            }
+            chunk.commands.push_back({ CmdGroup, chunk.faceStart.size() - 1, name, 0 });
+        }
+        else if (remaining > 1 && t[0] == 'o' && isSpace(t[1])) {
+            const char* argEnd = lineEnd;
+            while (argEnd > t + 2 && isLineEnd(argEnd[-1])) argEnd--;
+            chunk.commands.push_back({ CmdObject, chunk.faceStart.size() - 1, std::string(t + 2, argEnd), 0 });
+        }
+        else if (remaining > 1 && t[0] == 's' && isSpace(t[1])) {
+            t = skipSpace(t + 2, lineEnd);
+            if (t < lineEnd && !isLineEnd(*t)) {
+                unsigned int id = 0;
+                if (lineEnd - t < 3 || strncmp(t, "off", 3) != 0) {
+                    int value;
+                    bool found;
+                    parseInt(t, lineEnd, value, found);
+                    id = value < 0 ? 0 : (unsigned int)value;
+                }
+                chunk.commands.push_back({ CmdSmoothing, chunk.faceStart.size() - 1, std::string(), id });
+            }
+        }
+        // Anything else (l, p, vw, t, unknown statements) is ignored
+
+        p = next;
+    }
+}
+
+inline bool validVertex(int index, size_t vertexCount) {
+    return index >= 0 && (size_t)index < vertexCount;
+}
+
+inline bool pointInTriangle(const float* vx, const float* vy, float tx, float ty) {
+    bool inside = false;
+    for (int i = 0, j = 2; i < 3; j = i++) {
+        if (((vy[i] > ty) != (vy[j] > ty)) && (tx < (vx[j] - vx[i]) * (ty - vy[i]) / (vy[j] - vy[i]) + vx[i])) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// Ear clipping for polygons with more than four corners, ported from
+// tinyobj's built-in triangulation so both loaders emit the same triangles
+void clipPolygon(const tinyobj::index_t* corners, uint32_t n, const std::vector<tinyobj::real_t>& v,
+    std::vector<tinyobj::index_t>& out) {
+    auto coord = [&v](const tinyobj::index_t& index, size_t axis) {
+        size_t i = (size_t)index.vertex_index * 3 + axis;
+        return index.vertex_index >= 0 && i < v.size() ? v[i] : 0.0f;
+    };
+
+    // Project onto the plane that best matches the first non-degenerate corner
+    size_t axes[2] = { 1, 2 };
+    for (uint32_t k = 0; k < n; k++) {
+        const tinyobj::index_t& i0 = corners[k % n];
+        const tinyobj::index_t& i1 = corners[(k + 1) % n];
+        const tinyobj::index_t& i2 = corners[(k + 2) % n];
+        if (!validVertex(i0.vertex_index, v.size() / 3) || !validVertex(i1.vertex_index, v.size() / 3) ||
+            !validVertex(i2.vertex_index, v.size() / 3)) {
+            continue;
+        }
+        float e0[3], e1[3];
+        for (int a = 0; a < 3; a++) {
+            e0[a] = coord(i1, a) - coord(i0, a);
+            e1[a] = coord(i2, a) - coord(i1, a);
+        }
+        float cx = std::fabs(e0[1] * e1[2] - e0[2] * e1[1]);
+        float cy = std::fabs(e0[2] * e1[0] - e0[0] * e1[2]);
+        float cz = std::fabs(e0[0] * e1[1] - e0[1] * e1[0]);
+        const float epsilon = std::numeric_limits<float>::epsilon();
+        if (cx > epsilon || cy > epsilon || cz > epsilon) {
+            if (!(cx > cy && cx > cz)) {
+                axes[0] = 0;
+                if (cz > cx && cz > cy) axes[1] = 1;
+            }
+            break;
+        }
+    }
+
+    std::vector<tinyobj::index_t> remaining(corners, corners + n);
+    size_t guess = 0;
+    size_t iterationsLeft = remaining.size();
+    size_t previousCount = remaining.size();
+
+    while (remaining.size() > 3 && iterationsLeft > 0) {
+        size_t count = remaining.size();
+        if (guess >= count) guess -= count;
+
+        if (previousCount != count) {
+            previousCount = count;
+            iterationsLeft = count;
+        }
+        else {
+            iterationsLeft--;
+        }
+
+        tinyobj::index_t ind[3];
+        float vx[3], vy[3];
+        for (size_t k = 0; k < 3; k++) {
+            ind[k] = remaining[(guess + k) % count];
+            vx[k] = coord(ind[k], axes[0]);
+            vy[k] = coord(ind[k], axes[1]);
+        }
+
+        float cross = (vx[1] - vx[0]) * (vy[2] - vy[1]) - (vy[1] - vy[0]) * (vx[2] - vx[1]);
+        float area = (vx[0] * vy[1] - vy[0] * vx[1]) * 0.5f;
+        if (cross * area < 0.0f) {
+            guess++;
+            continue;
+        }
+
+        bool overlap = false;
+        for (size_t other = 3; other < count && !overlap; other++) {
+            const tinyobj::index_t& o = remaining[(guess + other) % count];
+            if (!validVertex(o.vertex_index, v.size() / 3)) continue;
+            overlap = pointInTriangle(vx, vy, coord(o, axes[0]), coord(o, axes[1]));
+        }
+        if (overlap) {
+            guess++;
+            continue;
+        }
+
+        out.insert(out.end(), ind, ind + 3);
+        remaining.erase(remaining.begin() + (guess + 1) % count);
+    }
+
+    if (remaining.size() == 3) {
+        out.insert(out.end(), remaining.begin(), remaining.end());
+    }
+}
+
+// Makes chunk indices global and checks them against the attribute counts:
+// faces with a vertex out of range are dropped, texcoords and normals out
+// of range are cleared to -1. Then triangulates: quads are split along the
+// shorter diagonal and larger polygons are ear-clipped, as in tinyobj.
+void finishChunk(Chunk& chunk, const tinyobj::attrib_t& attrib) {
+    const std::vector<tinyobj::real_t>& positions = attrib.vertices;
+    size_t vertexCount = positions.size() / 3;
+    size_t texcoordCount = attrib.texcoords.size() / 2;
+    size_t normalCount = attrib.normals.size() / 3;
+    bool badAttribute = false;
+    for (size_t i = 0; i < chunk.corners.size(); i++) {
+        uint8_t flags = chunk.relative[i];
+        tinyobj::index_t& index = chunk.corners[i];
+        if (flags & RelVertex) index.vertex_index += (int)chunk.vOffset;
+        if (flags & RelTexcoord) index.texcoord_index += (int)chunk.vtOffset;
+        if (flags & RelNormal) index.normal_index += (int)chunk.vnOffset;
+
+        if (index.texcoord_index != -1 && !validVertex(index.texcoord_index, texcoordCount)) {
+            index.texcoord_index = -1;
+            badAttribute = true;
+        }
+        if (index.normal_index != -1 && !validVertex(index.normal_index, normalCount)) {
+            index.normal_index = -1;
+            badAttribute = true;
+        }
+    }
+    if (badAttribute) chunk.warn += "Face with invalid texcoord or normal index found.\n";
+
+    size_t faceCount = chunk.faceStart.size() - 1;
+    bool badVertex = false;
+    chunk.faceTriStart.resize(faceCount + 1);
+    chunk.triangles.reserve(chunk.corners.size() * 3 / 2);
+
+    for (size_t f = 0; f < faceCount; f++) {
+        chunk.faceTriStart[f] = (uint32_t)(chunk.triangles.size() / 3);
+        const tinyobj::index_t* c = &chunk.corners[chunk.faceStart[f]];
+        uint32_t n = chunk.faceStart[f + 1] - chunk.faceStart[f];
+
+        if (n < 3) {
+            if (chunk.warn.empty()) chunk.warn = "Degenerated face found\n.";
+            continue;
+        }
+        bool valid = true;
+        for (uint32_t k = 0; k < n && valid; k++) valid = validVertex(c[k].vertex_index, vertexCount);
+        if (!valid) {
+            badVertex = true;
+            continue;
+        }
+        if (n == 3) {
+            chunk.triangles.insert(chunk.triangles.end(), c, c + 3);
+            continue;
+        }
+        if (n == 4) {
+            float d02 = 0.0f, d13 = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                float e02 = positions[3 * c[2].vertex_index + k] - positions[3 * c[0].vertex_index + k];
+                float e13 = positions[3 * c[3].vertex_index + k] - positions[3 * c[1].vertex_index + k];
+                d02 += e02 * e02;
+                d13 += e13 * e13;
+            }
+            const tinyobj::index_t split02[6] = { c[0], c[1], c[2], c[0], c[2], c[3] };
+            const tinyobj::index_t split13[6] = { c[0], c[1], c[3], c[1], c[2], c[3] };
+            const tinyobj::index_t* tris = d02 < d13 ? split02 : split13;
+            chunk.triangles.insert(chunk.triangles.end(), tris, tris + 6);
+            continue;
+        }
+        clipPolygon(c, n, positions, chunk.triangles);
+    }
+    chunk.faceTriStart[faceCount] = (uint32_t)(chunk.triangles.size() / 3);
+    if (badVertex) chunk.warn += "Face with invalid vertex index found.\n";
+
+    std::vector<tinyobj::index_t>().swap(chunk.corners);
+    std::vector<uint8_t>().swap(chunk.relative);
+}
+
+// One parallelFor batch per chunk
+template <typename Fn>
+void forEachChunk(std::vector<Chunk>& chunks, Fn fn) {
+    parallelFor(chunks.size(), 1, (unsigned)chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) fn(chunks[i]);
+    });
+}
+
+std::vector<std::string> splitFileNames(const std::string& s) {
+    std::vector<std::string> names;
+    std::string current;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' && i + 1 < s.size()) {
+            current += s[++i];
+        }
+        else if (s[i] == ' ') {
+            if (!current.empty()) names.push_back(current);
+            current.clear();
+        }
+        else {
+            current += s[i];
+        }
+    }
+    if (!current.empty()) names.push_back(current);
+    return names;
+}
+
+// Same defaults as tinyobj's InitMaterial / InitTexOpt
+void initTextureOption(tinyobj::texture_option_t& option, bool isBump) {
+    option = tinyobj::texture_option_t();
+    option.type = tinyobj::TEXTURE_TYPE_NONE;
+    option.imfchan = isBump ? 'l' : 'm';
+    option.bump_multiplier = 1.0f;
+    option.clamp = false;
+    option.blendu = true;
+    option.blendv = true;
+    option.sharpness = 1.0f;
+    option.brightness = 0.0f;
+    option.contrast = 1.0f;
+    for (int i = 0; i < 3; i++) {
+        option.origin_offset[i] = 0.0f;
+        option.scale[i] = 1.0f;
+        option.turbulence[i] = 0.0f;
+    }
+    option.texture_resolution = -1;
+}
+
+struct ColorKey {
+    const char* key;
+    tinyobj::real_t (tinyobj::material_t::*value)[3];
+};
+
+struct ScalarKey {
+    const char* key;
+    tinyobj::real_t tinyobj::material_t::*value;
+};
+
+struct TextureKey {
+    const char* key;
+    std::string tinyobj::material_t::*name;
+    tinyobj::texture_option_t tinyobj::material_t::*option;
+};
+
+const ColorKey kColorKeys[] = {
+    { "Ka", &tinyobj::material_t::ambient },
+    { "Kd", &tinyobj::material_t::diffuse },
+    { "Ks", &tinyobj::material_t::specular },
+    { "Kt", &tinyobj::material_t::transmittance },
+    { "Tf", &tinyobj::material_t::transmittance },
+    { "Ke", &tinyobj::material_t::emission },
+};
+
+const ScalarKey kScalarKeys[] = {
+    { "Ni", &tinyobj::material_t::ior },
+    { "Ns", &tinyobj::material_t::shininess },
+    { "Pr", &tinyobj::material_t::roughness },
+    { "Pm", &tinyobj::material_t::metallic },
+    { "Ps", &tinyobj::material_t::sheen },
+    { "Pc", &tinyobj::material_t::clearcoat_thickness },
+    { "Pcr", &tinyobj::material_t::clearcoat_roughness },
+    { "aniso", &tinyobj::material_t::anisotropy },
+    { "anisor", &tinyobj::material_t::anisotropy_rotation },
+};
+
+const TextureKey kTextureKeys[] = {
+    { "map_Ka", &tinyobj::material_t::ambient_texname, &tinyobj::material_t::ambient_texopt },
+    { "map_Kd", &tinyobj::material_t::diffuse_texname, &tinyobj::material_t::diffuse_texopt },
+    { "map_Ks", &tinyobj::material_t::specular_texname, &tinyobj::material_t::specular_texopt },
+    { "map_Ns", &tinyobj::material_t::specular_highlight_texname, &tinyobj::material_t::specular_highlight_texopt },
+    { "map_bump", &tinyobj::material_t::bump_texname, &tinyobj::material_t::bump_texopt },
+    { "map_Bump", &tinyobj::material_t::bump_texname, &tinyobj::material_t::bump_texopt },
+    { "bump", &tinyobj::material_t::bump_texname, &tinyobj::material_t::bump_texopt },
+    { "map_d", &tinyobj::material_t::alpha_texname, &tinyobj::material_t::alpha_texopt },
+    { "map_disp", &tinyobj::material_t::displacement_texname, &tinyobj::material_t::displacement_texopt },
+    { "map_Disp", &tinyobj::material_t::displacement_texname, &tinyobj::material_t::displacement_texopt },
+    { "disp", &tinyobj::material_t::displacement_texname, &tinyobj::material_t::displacement_texopt },
+    { "refl", &tinyobj::material_t::reflection_texname, &tinyobj::material_t::reflection_texopt },
+    { "map_Pr", &tinyobj::material_t::roughness_texname, &tinyobj::material_t::roughness_texopt },
+    { "map_Pm", &tinyobj::material_t::metallic_texname, &tinyobj::material_t::metallic_texopt },
+    { "map_Ps", &tinyobj::material_t::sheen_texname, &tinyobj::material_t::sheen_texopt },
+    { "map_Ke", &tinyobj::material_t::emissive_texname, &tinyobj::material_t::emissive_texopt },
+    { "norm", &tinyobj::material_t::normal_texname, &tinyobj::material_t::normal_texopt },
+};
+
+void initMaterial(tinyobj::material_t& material) {
+    material = tinyobj::material_t();
+    for (const TextureKey& key : kTextureKeys) {
+        initTextureOption(material.*key.option, key.option == &tinyobj::material_t::bump_texopt);
+    }
+    for (int i = 0; i < 3; i++) {
+        material.ambient[i] = material.diffuse[i] = material.specular[i] = 0.0f;
+        material.transmittance[i] = material.emission[i] = 0.0f;
+    }
+    material.illum = 0;
+    material.dissolve = 1.0f;
+    material.shininess = 1.0f;
+    material.ior = 1.0f;
+    material.roughness = material.metallic = material.sheen = 0.0f;
+    material.clearcoat_thickness = material.clearcoat_roughness = 0.0f;
+    material.anisotropy = material.anisotropy_rotation = 0.0f;
+}
+
+// Statement keyword followed by a blank; returns the argument start or null
+inline const char* matchKey(const char* t, const char* lineEnd, const char* key) {
+    size_t length = strlen(key);
+    if ((size_t)(lineEnd - t) <= length || strncmp(t, key, length) != 0 || !isSpace(t[length])) return nullptr;
+    return t + length;
+}
+
+// Reads a .mtl straight from a mapping with the same rules as tinyobj::LoadMtl.
+// Only texture statements are copied out, since the texture option parser
+// expects a terminated string.
+bool loadMaterialFile(const std::string& path, std::vector<tinyobj::material_t>& materials,
+    std::map<std::string, int>& materialMap, std::string& warn) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const char* p = (const char*)file.data();
+    const char* end = p + file.size();
+
+    tinyobj::material_t material;
+    initMaterial(material);
+    bool hasD = false, hasTr = false, hasKd = false;
+    size_t lineNumber = 0;
+    std::string textureLine;
+    std::string fileWarn;
+
+    auto flush = [&]() {
+        materialMap.insert(std::make_pair(material.name, (int)materials.size()));
+        materials.push_back(material);
+    };
+
+    while (p < end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (!lineEnd) lineEnd = end;
+        const char* next = lineEnd < end ? lineEnd + 1 : end;
+        lineNumber++;
+
+        while (lineEnd > p && (isSpace(lineEnd[-1]) || isLineEnd(lineEnd[-1]))) lineEnd--;
+        const char* t = skipSpace(p, lineEnd);
+        p = next;
+        if (t == lineEnd || *t == '#') continue;
+
+        const char* arg;
+        if ((arg = matchKey(t, lineEnd, "newmtl"))) {
+            if (!material.name.empty()) flush();
+            initMaterial(material);
+            hasD = hasTr = false;
+            material.name = parseWord(arg, lineEnd);
+            if (material.name.empty()) fileWarn += "empty material name in `newmtl`\n";
+            continue;
+        }
+
+        bool handled = false;
+        for (const ColorKey& key : kColorKeys) {
+            if ((arg = matchKey(t, lineEnd, key.key))) {
+                tinyobj::real_t* color = material.*key.value;
+                arg = parseReal(arg, lineEnd, color[0], 0.0f);
+                arg = parseReal(arg, lineEnd, color[1], 0.0f);
+                parseReal(arg, lineEnd, color[2], 0.0f);
+                hasKd |= key.value == &tinyobj::material_t::diffuse;
+                handled = true;
+                break;
+            }
+        }
+        for (size_t i = 0; !handled && i < sizeof(kScalarKeys) / sizeof(kScalarKeys[0]); i++) {
+            if ((arg = matchKey(t, lineEnd, kScalarKeys[i].key))) {
+                parseReal(arg, lineEnd, material.*kScalarKeys[i].value, 0.0f);
+                handled = true;
+            }
+        }
+        if (handled) continue;
+
+        if ((arg = matchKey(t, lineEnd, "illum"))) {
+            bool found;
+            parseInt(skipSpace(arg, lineEnd), lineEnd, material.illum, found);
+            if (!found) material.illum = 0;
+            continue;
+        }
+        if ((arg = matchKey(t, lineEnd, "d"))) {
+            parseReal(arg, lineEnd, material.dissolve, 0.0f);
+            if (hasTr) {
+                fileWarn += "Both `d` and `Tr` parameters defined for \"" + material.name +
+                    "\". Use the value of `d` for dissolve (line " + std::to_string(lineNumber) + " in .mtl.)\n";
+            }
+            hasD = true;
+            continue;
+        }
+        if ((arg = matchKey(t, lineEnd, "Tr"))) {
+            if (hasD) {
+                fileWarn += "Both `d` and `Tr` parameters defined for \"" + material.name +
+                    "\". Use the value of `d` for dissolve (line " + std::to_string(lineNumber) + " in .mtl.)\n";
+            }
+            else {
+                tinyobj::real_t tr;
+                parseReal(arg, lineEnd, tr, 0.0f);
+                material.dissolve = 1.0f - tr;
+            }
+            hasTr = true;
+            continue;
+        }
+
+        for (const TextureKey& key : kTextureKeys) {
+            if ((arg = matchKey(t, lineEnd, key.key))) {
+                textureLine.assign(arg + 1, lineEnd);
+                if (key.name == &tinyobj::material_t::alpha_texname) material.alpha_texname = textureLine;
+                tinyobj::ParseTextureNameAndOption(&(material.*key.name), &(material.*key.option), textureLine.c_str());
+                // Decent diffuse default when a texture comes without Kd
+                if (key.name == &tinyobj::material_t::diffuse_texname && !hasKd) {
+                    material.diffuse[0] = material.diffuse[1] = material.diffuse[2] = 0.6f;
+                }
+                handled = true;
+                break;
+            }
+        }
+        if (handled) continue;
+
+        const char* space = (const char*)memchr(t, ' ', (size_t)(lineEnd - t));
+        if (!space) space = (const char*)memchr(t, '\t', (size_t)(lineEnd - t));
+        if (space) material.unknown_parameter.insert(std::make_pair(std::string(t, space), std::string(space + 1, lineEnd)));
+    }
+    flush();
+
+    warn += fileWarn;
+    return true;
+}
+
+// Tries each directory of the ';' (':' outside Windows) separated search list
+bool loadMaterialLibrary(const std::string& fileName, const std::string& searchPath,
+    std::vector<tinyobj::material_t>& materials, std::map<std::string, int>& materialMap, std::string& warn) {
+    if (searchPath.empty()) {
+        if (loadMaterialFile(fileName, materials, materialMap, warn)) return true;
+    }
+    else {
+#ifdef _WIN32
+        const char separator = ';';
+#else
+        const char separator = ':';
+#endif
+        size_t start = 0;
+        while (start <= searchPath.size()) {
+            size_t stop = searchPath.find(separator, start);
+            if (stop == std::string::npos) stop = searchPath.size();
+            std::string dir = searchPath.substr(start, stop - start);
+            std::string filePath = dir.empty() ? fileName : dir.back() == '/' ? dir + fileName : dir + "/" + fileName;
+            if (loadMaterialFile(filePath, materials, materialMap, warn)) return true;
+            start = stop + 1;
+        }
+    }
+    warn += "Material file [ " + fileName + " ] not found in a path : " + searchPath + "\n";
+    return false;
+}
+
+}  // namespace
+
+bool loadObjParallel(const std::string& path, tinyobj::attrib_t& attrib,
+    std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+    std::string& warn, std::string& err, const std::string& mtlBaseDir, unsigned threadCount) {
+    attrib = tinyobj::attrib_t();
+    shapes.clear();
+
+    MappedFile file;
+    if (!file.open(path)) {
+        err += "Cannot open file [" + path + "]\n";
+        return false;
+    }
+
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, file.size() / kMinChunkSize));
+
+    // Split at line boundaries
+    const char* data = (const char*)file.data();
+    const char* fileEnd = data + file.size();
+    std::vector<Chunk> chunks(chunkCount);
+    const char* cursor = data;
+    for (size_t i = 0; i < chunkCount; i++) {
+        chunks[i].begin = cursor;
+        const char* target = data + file.size() * (i + 1) / chunkCount;
+        if (i + 1 == chunkCount || target <= cursor) {
+            target = i + 1 == chunkCount ? fileEnd : cursor;
+        }
+        const char* newline = (const char*)memchr(target, '\n', (size_t)(fileEnd - target));
+        cursor = newline ? newline + 1 : fileEnd;
+        chunks[i].end = cursor;
+    }
+
+    forEachChunk(chunks, tokenizeChunk);
+
+    size_t lineOffset = 0;
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            std::stringstream ss;
+            ss << chunk.error << " Line " << (lineOffset + chunk.errorLine) << ".\n";
+            err += ss.str();
+            return false;
+        }
+        lineOffset += chunk.lines;
+    }
+
+    // Prefix sum of the attribute counts gives each chunk its global offsets
+    size_t vCount = 0, vnCount = 0, vtCount = 0;
+    bool allColors = true;
+    for (Chunk& chunk : chunks) {
+        chunk.vOffset = vCount;
+        chunk.vnOffset = vnCount;
+        chunk.vtOffset = vtCount;
+        vCount += chunk.v.size() / 3;
+        vnCount += chunk.vn.size() / 3;
+        vtCount += chunk.vt.size() / 2;
+        allColors &= chunk.allColors;
+    }
+
+    attrib.vertices.resize(vCount * 3);
+    attrib.vertex_weights.resize(vCount);
+    attrib.colors.resize(vCount * 3);
+    attrib.normals.resize(vnCount * 3);
+    attrib.texcoords.resize(vtCount * 2);
+
+    forEachChunk(chunks, [&attrib](Chunk& chunk) {
+        std::copy(chunk.v.begin(), chunk.v.end(), attrib.vertices.begin() + chunk.vOffset * 3);
+        std::copy(chunk.weights.begin(), chunk.weights.end(), attrib.vertex_weights.begin() + chunk.vOffset);
+        std::copy(chunk.colors.begin(), chunk.colors.end(), attrib.colors.begin() + chunk.vOffset * 3);
+        std::copy(chunk.vn.begin(), chunk.vn.end(), attrib.normals.begin() + chunk.vnOffset * 3);
+        std::copy(chunk.vt.begin(), chunk.vt.end(), attrib.texcoords.begin() + chunk.vtOffset * 2);
+        std::vector<tinyobj::real_t>().swap(chunk.v);
+        std::vector<tinyobj::real_t>().swap(chunk.weights);
+        std::vector<tinyobj::real_t>().swap(chunk.colors);
+        std::vector<tinyobj::real_t>().swap(chunk.vn);
+        std::vector<tinyobj::real_t>().swap(chunk.vt);
+    });
+    (void)allColors;  // LoadObj keeps default colors when some are missing
+
+    forEachChunk(chunks, [&attrib](Chunk& chunk) { finishChunk(chunk, attrib); });
+
+    // Replay statements in file order and append whole face ranges at once
+    std::map<std::string, int> materialMap;
+    std::vector<std::string> loadedLibraries;
+    int material = -1;
+    unsigned int smoothing = 0;
+    std::string name;
+    tinyobj::shape_t shape;
+
+    auto flushShape = [&shapes, &shape]() {
+        if (!shape.mesh.indices.empty()) shapes.push_back(std::move(shape));
+        shape = tinyobj::shape_t();
+    };
+
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.warn.empty()) warn += chunk.warn;
+
+        size_t face = 0;
+        size_t faceCount = chunk.faceTriStart.empty() ? 0 : chunk.faceTriStart.size() - 1;
+        size_t commandIndex = 0;
+        while (face < faceCount || commandIndex < chunk.commands.size()) {
+            size_t stop = commandIndex < chunk.commands.size() ? chunk.commands[commandIndex].face : faceCount;
+            if (stop > face) {
+                size_t triBegin = chunk.faceTriStart[face];
+                size_t triEnd = chunk.faceTriStart[stop];
+                if (triEnd > triBegin) {
+                    shape.name = name;
+                    shape.mesh.indices.insert(shape.mesh.indices.end(),
+                        chunk.triangles.begin() + triBegin * 3, chunk.triangles.begin() + triEnd * 3);
+                    shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), triEnd - triBegin, 3u);
+                    shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), triEnd - triBegin, material);
+                    shape.mesh.smoothing_group_ids.insert(shape.mesh.smoothing_group_ids.end(), triEnd - triBegin, smoothing);
+                }
+                face = stop;
+            }
+            if (commandIndex >= chunk.commands.size()) break;
+
+            const Command& command = chunk.commands[commandIndex++];
+            switch (command.type) {
+            case CmdUseMtl: {
+                auto it = materialMap.find(command.arg);
+                if (it != materialMap.end()) {
+                    material = it->second;
+                }
+                else {
+                    warn += "material [ '" + command.arg + "' ] not found in .mtl\n";
+                    material = -1;
+                }
+                break;
+            }
+            case CmdMtlLib: {
+                bool found = false;
+                for (const std::string& fileName : splitFileNames(command.arg)) {
+                    if (std::find(loadedLibraries.begin(), loadedLibraries.end(), fileName) != loadedLibraries.end()) {
+                        found = true;
+                        continue;
+                    }
+                    if (loadMaterialLibrary(fileName, mtlBaseDir, materials, materialMap, warn)) {
+                        loadedLibraries.push_back(fileName);
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) warn += "Failed to load material file(s). Use default material.\n";
+                break;
+            }
+            case CmdGroup:
+            case CmdObject:
+                flushShape();
+                name = command.arg;
+                break;
+            case CmdSmoothing:
+                smoothing = command.smoothing;
+                break;
+            }
+        }
+    }
+    flushShape();
+
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+// Multi-threaded OBJ front end. The file is mapped and split at line
+// boundaries; each chunk is tokenized as a batch of parallelFor (shared
+// with the idle workers of the pool when called on one), then global
+// v/vn/vt offsets are fixed up with a prefix sum. The result has the same layout as
+// tinyobj::LoadObj (triangulated, per-face material and smoothing ids) so
+// it can be handed to buildMesh unchanged. Faces with a vertex index out of
+// range are dropped and texcoord or normal indices out of range set to -1,
+// with a warning.
+// Lines, points, skin weights and tags are not supported.
+bool loadObjParallel(const std::string& path, tinyobj::attrib_t& attrib,
+    std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+    std::string& warn, std::string& err, const std::string& mtlBaseDir = "", unsigned threadCount = 0);
+
+#endif
@@ -0,0 +1,151 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+
+StagingRing::~StagingRing() {
+    destroy();
+}
+
+bool StagingRing::create(size_t capacity, size_t frameBytes) {
+    destroy();
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+
+    persistent_ = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    if (persistent_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_READ_BUFFER, capacity, nullptr, flags);
+        mapped_ = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags);
+        if (!mapped_) {
+            glDeleteBuffers(1, &buffer_);
+            buffer_ = 0;
+            return false;
+        }
+    }
+    else {
+        glBufferData(GL_COPY_READ_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    capacity_ = capacity;
+    frameLimit_ = std::min(frameBytes, capacity);
+    head_ = used_ = frameBytes_ = 0;
+    return true;
+}
+
+void StagingRing::destroy() {
+    if (!buffer_) return;
+    for (const Frame& frame : frames_) glDeleteSync(frame.fence);
+    frames_.clear();
+    if (persistent_) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    else {
+        unmap();
+    }
+    mapped_ = nullptr;
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+}
+
+void StagingRing::unmap() {
+    if (persistent_ || !mapped_) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    mapped_ = nullptr;
+}
+
+unsigned char* StagingRing::allocate(size_t bytes, size_t& offset) {
+    if (!buffer_ || bytes == 0) return nullptr;
+    unmap();
+    bytes = (bytes + kStagingAlignment - 1) & ~(kStagingAlignment - 1);
+
+    // An allocation never wraps; the space left at the end is skipped
+    size_t skipped = head_ + bytes > capacity_ ? capacity_ - head_ : 0;
+    if (used_ + skipped + bytes > capacity_) return nullptr;
+    if (frameBytes_ > 0 && frameBytes_ + skipped + bytes > frameLimit_) return nullptr;
+    if (skipped) head_ = 0;
+
+    offset = head_;
+    head_ = (head_ + bytes) % capacity_;
+    used_ += skipped + bytes;
+    frameBytes_ += skipped + bytes;
+    bytesStaged_ += bytes;
+
+    if (persistent_) return mapped_ + offset;
+
+    // The fences keep the GPU off this range, so there is nothing to sync
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    mapped_ = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, offset, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return mapped_;
+}
+
+void StagingRing::copyToBuffer(size_t offset, size_t bytes, GLuint buffer, size_t bufferOffset) {
+    unmap();
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, bufferOffset, bytes);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void StagingRing::copyToTexture(size_t offset, GLuint texture, int level, int y, int width, int rows, GLenum format) {
+    unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, rows, format, GL_UNSIGNED_BYTE, (const void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StagingRing::copyToCompressedTexture(size_t offset, size_t bytes, GLuint texture, int level, int y, int width,
+    int rows, GLenum format) {
+    unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, rows, format, (GLsizei)bytes, (const void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StagingRing::copyToTextureLayer(size_t offset, GLuint texture, int level, int layer, int width, int height,
+    GLenum format) {
+    unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE,
+        (const void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StagingRing::copyToCompressedTextureLayer(size_t offset, size_t bytes, GLuint texture, int level, int layer,
+    int width, int height, GLenum format) {
+    unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format, (GLsizei)bytes,
+        (const void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StagingRing::endFrame() {
+    unmap();
+    if (frameBytes_ > 0) {
+        frames_.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameBytes_ });
+        frameBytes_ = 0;
+    }
+    while (!frames_.empty()) {
+        GLenum status = glClientWaitSync(frames_.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(frames_.front().fence);
+        used_ -= frames_.front().bytes;
+        frames_.pop_front();
+    }
+    // Nothing in flight: start over at the front so big allocations fit
+    if (used_ == 0) head_ = 0;
+}
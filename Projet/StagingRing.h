@@ -0,0 +1,81 @@
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <deque>
+
+const size_t kStagingCapacity = 32u << 20;
+const size_t kStagingFrameBytes = 8u << 20;  // staged per frame at most, so big assets spread out
+const size_t kStagingChunk = 1u << 20;  // uploads stage this much at a time
+const size_t kStagingAlignment = 64;
+
+// Upload memory shared by the loaders: a buffer the CPU writes assets into
+// and the GPU copies them out of, with glCopyBufferSubData for buffers and
+// as a pixel unpack buffer for textures. With GL 4.4 or ARB_buffer_storage
+// it is mapped once, persistent and coherent; on plain GL 3.3 each
+// allocation is mapped unsynchronized with glMapBufferRange and unmapped by
+// the copy that follows it. Every frame's allocations are fenced and the
+// space is reused once the GPU has passed the fence, so nothing ever waits
+// on the GPU: allocate fails instead and the caller tries next frame.
+// GL thread only, and destroy must run while the context is alive.
+class StagingRing {
+public:
+    StagingRing() = default;
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    bool create(size_t capacity = kStagingCapacity, size_t frameBytes = kStagingFrameBytes);
+    void destroy();
+
+    // Space for bytes at offset in the ring, or null when the ring or this
+    // frame's share of it is full. Write it before the next allocate.
+    unsigned char* allocate(size_t bytes, size_t& offset);
+
+    void copyToBuffer(size_t offset, size_t bytes, GLuint buffer, size_t bufferOffset);
+
+    // rows of width pixels of 8-bit format, tightly packed, into level from row y
+    void copyToTexture(size_t offset, GLuint texture, int level, int y, int width, int rows, GLenum format);
+
+    // bytes of blocks in compressed format covering rows of width pixels,
+    // into level from row y; y and rows are multiples of 4 except at the edge
+    void copyToCompressedTexture(size_t offset, size_t bytes, GLuint texture, int level, int y, int width, int rows,
+        GLenum format);
+
+    // The same into layer of a texture array, one whole level of width x
+    // height at a time
+    void copyToTextureLayer(size_t offset, GLuint texture, int level, int layer, int width, int height, GLenum format);
+    void copyToCompressedTextureLayer(size_t offset, size_t bytes, GLuint texture, int level, int layer, int width,
+        int height, GLenum format);
+
+    // Fences the copies issued since the last call and takes back the space
+    // of frames the GPU has finished. Call once per frame.
+    void endFrame();
+
+    bool persistent() const { return persistent_; }
+    size_t capacity() const { return capacity_; }
+    size_t bytesStaged() const { return bytesStaged_; }
+
+private:
+    struct Frame {
+        GLsync fence;
+        size_t bytes;  // allocated in the frame, including space skipped at the wrap
+    };
+
+    void unmap();
+
+    GLuint buffer_ = 0;
+    unsigned char* mapped_ = nullptr;  // whole ring when persistent, else the open allocation
+    bool persistent_ = false;
+    size_t capacity_ = 0;
+    size_t frameLimit_ = 0;
+    size_t head_ = 0;
+    size_t used_ = 0;        // allocated and not yet retired
+    size_t frameBytes_ = 0;  // allocated since the last endFrame
+    size_t bytesStaged_ = 0;
+    std::deque<Frame> frames_;
+};
+
+#endif
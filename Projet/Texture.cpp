@@ -0,0 +1,468 @@
+#include "Texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "BlockCompression.h"
+#include "FileUtil.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+ImageData::~ImageData() {
+    stbi_image_free(pixels);
+}
+
+size_t decodedImageSize(const unsigned char* data, size_t size, bool withMips) {
+    int width, height, channels;
+    if (size > (size_t)INT32_MAX || !stbi_info_from_memory(data, (int)size, &width, &height, &channels)) return 0;
+    return (size_t)width * height * channels + (withMips ? mipChainBytes(width, height, channels) : 0);
+}
+
+void buildMips(ImageData& image, unsigned threadCount) {
+    if (!image.pixels) return;
+    generateMips(image.pixels, image.width, image.height, image.channels, image.channels != 1, MipFilter::Kaiser,
+        image.mips, threadCount);
+}
+
+bool decodeImage(const char* path, const unsigned char* data, size_t size, ImageData& image) {
+    if (size <= (size_t)INT32_MAX) {
+        image.sourceHash = hashBytes(data, size);
+        image.pixels = stbi_load_from_memory(data, (int)size, &image.width, &image.height, &image.channels, 0);
+    }
+    if (!image.pixels) {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        return false;
+    }
+    printf("Texture loaded: %s size : (%d,%d)\n", path, image.width, image.height);
+    return true;
+}
+
+bool decodeImage(const char* path, ImageData& image) {
+    // Mapped so the hash and the decoder read the file once between them
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        return false;
+    }
+    return decodeImage(path, file.data(), file.size(), image);
+}
+
+CompressionSupport queryCompressionSupport() {
+    CompressionSupport support;
+    support.s3tc = GLEW_EXT_texture_compression_s3tc != 0;
+    support.bptc = GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+    return support;
+}
+
+bool compressedFormatSupported(GLenum format, const CompressionSupport& support) {
+    switch (format) {
+    case GL_COMPRESSED_RED_RGTC1: return true;
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return support.s3tc;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM: return support.bptc;
+    default: return false;
+    }
+}
+
+bool compressImage(const ImageData& image, const CompressionSupport& support, CompressedImage& compressed,
+    unsigned threadCount) {
+    if (!image.pixels) return false;
+
+    int channels = image.channels;
+    size_t texelCount = (size_t)image.width * image.height;
+    std::vector<unsigned char> level;
+    if (channels == 2) {
+        level.resize(texelCount * 4);
+        for (size_t i = 0; i < texelCount; i++) {
+            unsigned char grey = image.pixels[i * 2], alpha = image.pixels[i * 2 + 1];
+            level[i * 4] = level[i * 4 + 1] = level[i * 4 + 2] = grey;
+            level[i * 4 + 3] = alpha;
+        }
+        channels = 4;
+    }
+    else {
+        level.assign(image.pixels, image.pixels + texelCount * channels);
+    }
+
+    bool opaque = channels < 4;
+    if (!opaque) {
+        opaque = true;
+        for (size_t i = 3; i < level.size() && opaque; i += 4) opaque = level[i] == 255;
+    }
+
+    BlockFormat blockFormat;
+    GLenum format;
+    if (channels == 1) {
+        blockFormat = BlockFormat::BC4;
+        format = GL_COMPRESSED_RED_RGTC1;
+    }
+    else if (opaque && support.s3tc) {
+        blockFormat = BlockFormat::BC1;
+        format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+    else if (support.bptc) {
+        blockFormat = BlockFormat::BC7;
+        format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    else if (support.s3tc) {
+        blockFormat = BlockFormat::BC3;
+        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    else {
+        return false;
+    }
+
+    compressed.format = format;
+    compressed.channels = image.channels;
+    compressed.sourceHash = image.sourceHash;
+    compressed.levels.clear();
+    compressed.blocks.clear();
+
+    MipChain mips;
+    generateMips(level.data(), image.width, image.height, channels, channels != 1, MipFilter::Kaiser, mips,
+        threadCount);
+
+    for (size_t i = 0; i <= mips.levels.size(); i++) {
+        const MipLevel* mip = i > 0 ? &mips.levels[i - 1] : nullptr;
+        CompressedLevel info;
+        info.width = mip ? mip->width : image.width;
+        info.height = mip ? mip->height : image.height;
+        info.offset = compressed.blocks.size();
+        info.size = compressedSize(blockFormat, info.width, info.height);
+        compressed.levels.push_back(info);
+        compressed.blocks.resize(info.offset + info.size);
+        encodeBlocks(blockFormat, mip ? mips.texels.data() + mip->offset : level.data(), info.width, info.height,
+            channels, compressed.blocks.data() + info.offset, threadCount);
+    }
+    return true;
+}
+
+GLenum imageFormat(const ImageData& image) {
+    if (image.channels == 1) return GL_RED;
+    if (image.channels == 4) return GL_RGBA;
+    return GL_RGB;
+}
+
+// GL's default: every level glGenerateMipmap makes is sampled
+const GLint kAllLevels = 1000;
+
+static void setSampling(GLint maxLevel) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// Levels of image to upload: the pixels, then its CPU mips if it has them
+static size_t levelCount(const ImageData& image) {
+    return 1 + image.mips.levels.size();
+}
+
+const unsigned char* levelTexels(const ImageData& image, size_t level, int& width, int& height) {
+    if (level == 0) {
+        width = image.width;
+        height = image.height;
+        return image.pixels;
+    }
+    const MipLevel& mip = image.mips.levels[level - 1];
+    width = mip.width;
+    height = mip.height;
+    return image.mips.texels.data() + mip.offset;
+}
+
+static GLint maxLevel(const ImageData& image) {
+    return image.mips.levels.empty() ? kAllLevels : (GLint)image.mips.levels.size();
+}
+
+// Texture holding image, left bound
+static GLuint createTexture(const ImageData& image) {
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    if (image.pixels) {
+        GLenum format = imageFormat(image);
+
+        // Rows of RGB or single-channel images are not 4-byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < levelCount(image); i++) {
+            int width, height;
+            const unsigned char* texels = levelTexels(image, i, width, height);
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, format, width, height, 0, format, GL_UNSIGNED_BYTE, texels);
+        }
+    }
+    setSampling(maxLevel(image));
+    return textureID;
+}
+
+GLuint uploadTexture(const ImageData& image) {
+    GLuint texture = createTexture(image);
+    if (image.pixels && image.mips.levels.empty()) glGenerateMipmap(GL_TEXTURE_2D);
+    return texture;
+}
+
+// Every level of image specified, left bound
+static GLuint createTexture(const CompressedImage& image) {
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const CompressedLevel& level = image.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, image.format, level.width, level.height, 0, (GLsizei)level.size,
+            image.blocks.data() + level.offset);
+    }
+    setSampling(std::max<GLint>(0, (GLint)image.levels.size() - 1));
+    return textureID;
+}
+
+GLuint uploadTexture(const CompressedImage& image) {
+    return createTexture(image);
+}
+
+// Bytes a texel of format takes in video memory: drivers pad RGB to RGBA
+static size_t gpuTexelBytes(int channels) {
+    return channels == 3 ? 4 : channels;
+}
+
+TextureUpload::TextureUpload(std::shared_ptr<const ImageData> image)
+    : image_(std::move(image)) {
+    format_ = imageFormat(*image_);
+    if (image_->pixels) {
+        size_t texelBytes = gpuTexelBytes(image_->channels);
+        for (size_t i = 0; i < ::levelCount(*image_); i++) {
+            Level level;
+            levelTexels(*image_, i, level.width, level.height);
+            level.bytes = (size_t)level.width * level.height * texelBytes;
+            levels_.push_back(level);
+        }
+        generateMips_ = image_->mips.levels.empty();
+        if (generateMips_) levels_[0].bytes += mipChainBytes(image_->width, image_->height, (int)texelBytes);
+    }
+    resident_ = levelCount();
+
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    setSampling(maxLevel(*image_));
+}
+
+TextureUpload::TextureUpload(std::shared_ptr<const CompressedImage> image)
+    : compressed_(std::move(image)) {
+    format_ = compressed_->format;
+    blockFormat_ = true;
+    for (const CompressedLevel& source : compressed_->levels) {
+        Level level;
+        level.width = source.width;
+        level.height = source.height;
+        level.bytes = source.size;
+        levels_.push_back(level);
+    }
+    resident_ = levelCount();
+
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    setSampling(std::max(0, levelCount() - 1));
+}
+
+int TextureUpload::levelSize(int level) const {
+    return std::max(levels_[level].width, levels_[level].height);
+}
+
+int TextureUpload::levelFor(int size) const {
+    int level = 0;
+    while (level + 1 < levelCount() && levelSize(level) > size) level++;
+    return level;
+}
+
+size_t TextureUpload::allocatedBytes() const {
+    size_t bytes = 0;
+    for (int i = started_ ? resident_ - 1 : resident_; i < levelCount(); i++) {
+        bytes += levels_[i].bytes;
+    }
+    return bytes;
+}
+
+void TextureUpload::release() {
+    if (started_) return;
+    image_.reset();
+    compressed_.reset();
+}
+
+bool TextureUpload::attach(std::shared_ptr<const ImageData> image) {
+    if (!image || !image->pixels || imageFormat(*image) != format_ || ::levelCount(*image) != levels_.size() ||
+        image->width != levels_[0].width || image->height != levels_[0].height) {
+        return false;
+    }
+    image_ = std::move(image);
+    return true;
+}
+
+bool TextureUpload::attach(std::shared_ptr<const CompressedImage> image) {
+    if (!image || image->format != format_ || image->levels.size() != levels_.size() ||
+        image->width() != levels_[0].width || image->height() != levels_[0].height) {
+        return false;
+    }
+    compressed_ = std::move(image);
+    return true;
+}
+
+void TextureUpload::dropLevel() {
+    if (started_ || resident_ >= levelCount() - 1) return;
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, resident_ + 1);
+    // Respecified empty, the level gives its storage back
+    if (blockFormat_) glCompressedTexImage2D(GL_TEXTURE_2D, resident_, format_, 0, 0, 0, 0, nullptr);
+    else glTexImage2D(GL_TEXTURE_2D, resident_, format_, 0, 0, 0, format_, GL_UNSIGNED_BYTE, nullptr);
+    resident_++;
+}
+
+void TextureUpload::allocate(int level) {
+    const Level& size = levels_[level];
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    if (blockFormat_) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format_, size.width, size.height, 0, (GLsizei)size.bytes, nullptr);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, level, format_, size.width, size.height, 0, format_, GL_UNSIGNED_BYTE, nullptr);
+    }
+}
+
+bool TextureUpload::uploadBands(StagingRing& ring, int level) {
+    const Level& size = levels_[level];
+    const unsigned char* data;
+    size_t rowBytes;
+    int rowCount;
+    if (compressed_) {
+        const CompressedLevel& source = compressed_->levels[level];
+        rowCount = (size.height + 3) / 4;
+        rowBytes = source.size / rowCount;
+        data = compressed_->blocks.data() + source.offset;
+    }
+    else {
+        int width, height;
+        data = levelTexels(*image_, level, width, height);
+        rowBytes = (size_t)width * image_->channels;
+        rowCount = height;
+    }
+
+    int bandRows = (int)std::max<size_t>(1, kStagingChunk / rowBytes);
+    while (rowsDone_ < rowCount) {
+        int rows = std::min(bandRows, rowCount - rowsDone_);
+        size_t offset;
+        unsigned char* staging = ring.allocate(rows * rowBytes, offset);
+        if (!staging) return false;
+
+        std::memcpy(staging, data + rowsDone_ * rowBytes, rows * rowBytes);
+        if (compressed_) {
+            int y = rowsDone_ * 4;
+            ring.copyToCompressedTexture(offset, rows * rowBytes, texture_, level, y, size.width,
+                std::min(rows * 4, size.height - y), format_);
+        }
+        else {
+            ring.copyToTexture(offset, texture_, level, rowsDone_, size.width, rows, format_);
+        }
+        rowsDone_ += rows;
+    }
+    return true;
+}
+
+bool TextureUpload::step(StagingRing& ring, int target) {
+    while (resident_ > std::max(target, 0)) {
+        // Released between levels by whoever holds the upload; it must
+        // attach the image again first
+        if (!hasData()) return false;
+
+        int level = resident_ - 1;
+        if (!started_) {
+            allocate(level);
+            started_ = true;
+        }
+        if (!uploadBands(ring, level)) return false;
+
+        started_ = false;
+        rowsDone_ = 0;
+        resident_ = level;
+        glBindTexture(GL_TEXTURE_2D, texture_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        if (generateMips_) glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    return true;
+}
+
+void reuploadTexture(GLuint texture, const ImageData& image) {
+    if (!image.pixels) return;
+    GLenum format = imageFormat(image);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    GLint width = 0, height = 0, internalFormat = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+
+    // Same storage: no reallocation, and the mip chain keeps its levels
+    bool sameStorage = width == image.width && height == image.height && (GLenum)internalFormat == format;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < levelCount(image); i++) {
+        int levelWidth, levelHeight;
+        const unsigned char* texels = levelTexels(image, i, levelWidth, levelHeight);
+        if (sameStorage) {
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, levelWidth, levelHeight, format, GL_UNSIGNED_BYTE, texels);
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, format, levelWidth, levelHeight, 0, format, GL_UNSIGNED_BYTE, texels);
+        }
+    }
+    // The texture may have been uploaded compressed, with its own chain length
+    // and may have been streamed in only down to a coarser level
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel(image));
+    if (image.mips.levels.empty()) glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void reuploadTexture(GLuint texture, const CompressedImage& image) {
+    if (image.levels.empty()) return;
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    GLint width = 0, height = 0, internalFormat = 0, maxLevel = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+    bool sameStorage = width == image.width() && height == image.height() && (GLenum)internalFormat == image.format &&
+        maxLevel == (GLint)image.levels.size() - 1;
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const CompressedLevel& level = image.levels[i];
+        const unsigned char* blocks = image.blocks.data() + level.offset;
+        if (sameStorage) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, image.format,
+                (GLsizei)level.size, blocks);
+        }
+        else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, image.format, level.width, level.height, 0,
+                (GLsizei)level.size, blocks);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+}
+
+GLuint loadTexture(const char* path) {
+    ImageData image;
+    decodeImage(path, image);
+    return uploadTexture(image);
+}
+
+GLuint createSolidTexture(unsigned char r, unsigned char g, unsigned char b) {
+    unsigned char pixel[3] = { r, g, b };
+    ImageData image;
+    image.width = image.height = 1;
+    image.channels = 3;
+    image.pixels = pixel;
+    GLuint texture = uploadTexture(image);
+    image.pixels = nullptr;  // not owned by stb_image
+    return texture;
+}
@@ -0,0 +1,179 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "MipGenerator.h"
+#include "StagingRing.h"
+
+// Decoded 8-bit image, owned by stb_image
+struct ImageData {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* pixels = nullptr;
+    uint64_t sourceHash = 0;  // of the encoded file, set by decodeImage
+    MipChain mips;  // built on the CPU by buildMips; empty leaves it to glGenerateMipmap
+
+    ImageData() = default;
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+    ~ImageData();
+};
+
+// Safe to call from any thread
+bool decodeImage(const char* path, ImageData& image);
+
+// Same from encoded bytes already in memory; path only names the image in messages
+bool decodeImage(const char* path, const unsigned char* data, size_t size, ImageData& image);
+
+// Bytes decodeImage will allocate for an encoded image, from its header
+// alone, plus those of buildMips if withMips; 0 if the data is not an image
+// stbi can read
+size_t decodedImageSize(const unsigned char* data, size_t size, bool withMips = false);
+
+// GL format of the image's texels: GL_RED, GL_RGB or GL_RGBA
+GLenum imageFormat(const ImageData& image);
+
+// Texels of one level of image: the pixels for level 0, its CPU mips after
+const unsigned char* levelTexels(const ImageData& image, size_t level, int& width, int& height);
+
+// Fills image.mips with the Kaiser filter, in linear light for color
+// images (single-channel ones are taken as data). Safe to call from any
+// thread.
+void buildMips(ImageData& image, unsigned threadCount = 0);
+
+// Block-compressed image with its whole mip chain, as the importer makes
+// it and the KTX2 cache stores it
+struct CompressedLevel {
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;  // into blocks
+    size_t size = 0;
+};
+
+struct CompressedImage {
+    GLenum format = 0;  // GL_COMPRESSED_* internal format
+    int channels = 0;   // of the source image
+    std::vector<CompressedLevel> levels;  // level 0 first
+    std::vector<unsigned char> blocks;
+    uint64_t sourceHash = 0;  // of the encoded source file
+
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+};
+
+// Block formats the context can sample. RGTC is core since GL 3.0; S3TC
+// (BC1, BC3) and BPTC (BC7) are extensions. GL thread only.
+struct CompressionSupport {
+    bool s3tc = false;
+    bool bptc = false;
+};
+
+CompressionSupport queryCompressionSupport();
+
+bool compressedFormatSupported(GLenum format, const CompressionSupport& support);
+
+// Builds the mip chain of image and block-compresses every level: RGTC1
+// for one channel, BC1 when there is no alpha or it is all opaque, else BC7
+// where supported and BC3 otherwise. Grey-alpha images are expanded to
+// RGBA first. False, leaving compressed untouched, when the context
+// samples no format that fits. Safe to call from any thread; the blocks are
+// encoded on threadCount threads, 0 for one per core.
+bool compressImage(const ImageData& image, const CompressionSupport& support, CompressedImage& compressed,
+    unsigned threadCount = 0);
+
+// GL thread only; returns a mipmapped, repeating texture (empty if image
+// has no pixels) with the image's own mips, or ones glGenerateMipmap makes
+GLuint uploadTexture(const ImageData& image);
+
+// Same from a compressed image: its levels are uploaded as they are, so no
+// mips are generated
+GLuint uploadTexture(const CompressedImage& image);
+
+// Streamed form of uploadTexture through a StagingRing, a mip level at a
+// time from the smallest, so a texture can be drawn from its small levels
+// while the large ones are still on their way. The constructor makes the
+// texture with no storage. step allocates each level as it starts, stages
+// its rows (block rows when compressed) in bands, copies them in from the
+// ring as a pixel unpack buffer, as many as the ring takes this frame, and
+// lowers GL_TEXTURE_BASE_LEVEL to every level it completes. An image
+// without CPU mips is one level, mipmapped by glGenerateMipmap once it is
+// in. Between levels the image can be released and attached again later,
+// so a texture that stays partly resident need not keep its data, and the
+// finest levels can be dropped again to free their memory. GL thread only.
+class TextureUpload {
+public:
+    explicit TextureUpload(std::shared_ptr<const ImageData> image);
+    explicit TextureUpload(std::shared_ptr<const CompressedImage> image);
+
+    // Uploads levels until target and those below it are resident; false
+    // if the ring filled first
+    bool step(StagingRing& ring, int target = 0);
+    GLuint texture() const { return texture_; }
+
+    int levelCount() const { return (int)levels_.size(); }
+    // Finest level uploaded so far, levelCount() before the first
+    int resident() const { return resident_; }
+    // A level is partly uploaded: the data cannot be released yet
+    bool inProgress() const { return started_; }
+
+    // Finest level at most size texels across, the 1x1 level if none is
+    int levelFor(int size) const;
+    // Width or height of a level, whichever is larger
+    int levelSize(int level) const;
+    // Video memory of a level, with the chain glGenerateMipmap adds to a
+    // one-level image
+    size_t levelBytes(int level) const { return levels_[level].bytes; }
+    // Video memory of the levels allocated so far
+    size_t allocatedBytes() const;
+
+    // Frees the finest resident level and raises GL_TEXTURE_BASE_LEVEL past
+    // it; the coarsest level always stays, and nothing is dropped while a
+    // level is in progress. step uploads the level again when asked.
+    void dropLevel();
+
+    bool hasData() const { return image_ || compressed_; }
+    // Does nothing while a level is in progress
+    void release();
+    // False, leaving the upload without data, if image does not have the
+    // levels and format the upload was made for
+    bool attach(std::shared_ptr<const ImageData> image);
+    bool attach(std::shared_ptr<const CompressedImage> image);
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        size_t bytes = 0;
+    };
+
+    void allocate(int level);
+    bool uploadBands(StagingRing& ring, int level);
+
+    std::shared_ptr<const ImageData> image_;
+    std::shared_ptr<const CompressedImage> compressed_;
+    std::vector<Level> levels_;
+    GLenum format_ = 0;
+    bool blockFormat_ = false;  // format_ is compressed
+    bool generateMips_ = false;
+    GLuint texture_ = 0;
+    int resident_ = 0;
+    bool started_ = false;
+    int rowsDone_ = 0;  // pixel rows or block rows of the level after resident_
+};
+
+// GL thread only; replaces the contents of a texture made by uploadTexture,
+// keeping its name so everything that holds it sees the new image
+void reuploadTexture(GLuint texture, const ImageData& image);
+void reuploadTexture(GLuint texture, const CompressedImage& image);
+
+GLuint loadTexture(const char* path);
+
+// GL thread only; 1x1 texture of one color for materials without a map
+GLuint createSolidTexture(unsigned char r, unsigned char g, unsigned char b);
+
+#endif
@@ -0,0 +1,214 @@
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <cstring>
+
+static bool fitsLayerSize(int width, int height) {
+    auto powerOfTwo = [](int side) { return side > 0 && side <= kArrayMaxLayerSize && (side & (side - 1)) == 0; };
+    return powerOfTwo(width) && powerOfTwo(height);
+}
+
+// Levels from width x height down to 1x1
+static int chainLength(int width, int height) {
+    int levels = 1;
+    for (int side = std::max(width, height); side > 1; side >>= 1) levels++;
+    return levels;
+}
+
+bool fitsLayer(const ImageData& image) {
+    // Grey-alpha has no format of its own here (imageFormat uploads it as RGB)
+    return image.pixels && fitsLayerSize(image.width, image.height) && image.channels != 2 &&
+        image.mips.levels.size() == (size_t)chainLength(image.width, image.height) - 1;
+}
+
+bool fitsLayer(const CompressedImage& image) {
+    return fitsLayerSize(image.width(), image.height()) &&
+        image.levels.size() == (size_t)chainLength(image.width(), image.height());
+}
+
+// Repeating and trilinear, as 2D textures are
+static void setSampling(int levels) {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+TextureArray::TextureArray(const ImageData& image)
+    : format_(imageFormat(image)), width_(image.width), height_(image.height),
+      levels_(chainLength(image.width, image.height)), used_(kArrayLayers, false) {
+    glGenTextures(1, &id_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+    // Drivers store RGB with a padding byte
+    size_t texel = image.channels == 3 ? 4 : (size_t)image.channels;
+    for (int i = 0; i < levels_; i++) {
+        int width, height;
+        levelTexels(image, i, width, height);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, i, format_, width, height, kArrayLayers, 0, format_, GL_UNSIGNED_BYTE,
+            nullptr);
+        bytes_ += (size_t)width * height * texel * kArrayLayers;
+    }
+    setSampling(levels_);
+}
+
+TextureArray::TextureArray(const CompressedImage& image)
+    : format_(image.format), compressed_(true), width_(image.width()), height_(image.height()),
+      levels_((int)image.levels.size()), used_(kArrayLayers, false) {
+    glGenTextures(1, &id_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+    for (int i = 0; i < levels_; i++) {
+        const CompressedLevel& level = image.levels[i];
+        size_t bytes = level.size * kArrayLayers;
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, format_, level.width, level.height, kArrayLayers, 0,
+            (GLsizei)bytes, nullptr);
+        bytes_ += bytes;
+    }
+    setSampling(levels_);
+}
+
+TextureArray::~TextureArray() {
+    glDeleteTextures(1, &id_);
+}
+
+bool TextureArray::accepts(const ImageData& image) const {
+    return !compressed_ && fitsLayer(image) && image.width == width_ && image.height == height_ &&
+        imageFormat(image) == format_;
+}
+
+bool TextureArray::accepts(const CompressedImage& image) const {
+    return compressed_ && fitsLayer(image) && image.width() == width_ && image.height() == height_ &&
+        image.format == format_;
+}
+
+int TextureArray::allocateLayer() {
+    for (int i = 0; i < kArrayLayers; i++) {
+        if (!used_[i]) {
+            used_[i] = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TextureArray::releaseLayer(int layer) {
+    used_[layer] = false;
+}
+
+int TextureArray::layersUsed() const {
+    int count = 0;
+    for (bool used : used_) count += used;
+    return count;
+}
+
+template <typename Image>
+TextureLayer TextureArrayPool::allocateLayer(const Image& image) {
+    TextureLayer result;
+    for (auto it = arrays_.begin(); it != arrays_.end();) {
+        std::shared_ptr<TextureArray> array = it->lock();
+        if (!array) {
+            it = arrays_.erase(it);
+            continue;
+        }
+        if (array->accepts(image)) {
+            result.layer = array->allocateLayer();
+            if (result.layer >= 0) {
+                result.array = array;
+                return result;
+            }
+        }
+        ++it;
+    }
+    result.array = std::make_shared<TextureArray>(image);
+    result.layer = result.array->allocateLayer();
+    arrays_.push_back(result.array);
+    return result;
+}
+
+TextureLayer TextureArrayPool::allocate(const ImageData& image) {
+    return allocateLayer(image);
+}
+
+TextureLayer TextureArrayPool::allocate(const CompressedImage& image) {
+    return allocateLayer(image);
+}
+
+size_t TextureArrayPool::arrayCount() const {
+    size_t count = 0;
+    for (const auto& array : arrays_) {
+        if (!array.expired()) count++;
+    }
+    return count;
+}
+
+size_t TextureArrayPool::bytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : arrays_) {
+        if (std::shared_ptr<TextureArray> array = entry.lock()) bytes += array->bytes();
+    }
+    return bytes;
+}
+
+void uploadLayer(const TextureLayer& layer, const ImageData& image) {
+    GLenum format = imageFormat(image);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layer.array->id());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < layer.array->levels(); i++) {
+        int width, height;
+        const unsigned char* texels = levelTexels(image, i, width, height);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer.layer, width, height, 1, format, GL_UNSIGNED_BYTE,
+            texels);
+    }
+}
+
+void uploadLayer(const TextureLayer& layer, const CompressedImage& image) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layer.array->id());
+    for (int i = 0; i < layer.array->levels(); i++) {
+        const CompressedLevel& level = image.levels[i];
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer.layer, level.width, level.height, 1,
+            image.format, (GLsizei)level.size, image.blocks.data() + level.offset);
+    }
+}
+
+LayerUpload::LayerUpload(TextureLayer layer, std::shared_ptr<const ImageData> image)
+    : layer_(std::move(layer)), image_(std::move(image)) {
+}
+
+LayerUpload::LayerUpload(TextureLayer layer, std::shared_ptr<const CompressedImage> image)
+    : layer_(std::move(layer)), compressed_(std::move(image)) {
+}
+
+bool LayerUpload::step(StagingRing& ring) {
+    // A layer's largest level is at most kStagingChunk (512 x 512 RGBA), so
+    // levels go whole
+    for (; level_ < layer_.array->levels(); level_++) {
+        int width, height;
+        const unsigned char* data;
+        size_t bytes;
+        if (compressed_) {
+            const CompressedLevel& level = compressed_->levels[level_];
+            width = level.width;
+            height = level.height;
+            data = compressed_->blocks.data() + level.offset;
+            bytes = level.size;
+        }
+        else {
+            data = levelTexels(*image_, level_, width, height);
+            bytes = (size_t)width * height * image_->channels;
+        }
+
+        size_t offset;
+        unsigned char* staging = ring.allocate(bytes, offset);
+        if (!staging) return false;
+        std::memcpy(staging, data, bytes);
+        if (compressed_) {
+            ring.copyToCompressedTextureLayer(offset, bytes, layer_.array->id(), level_, layer_.layer, width, height,
+                layer_.array->format());
+        }
+        else {
+            ring.copyToTextureLayer(offset, layer_.array->id(), level_, layer_.layer, width, height,
+                layer_.array->format());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "StagingRing.h"
+#include "Texture.h"
+
+// Maps with power-of-two sides no larger than this are packed, at their
+// own size, as layers of texture arrays holding maps of the same size and
+// format, so the small maps of a scene draw without binding a texture each.
+// Other maps keep textures of their own; none are resized.
+const int kArrayMaxLayerSize = 512;
+const int kArrayLayers = 16;
+
+// Whether image can be a layer: power-of-two sides of at most
+// kArrayMaxLayerSize, a full mip chain and a format arrays take. GL thread
+// not needed.
+bool fitsLayer(const ImageData& image);
+bool fitsLayer(const CompressedImage& image);
+
+// One GL_TEXTURE_2D_ARRAY of kArrayLayers layers of one size, with full
+// mip chains, in one format. Deleted with its last handle, so handles must
+// not outlive the GL context. GL thread only.
+class TextureArray {
+public:
+    // Storage for images of image's size and format, which must fit a layer
+    explicit TextureArray(const ImageData& image);
+    explicit TextureArray(const CompressedImage& image);
+    ~TextureArray();
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    GLuint id() const { return id_; }
+    GLenum format() const { return format_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int levels() const { return levels_; }
+
+    // Whether image has the size and format of this array's layers
+    bool accepts(const ImageData& image) const;
+    bool accepts(const CompressedImage& image) const;
+
+    // A free layer, or -1 when all are taken
+    int allocateLayer();
+    void releaseLayer(int layer);
+    int layersUsed() const;
+
+    // Video memory of the whole array, free layers included
+    size_t bytes() const { return bytes_; }
+
+private:
+    GLuint id_ = 0;
+    GLenum format_ = 0;
+    bool compressed_ = false;
+    int width_ = 0;
+    int height_ = 0;
+    int levels_ = 0;
+    size_t bytes_ = 0;
+    std::vector<bool> used_;
+};
+
+// Where a packed texture lives
+struct TextureLayer {
+    std::shared_ptr<TextureArray> array;
+    int layer = -1;
+};
+
+// Hands out array layers, opening a new array when those of the size and
+// format are full. Holds the arrays weakly: an array goes with the last
+// texture in it. GL thread only.
+class TextureArrayPool {
+public:
+    // A free layer of an array that accepts image
+    TextureLayer allocate(const ImageData& image);
+    TextureLayer allocate(const CompressedImage& image);
+
+    size_t arrayCount() const;
+    size_t bytes() const;
+
+private:
+    template <typename Image>
+    TextureLayer allocateLayer(const Image& image);
+
+    std::vector<std::weak_ptr<TextureArray>> arrays_;
+};
+
+// GL thread only; fills the layer's levels from image, which it must accept
+void uploadLayer(const TextureLayer& layer, const ImageData& image);
+void uploadLayer(const TextureLayer& layer, const CompressedImage& image);
+
+// Streamed form of uploadLayer through a StagingRing: each step stages as
+// many whole levels as the ring takes this frame, largest first, and the
+// layer is complete once step returns true. GL thread only.
+class LayerUpload {
+public:
+    LayerUpload(TextureLayer layer, std::shared_ptr<const ImageData> image);
+    LayerUpload(TextureLayer layer, std::shared_ptr<const CompressedImage> image);
+
+    bool step(StagingRing& ring);
+    const TextureLayer& layer() const { return layer_; }
+
+private:
+    TextureLayer layer_;
+    std::shared_ptr<const ImageData> image_;
+    std::shared_ptr<const CompressedImage> compressed_;
+    int level_ = 0;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "TextureCache.h"
+
+#include <cstdio>
+#include "FileUtil.h"
+#include "KtxCache.h"
+
+GpuTexture::~GpuTexture() {
+    if (packed.array) packed.array->releaseLayer(packed.layer);
+    else glDeleteTextures(1, &id);
+}
+
+TextureInfo describeTexture(const ImageData& image) {
+    TextureInfo info;
+    info.sourceHash = image.sourceHash;
+    if (!image.pixels) return info;
+    info.width = image.width;
+    info.height = image.height;
+    info.channels = image.channels;
+    // Drivers store RGB with a padding byte; the mip chain adds a third
+    size_t texel = image.channels == 3 ? 4 : (size_t)image.channels;
+    info.bytes = (size_t)image.width * image.height * texel * 4 / 3;
+    return info;
+}
+
+TextureInfo describeTexture(const CompressedImage& image) {
+    TextureInfo info;
+    info.sourceHash = image.sourceHash;
+    info.width = image.width();
+    info.height = image.height();
+    info.channels = image.channels;
+    info.bytes = image.blocks.size();
+    return info;
+}
+
+static void describe(GpuTexture& texture, const TextureInfo& info) {
+    texture.sourceHash = info.sourceHash;
+    texture.width = info.width;
+    texture.height = info.height;
+    texture.channels = info.channels;
+    texture.bytes = info.bytes;
+}
+
+TextureHandle TextureCache::acquire(const std::string& path) {
+    if (TextureHandle texture = find(path)) return texture;
+
+    // The loader's import, on this thread
+    CompressionSupport support = queryCompressionSupport();
+    CompressedImage compressed;
+    ImageData image;
+    bool isCompressed = readKtxCache(path, support, compressed);
+    if (!isCompressed) {
+        if (!decodeImage(path.c_str(), image)) return nullptr;
+        isCompressed = compressImage(image, support, compressed);
+        if (isCompressed) writeKtxCache(path, compressed);
+        else buildMips(image);
+    }
+
+    TextureInfo info = isCompressed ? describeTexture(compressed) : describeTexture(image);
+    if (TextureHandle texture = findContent(path, info)) return texture;
+    return add(path, isCompressed ? uploadTexture(compressed) : uploadTexture(image), info);
+}
+
+TextureHandle TextureCache::find(const std::string& path) {
+    requests_++;
+    auto byPath = byPath_.find(canonicalPath(path));
+    if (byPath == byPath_.end()) return nullptr;
+    TextureHandle texture = byPath->second.lock();
+    if (texture) {
+        pathHits_++;
+        bytesSaved_ += texture->bytes;
+    }
+    return texture;
+}
+
+// Same bytes under another path: alias it instead of uploading again
+TextureHandle TextureCache::findContent(const std::string& path, const TextureInfo& info) {
+    if (!info.width) return nullptr;
+    auto byHash = byHash_.find(info.sourceHash);
+    if (byHash == byHash_.end()) return nullptr;
+    TextureHandle texture = byHash->second.lock();
+    if (!texture) return nullptr;
+
+    hashHits_++;
+    bytesSaved_ += texture->bytes;
+    byPath_[canonicalPath(path)] = texture;
+    return texture;
+}
+
+TextureHandle TextureCache::add(const std::string& path, const TextureLayer& layer, const TextureInfo& info) {
+    TextureHandle texture = add(path, layer.array->id(), info);
+    texture->packed = layer;
+    return texture;
+}
+
+TextureHandle TextureCache::add(const std::string& path, GLuint id, const TextureInfo& info) {
+    std::string key = canonicalPath(path);
+    TextureHandle texture = std::make_shared<GpuTexture>();
+    texture->id = id;
+    texture->path = key;
+    describe(*texture, info);
+    uploads_++;
+
+    byPath_[key] = texture;
+    if (info.width) byHash_[info.sourceHash] = texture;
+    return texture;
+}
+
+void TextureCache::countShared(const GpuTexture& texture) {
+    pathHits_++;
+    bytesSaved_ += texture.bytes;
+}
+
+bool TextureCache::retarget(const std::string& path, const TextureInfo& info, TextureHandle& texture) {
+    std::string key = canonicalPath(path);
+    auto byPath = byPath_.find(key);
+    texture = byPath != byPath_.end() ? byPath->second.lock() : nullptr;
+    if (!texture || !info.width || info.sourceHash == texture->sourceHash) return false;
+
+    // As for meshes: other paths that aliased the old bytes load again on
+    // their next request, while materials holding the handle follow the edit
+    for (auto entry = byPath_.begin(); entry != byPath_.end();) {
+        if (entry->first != key && entry->second.lock() == texture) entry = byPath_.erase(entry);
+        else ++entry;
+    }
+    byHash_.erase(texture->sourceHash);
+    describe(*texture, info);
+    byHash_[info.sourceHash] = texture;
+    return true;
+}
+
+template <typename Image>
+static void reupload(GpuTexture& texture, const Image& image) {
+    if (!texture.packed.array) {
+        reuploadTexture(texture.id, image);
+    }
+    else if (texture.packed.array->accepts(image)) {
+        uploadLayer(texture.packed, image);
+    }
+    else {
+        texture.packed.array->releaseLayer(texture.packed.layer);
+        texture.packed = TextureLayer();
+        texture.id = uploadTexture(image);
+    }
+}
+
+TextureHandle TextureCache::reload(const std::string& path, const ImageData& image) {
+    TextureHandle texture;
+    if (retarget(path, describeTexture(image), texture)) reupload(*texture, image);
+    return texture;
+}
+
+TextureHandle TextureCache::reload(const std::string& path, const CompressedImage& image) {
+    TextureHandle texture;
+    if (retarget(path, describeTexture(image), texture)) reupload(*texture, image);
+    return texture;
+}
+
+size_t TextureCache::liveCount() const {
+    size_t count = 0;
+    for (const auto& entry : byHash_) {
+        if (!entry.second.expired()) count++;
+    }
+    return count;
+}
+
+size_t TextureCache::packedCount() const {
+    size_t count = 0;
+    for (const auto& entry : byHash_) {
+        TextureHandle texture = entry.second.lock();
+        if (texture && texture->packed.array) count++;
+    }
+    return count;
+}
+
+size_t TextureCache::gpuBytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : byHash_) {
+        if (TextureHandle texture = entry.second.lock()) bytes += texture->bytes;
+    }
+    return bytes;
+}
+
+void TextureCache::printStats() const {
+    size_t hits = pathHits_ + hashHits_;
+    printf("Texture cache: %zu requests, %zu hits (%.1f%%: %zu by path, %zu by content), %zu uploads, "
+        "%zu live textures (%zu packed into arrays), %.2f MB on GPU, %.2f MB saved\n",
+        requests_, hits, requests_ ? 100.0 * hits / requests_ : 0.0, pathHits_, hashHits_, uploads_,
+        liveCount(), packedCount(), gpuBytes() / (1024.0 * 1024.0), bytesSaved_ / (1024.0 * 1024.0));
+}
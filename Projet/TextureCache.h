@@ -0,0 +1,102 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Texture.h"
+#include "TextureArray.h"
+
+// One GL texture, or one layer of a texture array, shared by every material
+// and object that uses the file. The texture (or the layer) is released
+// with the last handle, so handles must not outlive the GL context.
+struct GpuTexture {
+    GLuint id = 0;  // the texture's own, or the array's when packed
+    TextureLayer packed;  // the array layer holding the texture, if any
+    std::string path;
+    uint64_t sourceHash = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    size_t bytes = 0;  // on the GPU, mips included; only the levels streamed in so far
+
+    // Largest size on screen, in pixels across, the texture was drawn at
+    // since the streamer last looked; the renderer reports it every frame
+    float screenSize = 0.0f;
+    void requestScreenSize(float pixels) { screenSize = std::max(screenSize, pixels); }
+
+    GpuTexture() = default;
+    GpuTexture(const GpuTexture&) = delete;
+    GpuTexture& operator=(const GpuTexture&) = delete;
+    ~GpuTexture();
+};
+
+using TextureHandle = std::shared_ptr<GpuTexture>;
+
+// What the cache records of an image it uploads
+struct TextureInfo {
+    uint64_t sourceHash = 0;
+    int width = 0;  // 0 for an image that failed to load
+    int height = 0;
+    int channels = 0;
+    size_t bytes = 0;
+};
+
+TextureInfo describeTexture(const ImageData& image);
+TextureInfo describeTexture(const CompressedImage& image);
+
+// Hands out one texture per image file. Textures are looked up by
+// canonical path first and by the hash of the encoded file second, so a
+// copy of a file under another name shares the upload as well. Counts how
+// many requests were served without an upload and the bytes that saved.
+// GL thread only.
+class TextureCache {
+public:
+    // Loads (through the compressed cache, as the loader does) and uploads
+    // on the calling thread if the path is not cached
+    TextureHandle acquire(const std::string& path);
+
+    // Split form of acquire for loaders that decode elsewhere: find returns
+    // the live texture of path or null; once the image is loaded,
+    // findContent returns a live texture with the same file bytes (and files
+    // path under it) or null, and add registers the texture uploaded from
+    // the image info describes, taking ownership of it
+    TextureHandle find(const std::string& path);
+    TextureHandle findContent(const std::string& path, const TextureInfo& info);
+    TextureHandle add(const std::string& path, GLuint texture, const TextureInfo& info);
+    TextureHandle add(const std::string& path, const TextureLayer& layer, const TextureInfo& info);
+
+    // A request answered with a texture already in flight for the same path
+    void countShared(const GpuTexture& texture);
+
+    // Points path at image, re-uploaded into the texture's existing name,
+    // or its layer while the image still fits the array; a packed texture
+    // that no longer fits gets a texture of its own. Returns null if path
+    // has no live texture.
+    TextureHandle reload(const std::string& path, const ImageData& image);
+    TextureHandle reload(const std::string& path, const CompressedImage& image);
+
+    size_t liveCount() const;
+    size_t packedCount() const;
+    size_t gpuBytes() const;
+
+    void printStats() const;
+
+private:
+    // Sets texture to the live texture of path and, if info has other
+    // content, files the texture under it; true if it must be re-uploaded
+    bool retarget(const std::string& path, const TextureInfo& info, TextureHandle& texture);
+
+    std::unordered_map<std::string, std::weak_ptr<GpuTexture>> byPath_;
+    std::unordered_map<uint64_t, std::weak_ptr<GpuTexture>> byHash_;
+    size_t requests_ = 0;
+    size_t pathHits_ = 0;
+    size_t hashHits_ = 0;
+    size_t uploads_ = 0;
+    size_t bytesSaved_ = 0;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <vector>
+
+TextureStreamer::TextureStreamer(TextureCache& textures, ImportFn import, size_t budget)
+    : textures_(textures), import_(std::move(import)), budget_(budget) {
+}
+
+void TextureStreamer::add(const TextureHandle& texture, std::shared_ptr<TextureUpload> upload) {
+    texture->bytes = upload->allocatedBytes();
+    // An image that failed to load has no levels to manage
+    if (upload->levelCount() == 0) return;
+
+    Entry& entry = entries_[upload->texture()];
+    entry.texture = texture;
+    entry.tail = upload->levelFor(kStreamTailSize);
+    entry.wanted = upload->resident();
+    entry.upload = std::move(upload);
+    entry.sourceHash = texture->sourceHash;
+    entry.lastStep = entry.lastSeen = frame_;
+    entry.importing = false;
+    entry.importFailed = false;
+}
+
+void TextureStreamer::resume(GLuint texture, std::shared_ptr<const ImageData> image,
+    std::shared_ptr<const CompressedImage> compressed) {
+    auto it = entries_.find(texture);
+    if (it == entries_.end()) return;
+    Entry& entry = it->second;
+    entry.importing = false;
+
+    // Asking again would fail the same way every update; a reload that
+    // changes the file replaces the entry
+    uint64_t hash = compressed ? compressed->sourceHash : image ? image->sourceHash : 0;
+    bool attached = hash == entry.sourceHash &&
+        (compressed ? entry.upload->attach(std::move(compressed)) : entry.upload->attach(std::move(image)));
+    if (attached) {
+        entry.lastStep = frame_;
+    }
+    else {
+        entry.importFailed = true;
+        failedImports_++;
+    }
+}
+
+bool TextureStreamer::update(StagingRing& ring) {
+    frame_++;
+
+    struct Candidate {
+        Entry* entry;
+        TextureHandle texture;
+        float priority;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<Entry*> victims;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        Entry& entry = it->second;
+        TextureUpload& upload = *entry.upload;
+        // Deleted, or replaced whole by a reload
+        TextureHandle texture = entry.texture.lock();
+        if (!texture || texture->sourceHash != entry.sourceHash) {
+            it = entries_.erase(it);
+            continue;
+        }
+
+        float screenSize = texture->screenSize;
+        texture->screenSize = 0.0f;
+        if (screenSize > 0.0f) {
+            entry.lastSeen = frame_;
+            entry.wanted = upload.levelFor((int)std::min(screenSize * 2.0f, 65536.0f));
+        }
+        // A level already begun has its storage and goes first; textures out
+        // of sight keep what they have until the memory is wanted elsewhere
+        if (upload.inProgress()) {
+            candidates.push_back({ &entry, texture, FLT_MAX });
+        }
+        else if (entry.lastSeen == frame_ && entry.wanted < upload.resident() &&
+            (upload.hasData() || !entry.importFailed)) {
+            candidates.push_back({ &entry, texture, screenSize / upload.levelSize(upload.resident()) });
+        }
+        victims.push_back(&entry);
+        ++it;
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.priority > b.priority;
+    });
+    std::sort(victims.begin(), victims.end(), [](const Entry* a, const Entry* b) {
+        return a->lastSeen < b->lastSeen;
+    });
+    refining_ = candidates.size();
+
+    // Drops levels, least recently drawn textures first, until bytes more
+    // fit; false if they cannot
+    size_t used = textures_.gpuBytes();
+    size_t victim = 0;
+    auto makeRoom = [&](size_t bytes) {
+        while (used + bytes > budget_ && victim < victims.size()) {
+            Entry& entry = *victims[victim];
+            TextureUpload& upload = *entry.upload;
+            bool droppable = !upload.inProgress() && upload.resident() < entry.tail &&
+                (entry.lastSeen != frame_ || upload.resident() < entry.wanted);
+            if (!droppable) {
+                victim++;
+                continue;
+            }
+            size_t before = upload.allocatedBytes();
+            upload.dropLevel();
+            used -= before - upload.allocatedBytes();
+            if (TextureHandle texture = entry.texture.lock()) texture->bytes = upload.allocatedBytes();
+            levelsDropped_++;
+        }
+        return used + bytes <= budget_;
+    };
+    // Over budget already after a reload, or with a budget just lowered
+    makeRoom(0);
+
+    bool stalled = false, ringFull = false;
+    for (Candidate& candidate : candidates) {
+        Entry& entry = *candidate.entry;
+        TextureUpload& upload = *entry.upload;
+        int level = upload.resident() - 1;
+        if (!upload.inProgress() && !makeRoom(upload.levelBytes(level))) {
+            stalled = true;
+            continue;
+        }
+        if (!upload.hasData()) {
+            if (!entry.importing) {
+                entry.importing = true;
+                imports_++;
+                import_(candidate.texture->path, upload.texture());
+            }
+            continue;
+        }
+
+        size_t before = upload.allocatedBytes();
+        ringFull = !upload.step(ring, level);
+        size_t after = upload.allocatedBytes();
+        used += after - before;
+        candidate.texture->bytes = after;
+        entry.lastStep = frame_;
+        if (upload.resident() == level) levelsStreamed_++;
+        if (ringFull) break;
+    }
+    if (stalled) budgetStalls_++;
+
+    // Data no upload has used for a while goes back to the decode budget
+    for (auto& it : entries_) {
+        Entry& entry = it.second;
+        if (entry.upload->hasData() && frame_ - entry.lastStep >= kStreamIdleFrames) entry.upload->release();
+    }
+    return !ringFull;
+}
+
+size_t TextureStreamer::residentBytes() const {
+    size_t bytes = 0;
+    for (const auto& it : entries_) {
+        bytes += it.second.upload->allocatedBytes();
+    }
+    return bytes;
+}
+
+void TextureStreamer::printStats() const {
+    size_t withData = 0;
+    for (const auto& it : entries_) {
+        if (it.second.upload->hasData()) withData++;
+    }
+    size_t total = textures_.gpuBytes(), streamed = residentBytes();
+    printf("Texture residency: %zu streamed textures (%zu refining, %zu holding data), %.2f MB resident "
+        "+ %.2f MB not streamed, of %.0f MB budget; %zu levels streamed, %zu dropped, %zu re-imports "
+        "(%zu failed), %zu budget stalls\n",
+        entries_.size(), refining_, withData, streamed / (1024.0 * 1024.0),
+        (total > streamed ? total - streamed : 0) / (1024.0 * 1024.0), budget_ / (1024.0 * 1024.0), levelsStreamed_,
+        levelsDropped_, imports_, failedImports_, budgetStalls_);
+}
+
+void TextureStreamer::printResidency() const {
+    printStats();
+    for (const auto& it : entries_) {
+        const Entry& entry = it.second;
+        const TextureUpload& upload = *entry.upload;
+        TextureHandle texture = entry.texture.lock();
+        if (!texture) continue;
+        // The finest level allocated is resident or on its way
+        int finest = upload.inProgress() ? upload.resident() - 1 : upload.resident();
+        printf("  %s: level %d of %d (%d texels across), %.2f MB; wants level %d, level 0 is %.2f MB; "
+            "drawn %u updates ago\n",
+            texture->path.c_str(), finest, upload.levelCount(), upload.levelSize(finest),
+            upload.allocatedBytes() / (1024.0 * 1024.0), entry.wanted, upload.levelBytes(0) / (1024.0 * 1024.0),
+            frame_ - entry.lastSeen);
+    }
+}
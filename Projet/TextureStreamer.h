@@ -0,0 +1,100 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "StagingRing.h"
+#include "Texture.h"
+#include "TextureCache.h"
+
+// Video memory the textures in the cache are kept within by default
+const size_t kTextureBudget = 512u << 20;
+
+// Levels at most this many texels across upload with the texture, before
+// it is first handed out, and are never dropped
+const int kStreamTailSize = 64;
+
+// Updates a texture may go without uploading before it lets go of its data
+const unsigned kStreamIdleFrames = 30;
+
+// Manages which mip levels of the streamed textures are resident, a level
+// at a time, for as long as each texture lives. Each update looks at how
+// large every texture was last drawn on screen, wants the level with
+// texels no coarser than half a pixel there (surfaces often map only part
+// of a texture), and uploads one finer level to the textures furthest
+// from theirs first. The textures in the cache are kept within the
+// budget: when a level does not fit, the finest levels of the textures
+// drawn least recently, then of those resident finer than they are drawn,
+// are dropped down to their tail until it does. A texture that has not
+// uploaded for kStreamIdleFrames releases its image data back to the
+// decode budget, and asks for it again through import when it needs
+// levels back: a read of the KTX2 cache for compressed textures. A texture
+// whose import fails keeps the levels it has and is not refined again until
+// a reload replaces it. GL thread only.
+class TextureStreamer {
+public:
+    // Imports path again on a worker and hands the result to resume
+    using ImportFn = std::function<void(const std::string& path, GLuint texture)>;
+
+    TextureStreamer(TextureCache& textures, ImportFn import, size_t budget = kTextureBudget);
+
+    // Takes over upload, whose tail is resident, for the life of texture
+    void add(const TextureHandle& texture, std::shared_ptr<TextureUpload> upload);
+
+    // The data asked for by import, either image or compressed; dropped if
+    // the file has changed since, as a reload then replaces the texture.
+    // Data that is missing, changed or does not fit the upload fails the
+    // import.
+    void resume(GLuint texture, std::shared_ptr<const ImageData> image, std::shared_ptr<const CompressedImage> compressed);
+
+    // Drops and uploads levels as described above. Returns false when the
+    // staging ring filled.
+    bool update(StagingRing& ring);
+
+    // Takes effect at the next update, dropping levels if it shrank
+    void setBudget(size_t bytes) { budget_ = bytes; }
+    size_t budget() const { return budget_; }
+
+    // Streamed textures, and those of them short of their wanted level
+    size_t textureCount() const { return entries_.size(); }
+    size_t refiningCount() const { return refining_; }
+    // Video memory of the streamed textures' resident levels
+    size_t residentBytes() const;
+
+    void printStats() const;
+    // One line per streamed texture: its resident and wanted levels, their
+    // bytes and when it was last drawn
+    void printResidency() const;
+
+private:
+    struct Entry {
+        std::weak_ptr<GpuTexture> texture;
+        std::shared_ptr<TextureUpload> upload;
+        uint64_t sourceHash = 0;  // of the content the upload was made from
+        int tail = 0;             // finest level of the tail, which stays resident
+        int wanted = 0;           // for the size it was last drawn at
+        unsigned lastStep = 0;    // update that last uploaded to it
+        unsigned lastSeen = 0;    // update that last found it drawn
+        bool importing = false;
+        bool importFailed = false;  // stops refining until a reload replaces the texture
+    };
+
+    TextureCache& textures_;
+    ImportFn import_;
+    size_t budget_;
+    std::unordered_map<GLuint, Entry> entries_;
+    unsigned frame_ = 0;
+    size_t refining_ = 0;
+    size_t levelsStreamed_ = 0;
+    size_t levelsDropped_ = 0;
+    size_t imports_ = 0;
+    size_t failedImports_ = 0;
+    size_t budgetStalls_ = 0;  // updates where a wanted level did not fit
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+static thread_local ThreadPool* currentPool = nullptr;
+
+ThreadPool* ThreadPool::current() {
+    return currentPool;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        threadCount = std::max(1u, cores > 1 ? cores - 1 : 1u);
+    }
+    workers_.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        tasks_.clear();
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task, bool front) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (front) tasks_.push_front(std::move(task));
+        else tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    currentPool = this;
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if (stopping_) return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
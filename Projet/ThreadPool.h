@@ -0,0 +1,99 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued tasks in FIFO order.
+// Tasks still queued when the pool is destroyed are dropped.
+class ThreadPool {
+public:
+    // 0 picks one thread per core, leaving one for the GL thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // front puts the task ahead of those already queued, for work a
+    // running task waits on
+    void submit(std::function<void()> task, bool front = false);
+    unsigned size() const { return (unsigned)workers_.size(); }
+
+    // The pool whose worker is the calling thread, or null
+    static ThreadPool* current();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+// Calls fn(begin, end) over [0, count) in at most threadCount batches of at
+// least minBatch items each (0: one per core, or one per worker on a pool).
+// Off a pool each batch gets a thread of its own. On a pool worker no
+// thread is started: the batches are queued at the front of the worker's
+// pool and the calling worker takes them too, so idle workers share a large
+// import and busy ones leave the caller to do it alone, without ever
+// running more threads than the pool has.
+template <typename Fn>
+void parallelFor(size_t count, size_t minBatch, unsigned threadCount, Fn fn) {
+    ThreadPool* pool = ThreadPool::current();
+    if (threadCount == 0) threadCount = pool ? pool->size() : std::max(1u, std::thread::hardware_concurrency());
+    size_t batches = std::max<size_t>(1, std::min<size_t>(threadCount, count / std::max<size_t>(1, minBatch)));
+    if (batches == 1) {
+        fn((size_t)0, count);
+        return;
+    }
+
+    if (pool) {
+        // Batches are claimed in order by whoever gets there first. The
+        // caller claims every batch left, so it never waits on a queued
+        // task, only on batches other workers are running.
+        struct Shared {
+            std::atomic<size_t> next{ 0 };
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto shared = std::make_shared<Shared>();
+        Fn* body = &fn;
+        auto run = [shared, body, count, batches]() {
+            for (size_t b; (b = shared->next++) < batches;) {
+                (*body)(count * b / batches, count * (b + 1) / batches);
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (++shared->done == batches) shared->finished.notify_all();
+            }
+        };
+        for (size_t b = 1; b < batches; b++) {
+            pool->submit(run, true);
+        }
+        run();
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [&]() { return shared->done == batches; });
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(batches);
+    for (size_t b = 0; b < batches; b++) {
+        workers.emplace_back([&fn, count, batches, b]() { fn(count * b / batches, count * (b + 1) / batches); });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "VertexCodec.h"
+#include "LzCodec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEXCODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void write32(unsigned char* p, uint32_t v) { std::memcpy(p, &v, sizeof(v)); }
+
+inline uint32_t zigzag(uint32_t delta) { return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31); }
+inline uint32_t unzigzag(uint32_t code) { return (code >> 1) ^ (0u - (code & 1)); }
+
+// Words [firstWord, vertexSize / 4) of vertex v of the block starting at
+// vertex first, whose planes hold count vertices; vertex first + v - 1 must
+// be decoded already
+void decodeWords(unsigned char* out, const unsigned char* planes, size_t count, size_t vertexSize,
+    size_t first, size_t v, size_t firstWord) {
+    unsigned char* vertex = out + (first + v) * vertexSize;
+    for (size_t w = firstWord; w < vertexSize / 4; w++) {
+        const unsigned char* plane = planes + 4 * w * count + v;
+        uint32_t code = plane[0] | ((uint32_t)plane[count] << 8) | ((uint32_t)plane[2 * count] << 16) |
+            ((uint32_t)plane[3 * count] << 24);
+        uint32_t previous = first + v > 0 ? read32(vertex - vertexSize + 4 * w) : 0;
+        write32(vertex + 4 * w, previous + unzigzag(code));
+    }
+}
+
+#ifdef VERTEXCODEC_SSE2
+
+// Row i of the result holds byte i of every input row. Interleaving row r
+// with row r + 8 four times is a full 16x16 transpose.
+inline void transpose16x16(__m128i rows[16]) {
+    for (int round = 0; round < 4; round++) {
+        __m128i next[16];
+        for (int r = 0; r < 8; r++) {
+            next[2 * r] = _mm_unpacklo_epi8(rows[r], rows[r + 8]);
+            next[2 * r + 1] = _mm_unpackhi_epi8(rows[r], rows[r + 8]);
+        }
+        for (int r = 0; r < 16; r++) rows[r] = next[r];
+    }
+}
+
+#endif
+
+}  // namespace
+
+void encodeVertexBuffer(std::vector<unsigned char>& out, const void* vertices, size_t vertexCount, size_t vertexSize) {
+    const unsigned char* in = (const unsigned char*)vertices;
+    out.clear();
+    std::vector<unsigned char> planes, block;
+    for (size_t first = 0; first < vertexCount; first += kVertexCodecBlock) {
+        size_t count = std::min(kVertexCodecBlock, vertexCount - first);
+        planes.resize(count * vertexSize);
+        for (size_t v = 0; v < count; v++) {
+            // Deltas run on across blocks; decoding is in order anyway
+            const unsigned char* vertex = in + (first + v) * vertexSize;
+            for (size_t w = 0; w < vertexSize / 4; w++) {
+                uint32_t previous = first + v > 0 ? read32(vertex - vertexSize + 4 * w) : 0;
+                uint32_t code = zigzag(read32(vertex + 4 * w) - previous);
+                for (size_t b = 0; b < 4; b++) planes[(4 * w + b) * count + v] = (unsigned char)(code >> (8 * b));
+            }
+        }
+        compressLz(block, planes.data(), planes.size());
+        uint32_t blockSize = (uint32_t)block.size();
+        out.insert(out.end(), (const unsigned char*)&blockSize, (const unsigned char*)&blockSize + sizeof(blockSize));
+        out.insert(out.end(), block.begin(), block.end());
+    }
+}
+
+bool decodeVertexBuffer(void* vertices, size_t vertexCount, size_t vertexSize, const unsigned char* data, size_t size) {
+    if (vertexSize == 0 || vertexSize % 4 != 0) return false;
+    unsigned char* out = (unsigned char*)vertices;
+    const unsigned char* end = data + size;
+    std::vector<unsigned char> planes(std::min(kVertexCodecBlock, vertexCount) * vertexSize);
+
+    for (size_t first = 0; first < vertexCount; first += kVertexCodecBlock) {
+        size_t count = std::min(kVertexCodecBlock, vertexCount - first);
+        uint32_t blockSize;
+        if ((size_t)(end - data) < sizeof(blockSize)) return false;
+        std::memcpy(&blockSize, data, sizeof(blockSize));
+        data += sizeof(blockSize);
+        if ((size_t)(end - data) < blockSize) return false;
+        if (!decompressLz(planes.data(), count * vertexSize, data, blockSize)) return false;
+        data += blockSize;
+
+        size_t v = 0;
+#ifdef VERTEXCODEC_SSE2
+        // 16 planes by 16 vertices at a time: transpose, then a running sum
+        // down the vertices, four words per add
+        size_t blocks = vertexSize / 16;
+        const __m128i one = _mm_set1_epi32(1);
+        for (; v + 16 <= count; v += 16) {
+            for (size_t block = 0; block < blocks; block++) {
+                __m128i rows[16];
+                for (int i = 0; i < 16; i++) {
+                    rows[i] = _mm_loadu_si128((const __m128i*)(planes.data() + (block * 16 + i) * count + v));
+                }
+                transpose16x16(rows);
+
+                unsigned char* write = out + (first + v) * vertexSize + block * 16;
+                __m128i previous = first + v > 0 ? _mm_loadu_si128((const __m128i*)(write - vertexSize)) : _mm_setzero_si128();
+                for (int j = 0; j < 16; j++) {
+                    __m128i code = rows[j];
+                    __m128i delta = _mm_xor_si128(_mm_srli_epi32(code, 1),
+                        _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(code, one)));
+                    previous = _mm_add_epi32(previous, delta);
+                    _mm_storeu_si128((__m128i*)(write + j * vertexSize), previous);
+                }
+            }
+            for (size_t j = 0; j < 16; j++) decodeWords(out, planes.data(), count, vertexSize, first, v + j, blocks * 4);
+        }
+#endif
+        for (; v < count; v++) decodeWords(out, planes.data(), count, vertexSize, first, v, 0);
+    }
+    return data == end;
+}
@@ -0,0 +1,22 @@
+#ifndef VERTEXCODEC_H
+#define VERTEXCODEC_H
+
+#include <cstddef>
+#include <vector>
+
+// Vertex buffer codec for the mesh cache. Every 32-bit word of a vertex is
+// stored as the zig-zagged difference to the same word of the previous
+// vertex, and the result is split into byte planes (byte 0 of every
+// vertex, then byte 1, ...) so the mostly-zero high bytes of the deltas
+// form long runs. The planes then go through compressLz, in blocks of
+// kVertexCodecBlock vertices so a block's planes stay in cache while they
+// are decoded. vertexSize must be a multiple of 4.
+const size_t kVertexCodecBlock = 4096;
+
+void encodeVertexBuffer(std::vector<unsigned char>& out, const void* vertices, size_t vertexCount, size_t vertexSize);
+
+// Returns false if data is not an encoding of exactly vertexCount vertices
+// of vertexSize bytes. Transposes and sums 16 vertices at a time with SSE2.
+bool decodeVertexBuffer(void* vertices, size_t vertexCount, size_t vertexSize, const unsigned char* data, size_t size);
+
+#endif
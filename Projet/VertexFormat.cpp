@@ -0,0 +1,237 @@
+#include "VertexFormat.h"
+#include "Mesh.h"
+#include "MeshNormals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+inline float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+inline int16_t toSnorm(float v) {
+    return (int16_t)std::lround(std::max(-1.0f, std::min(1.0f, v)) * 32767.0f);
+}
+
+inline float fromSnorm(int16_t v) { return std::max(v / 32767.0f, -1.0f); }
+
+void octDecode(const int16_t e[2], float n[3]) {
+    float x = fromSnorm(e[0]), y = fromSnorm(e[1]);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+    if (z < 0.0f) {
+        float ox = x;
+        x = (1.0f - std::fabs(y)) * signNotZero(ox);
+        y = (1.0f - std::fabs(ox)) * signNotZero(y);
+    }
+    float length = std::sqrt(x * x + y * y + z * z);
+    n[0] = x / length;
+    n[1] = y / length;
+    n[2] = z / length;
+}
+
+inline float angleDegrees(const float a[3], const float b[3]) {
+    float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return std::acos(std::max(-1.0f, std::min(1.0f, d))) * 57.2957795f;
+}
+
+// Octahedral encoding, then the best of the four neighboring snorm values
+void octEncode(const float normal[3], int16_t e[2]) {
+    float n[3] = { normal[0], normal[1], normal[2] };
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0f) {
+        e[0] = e[1] = 0;
+        return;
+    }
+    for (float& c : n) c /= length;
+
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float x = n[0] / l1, y = n[1] / l1;
+    if (n[2] < 0.0f) {
+        float ox = x;
+        x = (1.0f - std::fabs(y)) * signNotZero(ox);
+        y = (1.0f - std::fabs(ox)) * signNotZero(y);
+    }
+
+    int baseX = (int)std::floor(std::max(-1.0f, std::min(1.0f, x)) * 32767.0f);
+    int baseY = (int)std::floor(std::max(-1.0f, std::min(1.0f, y)) * 32767.0f);
+    float bestError = 1e9f;
+    for (int dy = 0; dy <= 1; dy++) {
+        for (int dx = 0; dx <= 1; dx++) {
+            int16_t candidate[2] = { (int16_t)std::min(32767, baseX + dx), (int16_t)std::min(32767, baseY + dy) };
+            float decoded[3];
+            octDecode(candidate, decoded);
+            float error = angleDegrees(n, decoded);
+            if (error < bestError) {
+                bestError = error;
+                e[0] = candidate[0];
+                e[1] = candidate[1];
+            }
+        }
+    }
+}
+
+const float kTwoPi = 6.28318531f;
+
+// The tangent lies in the plane of the normal, so one angle in the basis of
+// the decoded normal is enough; the shader rebuilds the same basis
+uint16_t encodeTangent(const float decodedNormal[3], const float tangent[4]) {
+    float b1[3], b2[3];
+    tangentBasis(decodedNormal, b1, b2);
+    float x = tangent[0] * b1[0] + tangent[1] * b1[1] + tangent[2] * b1[2];
+    float y = tangent[0] * b2[0] + tangent[1] * b2[1] + tangent[2] * b2[2];
+    float turns = std::atan2(y, x) / kTwoPi;
+    if (turns < 0.0f) turns += 1.0f;
+    uint16_t code = (uint16_t)(std::lround(turns * 32768.0f) & 0x7FFF);
+    return (uint16_t)(code | (tangent[3] < 0.0f ? 0x8000 : 0));
+}
+
+void decodeTangent(const float decodedNormal[3], uint16_t code, float tangent[3]) {
+    float b1[3], b2[3];
+    tangentBasis(decodedNormal, b1, b2);
+    float angle = (code & 0x7FFF) * (kTwoPi / 32768.0f);
+    float c = std::cos(angle), s = std::sin(angle);
+    for (int i = 0; i < 3; i++) tangent[i] = c * b1[i] + s * b2[i];
+}
+
+}  // namespace
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+    int halfExponent = (int)exponent - 127 + 15;
+    if (halfExponent >= 31) return (uint16_t)(sign | 0x7C00);
+    if (halfExponent <= 0) {
+        // Subnormal half (or zero): shift the implicit bit in, round to nearest even
+        if (halfExponent < -10) return (uint16_t)sign;
+        mantissa |= 0x800000;
+        int shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    // A carry out of the mantissa correctly bumps the exponent (up to infinity)
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return (uint16_t)(sign | half);
+}
+
+float halfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            // Normalize the subnormal
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    }
+    else if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Sets the offset, scale and uv format of packed for the whole mesh
+static void choosePacking(const float* vertices, size_t vertexCount,
+    const float boundsMin[3], const float boundsMax[3], PackedMesh& packed) {
+    packed.error = QuantizationError();
+    for (int c = 0; c < 3; c++) {
+        packed.positionOffset[c] = boundsMin[c];
+        packed.positionScale[c] = boundsMax[c] - boundsMin[c];
+    }
+
+    packed.halfTexcoords = false;
+    for (size_t v = 0; v < vertexCount && !packed.halfTexcoords; v++) {
+        const float* uv = vertices + v * kVertexStride + kTexcoordOffset;
+        packed.halfTexcoords = uv[0] < 0.0f || uv[0] > 1.0f || uv[1] < 0.0f || uv[1] > 1.0f;
+    }
+}
+
+static void packVertexRange(const float* vertices, size_t vertexCount, PackedMesh& packed, PackedVertex* output) {
+    for (size_t v = 0; v < vertexCount; v++) {
+        const float* in = vertices + v * kVertexStride;
+        PackedVertex out;
+
+        for (int c = 0; c < 3; c++) {
+            float scale = packed.positionScale[c];
+            float offset = packed.positionOffset[c];
+            float t = scale > 0.0f ? (in[c] - offset) / scale : 0.0f;
+            out.position[c] = (uint16_t)std::lround(std::max(0.0f, std::min(1.0f, t)) * 65535.0f);
+            float decoded = offset + scale * (out.position[c] / 65535.0f);
+            packed.error.position = std::max(packed.error.position, std::fabs(decoded - in[c]));
+        }
+
+        octEncode(in + kNormalOffset, out.normal);
+        float decodedNormal[3];
+        octDecode(out.normal, decodedNormal);
+        float length = std::sqrt(in[3] * in[3] + in[4] * in[4] + in[5] * in[5]);
+        if (length > 0.0f) {
+            float n[3] = { in[3] / length, in[4] / length, in[5] / length };
+            packed.error.normalDegrees = std::max(packed.error.normalDegrees, angleDegrees(n, decodedNormal));
+        }
+
+        // Measured against the tangent made orthogonal to the decoded normal,
+        // which is all the encoding can keep
+        const float* tangent = in + kTangentOffset;
+        out.tangent = encodeTangent(decodedNormal, tangent);
+        float along = tangent[0] * decodedNormal[0] + tangent[1] * decodedNormal[1] + tangent[2] * decodedNormal[2];
+        float projected[3];
+        for (int c = 0; c < 3; c++) projected[c] = tangent[c] - decodedNormal[c] * along;
+        float projectedLength = std::sqrt(projected[0] * projected[0] + projected[1] * projected[1] + projected[2] * projected[2]);
+        if (projectedLength > 0.0f) {
+            for (float& c : projected) c /= projectedLength;
+            float decodedTangent[3];
+            decodeTangent(decodedNormal, out.tangent, decodedTangent);
+            packed.error.tangentDegrees = std::max(packed.error.tangentDegrees, angleDegrees(projected, decodedTangent));
+        }
+
+        for (int c = 0; c < 2; c++) {
+            float decoded;
+            if (packed.halfTexcoords) {
+                out.texcoord[c] = floatToHalf(in[kTexcoordOffset + c]);
+                decoded = halfToFloat(out.texcoord[c]);
+            }
+            else {
+                out.texcoord[c] = (uint16_t)std::lround(in[kTexcoordOffset + c] * 65535.0f);
+                decoded = out.texcoord[c] / 65535.0f;
+            }
+            packed.error.texcoord = std::max(packed.error.texcoord, std::fabs(decoded - in[kTexcoordOffset + c]));
+        }
+        output[v] = out;
+    }
+
+    float largestExtent = std::max(packed.positionScale[0], std::max(packed.positionScale[1], packed.positionScale[2]));
+    packed.error.positionRelative = largestExtent > 0.0f ? packed.error.position / largestExtent : 0.0f;
+}
+
+void packVertices(const float* vertices, size_t vertexCount,
+    const float boundsMin[3], const float boundsMax[3], PackedMesh& packed) {
+    choosePacking(vertices, vertexCount, boundsMin, boundsMax, packed);
+    packed.vertices.resize(vertexCount);
+    packVertexRange(vertices, vertexCount, packed, packed.vertices.data());
+}
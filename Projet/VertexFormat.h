@@ -0,0 +1,45 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 16-byte vertex uploaded instead of the 48-byte float layout
+struct PackedVertex {
+    uint16_t position[3];  // unorm over the mesh bounds
+    uint16_t tangent;      // angle around the decoded normal in 15 bits, bitangent sign in the top bit
+    int16_t normal[2];     // octahedral snorm
+    uint16_t texcoord[2];  // unorm when all uvs are in [0, 1], half floats otherwise
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex layout changed");
+
+// Largest round-trip error over all vertices
+struct QuantizationError {
+    float position = 0.0f;          // object space units
+    float positionRelative = 0.0f;  // fraction of the largest bounds extent
+    float normalDegrees = 0.0f;
+    float tangentDegrees = 0.0f;
+    float texcoord = 0.0f;
+};
+
+struct PackedMesh {
+    std::vector<PackedVertex> vertices;
+
+    // position = offset + scale * unorm, folded into the model matrix
+    float positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+    float positionScale[3] = { 1.0f, 1.0f, 1.0f };
+    bool halfTexcoords = false;
+
+    QuantizationError error;
+};
+
+// Packs kVertexStride float vertices (position, normal, texcoord, tangent)
+void packVertices(const float* vertices, size_t vertexCount,
+    const float boundsMin[3], const float boundsMax[3], PackedMesh& packed);
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+#endif
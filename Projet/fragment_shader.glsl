@@ -9,6 +9,9 @@ struct Light {
 
 struct Material {
     sampler2D diffuse; // Texture diffuse
+    sampler2DArray diffuseArray; // small maps, packed into layers
+    float diffuseLayer; // layer of diffuseArray holding the map, or negative for diffuse
+    vec3 diffuseColor; // multiplies the texture
     vec3 specular;
     float shininess;
 };
@@ -16,6 +19,7 @@ struct Material {
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord; // Coordonnes de texture reues du vertex shader
+in vec4 Tangent; // for normal maps: bitangent = Tangent.w * cross(Normal, Tangent.xyz)
 
 out vec4 FragColor;
 
@@ -25,12 +29,15 @@ uniform vec3 viewPos;
 
 void main() {
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoord).rgb + vec3(0.3f,0.3f,0.3f);
+    vec3 texel = material.diffuseLayer >= 0.0 ? texture(material.diffuseArray, vec3(TexCoord, material.diffuseLayer)).rgb
+                                              : texture(material.diffuse, TexCoord).rgb;
+    vec3 albedo = texel * material.diffuseColor;
+    vec3 ambient = light.ambient * albedo + vec3(0.3f,0.3f,0.3f);
 
     vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(light.position - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoord).rgb;
+    vec3 diffuse = light.diffuse * diff * albedo;
 
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
@@ -3,13 +3,23 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
-#include "tiny_obj_loader.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "AssetLoader.h"
+#include "Benchmark.h"
+#include "Culling.h"
+#include "FileWatcher.h"
+#include "MeshCache.h"
+#include "MeshRegistry.h"
+#include "StagingRing.h"
+#include "Texture.h"
+#include "TextureCache.h"
 
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -25,10 +35,39 @@ bool firstMouse = true;
 float deltaTime = 0.0f; 
 float lastFrame = 0.0f; 
 
-GLuint cubeVAO, cubeVBO, cubeEBO;
-GLuint HumanVAO, HumanVBO, HumanEBO;
-GLuint Wolf1VAO, Wolf1VBO, Wolf1EBO;
-GLuint Wolf2VAO, Wolf2VBO, Wolf2EBO;
+// An instance of a shared mesh placed in the scene
+struct SceneObject {
+    MeshHandle mesh;
+    glm::mat4 model;
+    glm::vec3 color;
+};
+
+// One submesh draw of a visible object, queued so the frame can be drawn
+// grouped by texture and material
+struct QueuedDraw {
+    GLuint texture;
+    GLenum target;  // GL_TEXTURE_2D_ARRAY for a map packed into an array
+    const GpuMaterial* material;
+    size_t object;  // into visibleObjects
+    const GpuDraw* draw;
+};
+
+// An object that passed the frustum test, with its culling inputs in model space
+struct VisibleObject {
+    const SceneObject* object;
+    Frustum frustum;
+    glm::vec3 eye;
+};
+
+MeshRegistry meshRegistry;
+TextureCache textureCache;
+StagingRing stagingRing;
+std::vector<SceneObject> scene;
+std::vector<VisibleObject> visibleObjects;
+std::vector<QueuedDraw> drawQueue;
+GpuMaterial defaultMaterial;
+TextureHandle cubeTexture;
+GLuint whiteTexture = 0;
 GLFWwindow* window;
 int width, height;
 
@@ -148,21 +187,11 @@ static bool Initiate(int w, int h, const char* title)
 }
 
 static void Terminate() {
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &cubeEBO);
-
-    glDeleteVertexArrays(1, &HumanVAO);
-    glDeleteBuffers(1, &HumanVBO);
-    glDeleteBuffers(1, &HumanEBO);
-
-    glDeleteVertexArrays(1, &Wolf1VAO);
-    glDeleteBuffers(1, &Wolf1VBO);
-    glDeleteBuffers(1, &Wolf1EBO);
-
-    glDeleteVertexArrays(1, &Wolf2VAO);
-    glDeleteBuffers(1, &Wolf2VBO);
-    glDeleteBuffers(1, &Wolf2EBO);
+    // Dropping the last handles frees the GL buffers and textures, so do it before the context goes away
+    scene.clear();
+    defaultMaterial.diffuseMap = nullptr;
+    cubeTexture = nullptr;
+    stagingRing.destroy();
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -212,164 +241,113 @@ GLuint createShaderProgram(const char* vertexPath, const char* fragmentPath) {
 
     GLint success;
     glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
     if (!success) {
         char infoLog[512];
         glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
         std::cerr << "Shader linking failed: " << infoLog << std::endl;
+        glDeleteProgram(shaderProgram);
+        return 0;
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
     return shaderProgram;
 }
 
-// Load model using TinyOBJLoader
-bool loadModel(const std::string& path, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-
-    bool success = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str());
-    if (!warn.empty()) std::cerr << "WARN: " << warn << std::endl;
-    if (!err.empty()) std::cerr << "ERR: " << err << std::endl;
-    if (!success) return false;
-
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            vertices.push_back(attrib.vertices[3 * index.vertex_index + 0]);
-            vertices.push_back(attrib.vertices[3 * index.vertex_index + 1]);
-            vertices.push_back(attrib.vertices[3 * index.vertex_index + 2]);
-
-            vertices.push_back(attrib.normals[3 * index.normal_index + 0]);
-            vertices.push_back(attrib.normals[3 * index.normal_index + 1]);
-            vertices.push_back(attrib.normals[3 * index.normal_index + 2]);
-
-            if (index.texcoord_index >= 0) {
-                vertices.push_back(attrib.texcoords[2 * index.texcoord_index + 0]);
-                vertices.push_back(attrib.texcoords[2 * index.texcoord_index + 1]);
-            }
-            else {
-                vertices.push_back(0.0f); 
-                vertices.push_back(0.0f);
-            }
-
-            indices.push_back(indices.size());
-        }
-    }
-
-    return true;
-}
-
-GLuint loadTexture(const char* path) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-        printf("Texture loaded: %s size : (%d,%d)\n", path, width, height);
-        GLenum format = GL_RGB;
-        if (nrChannels == 1)      format = GL_RED;
-        else if (nrChannels == 3) format = GL_RGB;
-        else if (nrChannels == 4) format = GL_RGBA;
-
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-    }
-
-    stbi_image_free(data);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    return textureID;
+// Uniforms that stay the same every frame, set once per program
+static void setLightColors(GLuint shaderProgram)
+{
+    glUseProgram(shaderProgram);
+    glUniform3f(glGetUniformLocation(shaderProgram, "light.ambient"), 0.2f, 0.2f, 0.2f);
+    glUniform3f(glGetUniformLocation(shaderProgram, "light.diffuse"), 0.5f, 0.5f, 0.5f);
+    glUniform3f(glGetUniformLocation(shaderProgram, "light.specular"), 1.0f, 1.0f, 1.0f);
 }
 
-static void Setup(GLuint& VAO, GLuint& VBO, GLuint& EBO, const std::vector<float>& vertices, const std::vector<unsigned int>& indices)
+// Requests every asset of the scene; objects appear as their mesh finishes
+// loading, and objects that use the same file share one mesh
+static void LoadScene(AssetLoader& loader)
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    auto place = [&loader](const char* path, const glm::mat4& model, const glm::vec3& color) {
+        loader.loadMesh(path, [path, model, color](MeshHandle mesh) {
+            if (!mesh) {
+                std::cerr << "Failed to load obj: " << path << std::endl;
+                return;
+            }
+            scene.push_back({ mesh, model, color });
+        });
+    };
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(0.2f, -0.6f, 0.0f));
+        model = glm::rotate(model, glm::radians(-115.0f), glm::vec3(0, 1, 0));
+        model = glm::scale(model, glm::vec3(0.06f));
+        place("Objects\\Cottage\\cottage_obj.obj", model, glm::vec3(1.0f, 0.8f, 0.2f));
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(0.0f, -0.35f, 2.0f));
+        model = glm::scale(model, glm::vec3(0.001f));
+        place("Objects\\OBJ\\OBJ.obj", model, glm::vec3(0.8f, 0.7f, 0.6f));
+    }
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(1.5f, -0.5f, -1.0f));
+        model = glm::scale(model, glm::vec3(0.6f));
+        place("Objects\\Wolf\\Wolf_obj.obj", model, glm::vec3(0.8f, 0.8f, 0.2f));
+    }
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(-1.5f, -0.5f, -2.0f));
+        model = glm::scale(model, glm::vec3(0.6f));
+        place("Objects\\Wolf\\Wolf_obj.obj", model, glm::vec3(0.2f, 0.5f, 0.2f));
+    }
 
-    glBindVertexArray(0);
+    loader.loadTexture("Objects\\Texture_Old_paint.jpg", [](TextureHandle texture) { cubeTexture = texture; });
 }
 
-
-int main() {
+int main(int argc, char** argv) {
+    if (isBenchmarkCommand(argc, argv)) {
+        return runBenchmark(argc, argv);
+    }
  
     if (!Initiate(800, 600, "Computer Graphics Project")) {
         return -1;
     }
     
-    std::vector<float> cubeVertices;
-    std::vector<unsigned int> cubeIndices;
-    if (!loadModel("Objects\\Cottage\\cottage_obj.obj", cubeVertices, cubeIndices)) {
-        std::cerr << "Failed to load obj" << std::endl;
-        return -1;
-    }
-
-    std::vector<float> HumanVertices;
-    std::vector<unsigned int> HumanIndices;
-    if (!loadModel("Objects\\OBJ\\OBJ.obj", HumanVertices, HumanIndices)) {
-        std::cerr << "Failed to load obj" << std::endl;
-        return -1;
+    // Edited assets and shaders are reloaded while the scene runs
+    FileWatcher fileWatcher;
+    std::vector<std::string> changedFiles;
+    AssetLoader assetLoader(meshRegistry, textureCache);
+    assetLoader.setFileWatcher(&fileWatcher);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            assetLoader.setTextureBudget((size_t)strtoull(argv[++i], nullptr, 10) << 20);
+        }
+        else if (strcmp(argv[i], "--compress-cache") == 0) {
+            setMeshCacheCompression(true);
+        }
     }
-
-    std::vector<float> Wolf1Vertices;
-    std::vector<unsigned int> Wolf1Indices;
-    if (!loadModel("Objects\\Wolf\\Wolf_obj.obj", Wolf1Vertices, Wolf1Indices)) {
-        std::cerr << "Failed to load obj" << std::endl;
-        return -1;
+    if (stagingRing.create()) {
+        assetLoader.setStagingRing(&stagingRing);
+        printf("Staging ring: %zu MB, %s\n", stagingRing.capacity() >> 20,
+            stagingRing.persistent() ? "persistent mapping" : "mapped per upload");
     }
+    float loadStart = (float)glfwGetTime();
+    LoadScene(assetLoader);
+    bool sceneLoaded = false;
+    bool residencyKeyDown = false;
 
-    std::vector<float> Wolf2Vertices;
-    std::vector<unsigned int> Wolf2Indices;
-    if (!loadModel("Objects\\Wolf\\Wolf_obj.obj", Wolf2Vertices, Wolf2Indices)) {
-        std::cerr << "Failed to load obj" << std::endl;
+    GLuint shaderProgram = createShaderProgram("vertex_shader.glsl", "fragment_shader.glsl");
+    if (!shaderProgram) {
+        Terminate();
         return -1;
     }
-
-    // Cube
-    Setup(cubeVAO, cubeVBO, cubeEBO, cubeVertices, cubeIndices);
-
-    // Human
-    Setup(HumanVAO, HumanVBO, HumanEBO, HumanVertices, HumanIndices);
-
-    // Wolf1
-    Setup(Wolf1VAO, Wolf1VBO, Wolf1EBO, Wolf1Vertices, Wolf1Indices);
-
-    // Wolf2
-    Setup(Wolf2VAO, Wolf2VBO, Wolf2EBO, Wolf2Vertices, Wolf2Indices);
-
-   
-    GLuint shaderProgram = createShaderProgram("vertex_shader.glsl", "fragment_shader.glsl");
-
-    GLuint cubeTexture = loadTexture("Objects\\Texture_Old_paint.jpg");
+    fileWatcher.watch("vertex_shader.glsl");
+    fileWatcher.watch("fragment_shader.glsl");
 
     // Set up camera
     glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
@@ -379,18 +357,15 @@ int main() {
 
     glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-    glUseProgram(shaderProgram);
+    setLightColors(shaderProgram);
     glUniform3f(glGetUniformLocation(shaderProgram, "light.position"), lightPos.x, lightPos.y, lightPos.z);
-    glUniform3f(glGetUniformLocation(shaderProgram, "light.ambient"), 0.2f, 0.2f, 0.2f);
-    glUniform3f(glGetUniformLocation(shaderProgram, "light.diffuse"), 0.5f, 0.5f, 0.5f);
-    glUniform3f(glGetUniformLocation(shaderProgram, "light.specular"), 1.0f, 1.0f, 1.0f);
 
-    glUniform3f(glGetUniformLocation(shaderProgram, "material.ambient"), 1.0f, 0.5f, 0.31f);
-    glUniform3f(glGetUniformLocation(shaderProgram, "material.diffuse"), 1.0f, 0.5f, 0.31f);
-    glUniform3f(glGetUniformLocation(shaderProgram, "material.specular"), 0.5f, 0.5f, 0.5f);
-    glUniform1f(glGetUniformLocation(shaderProgram, "material.shininess"), 32.0f);
+    whiteTexture = createSolidTexture(255, 255, 255);
+    defaultMaterial.specular = glm::vec3(0.5f);
+    defaultMaterial.shininess = 32.0f;
 
 
+    float lastTitleUpdate = 0.0f;
     while (!glfwWindowShouldClose(window)) {
 
 
@@ -399,6 +374,41 @@ int main() {
         lastFrame = currentFrame;
 
         processInput(window);
+        // T lists which levels of each texture are resident
+        bool residencyKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+        if (residencyKey && !residencyKeyDown) assetLoader.streamer().printResidency();
+        residencyKeyDown = residencyKey;
+
+        // Changed meshes and textures are re-imported by the loader's workers
+        // and swapped in by pumpUploads; shaders are quick enough to rebuild
+        // here. A shader that fails to build leaves the old program in use.
+        fileWatcher.poll(changedFiles);
+        bool shadersChanged = false;
+        for (const std::string& path : changedFiles) {
+            if (!assetLoader.reload(path)) shadersChanged = true;
+        }
+        if (shadersChanged) {
+            if (GLuint program = createShaderProgram("vertex_shader.glsl", "fragment_shader.glsl")) {
+                glDeleteProgram(shaderProgram);
+                shaderProgram = program;
+                setLightColors(shaderProgram);
+                printf("Shaders reloaded\n");
+            }
+        }
+
+        // Upload whatever the workers finished, without stalling the frame
+        assetLoader.pumpUploads(4.0);
+        if (!sceneLoaded && assetLoader.pending() == 0) {
+            sceneLoaded = true;
+            printf("Scene loaded in %.2f s\n", currentFrame - loadStart);
+            meshRegistry.printStats();
+            textureCache.printStats();
+            assetLoader.streamer().printStats();
+            printf("Texture arrays: %zu of %d layers, %.2f MB\n", assetLoader.textureArrays().arrayCount(),
+                kArrayLayers, assetLoader.textureArrays().bytes() / (1024.0 * 1024.0));
+            printf("Texture decode peak: %.2f MB of %.0f MB budget\n", assetLoader.decodePeakBytes() / (1024.0 * 1024.0),
+                kDecodeBudget / (1024.0 * 1024.0));
+        }
 
         view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
@@ -422,61 +432,110 @@ int main() {
         glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
         
                
-        // Bind texture for cottage
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
         glUniform1i(glGetUniformLocation(shaderProgram, "material.diffuse"), 0);
-
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.2f, -0.6f, 0.0f));
-
-            model = glm::rotate(model, glm::radians(-115.0f), glm::vec3(0, 1, 0));
-
-            model = glm::scale(model, glm::vec3(0.06f));
-
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 1.0f, 0.8f, 0.2f);
-
-            glBindVertexArray(cubeVAO);
-            glDrawElements(GL_TRIANGLES, (GLsizei)cubeIndices.size(), GL_UNSIGNED_INT, 0);
+        glUniform1i(glGetUniformLocation(shaderProgram, "material.diffuseArray"), 1);
+
+        // Submeshes without a material keep the shared paint texture
+        defaultMaterial.diffuseMap = cubeTexture;
+
+        float pixelScale = (float)height / (2.0f * tan(glm::radians(fov) * 0.5f));
+        CullStats cullStats;
+        visibleObjects.clear();
+        drawQueue.clear();
+        for (const SceneObject& object : scene) {
+            // Culling runs in model space, where the bounds and meshlets live
+            const GpuMesh& mesh = *object.mesh;
+            Frustum frustum = extractFrustum(projection * view * object.model);
+            glm::vec3 eye = glm::vec3(glm::inverse(object.model) * glm::vec4(cameraPos, 1.0f));
+            glm::vec3 boundsMin = glm::make_vec3(mesh.boundsMin);
+            glm::vec3 boundsMax = glm::make_vec3(mesh.boundsMax);
+            glm::vec3 boundsCenter = (boundsMin + boundsMax) * 0.5f;
+            float boundsRadius = 0.5f * glm::length(boundsMax - boundsMin);
+            if (!isSphereVisible(frustum, boundsCenter, boundsRadius)) continue;
+
+            // Level of detail from the distance to the bounding sphere
+            glm::vec3 center = glm::vec3(object.model * glm::vec4(boundsCenter, 1.0f));
+            float scale = glm::max(glm::length(glm::vec3(object.model[0])),
+                glm::max(glm::length(glm::vec3(object.model[1])), glm::length(glm::vec3(object.model[2]))));
+            float distance = glm::length(center - cameraPos) - boundsRadius * scale;
+            const GpuLod& lod = mesh.lods[selectLod(mesh, scale, distance, pixelScale)];
+            // Diameter of the bounds on screen, which sizes the streamed diffuse maps
+            float screenSize = 2.0f * boundsRadius * scale * pixelScale / glm::max(distance, 0.1f);
+
+            size_t objectIndex = visibleObjects.size();
+            visibleObjects.push_back({ &object, frustum, eye });
+            for (size_t d = lod.drawOffset; d < lod.drawOffset + lod.drawCount; d++) {
+                const GpuDraw& draw = mesh.draws[d];
+                const GpuMaterial* material = draw.materialId >= 0 ? &mesh.materials[draw.materialId] : &defaultMaterial;
+                GLuint texture = material->diffuseMap ? material->diffuseMap->id : whiteTexture;
+                GLenum target = material->diffuseMap && material->diffuseMap->packed.array ? GL_TEXTURE_2D_ARRAY
+                                                                                            : GL_TEXTURE_2D;
+                if (material->diffuseMap) material->diffuseMap->requestScreenSize(screenSize);
+                drawQueue.push_back({ texture, target, material, objectIndex, &draw });
+            }
         }
 
+        // Texture binds cost the most, then material uniforms, then per-object state
+        std::sort(drawQueue.begin(), drawQueue.end(), [](const QueuedDraw& a, const QueuedDraw& b) {
+            if (a.texture != b.texture) return a.texture < b.texture;
+            if (a.material != b.material) return a.material < b.material;
+            return a.object < b.object;
+        });
+
+        // Packed maps sample unit 1, the rest unit 0, so each keeps its binding
+        GLuint boundTexture = 0, boundArray = 0;
+        const GpuMaterial* boundMaterial = nullptr;
+        size_t boundObject = scene.size();
+        size_t textureBinds = 0;
+        for (const QueuedDraw& queued : drawQueue) {
+            GLuint& bound = queued.target == GL_TEXTURE_2D_ARRAY ? boundArray : boundTexture;
+            if (queued.texture != bound) {
+                if (queued.target == GL_TEXTURE_2D_ARRAY) glActiveTexture(GL_TEXTURE1);
+                glBindTexture(queued.target, queued.texture);
+                glActiveTexture(GL_TEXTURE0);
+                bound = queued.texture;
+                textureBinds++;
+            }
+            if (queued.material != boundMaterial) {
+                const GpuMaterial& material = *queued.material;
+                glUniform3fv(glGetUniformLocation(shaderProgram, "material.diffuseColor"), 1, glm::value_ptr(material.diffuseColor));
+                glUniform3fv(glGetUniformLocation(shaderProgram, "material.specular"), 1, glm::value_ptr(material.specular));
+                glUniform1f(glGetUniformLocation(shaderProgram, "material.shininess"), material.shininess);
+                bool packed = material.diffuseMap && material.diffuseMap->packed.array;
+                glUniform1f(glGetUniformLocation(shaderProgram, "material.diffuseLayer"),
+                    packed ? (float)material.diffuseMap->packed.layer : -1.0f);
+                boundMaterial = queued.material;
+            }
 
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, -0.35f, 2.0f));
-            model = glm::scale(model, glm::vec3(0.001f));
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.8f, 0.7f, 0.6f);
-
-            glBindVertexArray(HumanVAO);
-            glDrawElements(GL_TRIANGLES, (GLsizei)HumanIndices.size(), GL_UNSIGNED_INT, 0);
-        }
+            const VisibleObject& visible = visibleObjects[queued.object];
+            const SceneObject& object = *visible.object;
+            if (queued.object != boundObject) {
+                // Normals use the scene transform only; packed positions also need their dequantization
+                glm::mat4 model = object.model * object.mesh->dequantize;
+                glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+                glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+                glm::mat3 tangentMatrix = glm::mat3(object.model);
+                glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "tangentMatrix"), 1, GL_FALSE, glm::value_ptr(tangentMatrix));
+                glUniform1i(glGetUniformLocation(shaderProgram, "octahedralNormals"), object.mesh->packed);
+                glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), object.color.r, object.color.g, object.color.b);
+                glBindVertexArray(object.mesh->VAO);
+                boundObject = queued.object;
+            }
 
- 
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(1.5f, -0.5f, -1.0f));
-            model = glm::scale(model, glm::vec3(0.6f));
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.8f, 0.8f, 0.2f);
-
-            glBindVertexArray(Wolf1VAO);
-            glDrawElements(GL_TRIANGLES, (GLsizei)Wolf1Indices.size(), GL_UNSIGNED_INT, 0);
+            drawVisibleMeshlets(*object.mesh, *queued.draw, visible.frustum, visible.eye, cullStats);
         }
 
-
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-1.5f, -0.5f, -2.0f));
-            model = glm::scale(model, glm::vec3(0.6f));
-
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.2f, 0.5f, 0.2f);
-
-            glBindVertexArray(Wolf2VAO);
-            glDrawElements(GL_TRIANGLES, (GLsizei)Wolf2Indices.size(), GL_UNSIGNED_INT, 0);
+        // Once a second, show how much of the scene culling kept
+        if (currentFrame - lastTitleUpdate >= 1.0f) {
+            lastTitleUpdate = currentFrame;
+            char title[200];
+            snprintf(title, sizeof(title), "Computer Graphics Project - %zu/%zu meshlets, %zu/%zu triangles, %zu draws, %zu texture binds, %.0f/%.0f MB textures (%zu refining)",
+                cullStats.meshletsDrawn, cullStats.meshlets, cullStats.trianglesDrawn, cullStats.triangles,
+                drawQueue.size(), textureBinds, textureCache.gpuBytes() / (1024.0 * 1024.0),
+                assetLoader.streamer().budget() / (1024.0 * 1024.0), assetLoader.streamer().refiningCount());
+            glfwSetWindowTitle(window, title);
         }
 
         glfwSwapBuffers(window);
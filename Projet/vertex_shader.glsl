@@ -1,21 +1,49 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec3 aNormal; // xy only when octahedral
 layout (location = 2) in vec2 aTexCoord; // Coordonnes de texture en entre
+layout (location = 3) in vec4 aTangent; // w is the bitangent sign; only x, a 16-bit code, when octahedral
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec4 Tangent; // world space, w is the bitangent sign
 
 
-uniform mat4 model;
+uniform mat4 model; // includes the dequantization of packed positions
+uniform mat3 normalMatrix;
+uniform mat3 tangentMatrix; // scene transform without the dequantization
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool octahedralNormals;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+// Same basis as tangentBasis on the CPU
+vec4 tangentDecode(float code, vec3 n) {
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+    vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);
+    float angle = mod(code, 32768.0) * (6.28318531 / 32768.0);
+    return vec4(cos(angle) * b1 + sin(angle) * b2, code >= 32768.0 ? -1.0 : 1.0);
+}
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 normal = octahedralNormals ? octDecode(aNormal.xy) : aNormal;
+    vec4 tangent = octahedralNormals ? tangentDecode(aTangent.x, normal) : aTangent;
+    Normal = normalMatrix * normal;
+    Tangent = vec4(tangentMatrix * tangent.xyz, tangent.w);
     TexCoord = aTexCoord;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);